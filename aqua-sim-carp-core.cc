@@ -0,0 +1,716 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-carp-core.h"
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdint.h>
+
+using namespace ns3;
+
+CarpCore::CarpCore(CarpCoreEnv *env) :
+  m_env(env),
+  m_multipath(false),
+  m_multipathTolerance(0.1),
+  m_scheduler(WEIGHTED_RR),
+  m_numPkt(4),
+  m_alpha(0.85),
+  m_maxNeighbors(256),
+  m_hopCount(0),
+  m_probeStart(0),
+  m_linkQuality(0),
+  m_nextHop(0),
+  m_backupHop(0),
+  m_drrIndex(0)
+{
+}
+
+void
+CarpCore::SetEnv(CarpCoreEnv *env)
+{
+  m_env = env;
+}
+
+void
+CarpCore::SetMultipath(bool multipath)
+{
+  m_multipath = multipath;
+}
+
+bool
+CarpCore::GetMultipath() const
+{
+  return m_multipath;
+}
+
+void
+CarpCore::SetMultipathTolerance(double tolerance)
+{
+  m_multipathTolerance = tolerance;
+}
+
+double
+CarpCore::GetMultipathTolerance() const
+{
+  return m_multipathTolerance;
+}
+
+void
+CarpCore::SetScheduler(Scheduler scheduler)
+{
+  m_scheduler = scheduler;
+}
+
+CarpCore::Scheduler
+CarpCore::GetScheduler() const
+{
+  return m_scheduler;
+}
+
+void
+CarpCore::SetProbeCount(uint8_t frames)
+{
+  m_numPkt = frames;
+}
+
+uint8_t
+CarpCore::GetProbeCount() const
+{
+  return m_numPkt;
+}
+
+void
+CarpCore::SetLinkQualityWeight(double alpha)
+{
+  m_alpha = alpha;
+}
+
+void
+CarpCore::SetMaxNeighbors(uint32_t neighbors)
+{
+  m_maxNeighbors = neighbors;
+}
+
+uint32_t
+CarpCore::GetMaxNeighbors() const
+{
+  return m_maxNeighbors;
+}
+
+/*
+ * Keeps the smallest hop count from the sink heard from every neighbor. The
+ * hop count of this node is the smallest hop count heard, as HELLOs count the
+ * hop that delivered them.
+ */
+void
+CarpCore::RecvHello(CarpAddr neighbor, uint16_t hops)
+{
+  std::map<CarpAddr, uint16_t>::iterator it = m_neighbor.find(neighbor);
+  if (it == m_neighbor.end())
+    {
+      if (!MakeRoom(hops))
+        {
+          return;
+        }
+      m_neighbor.insert(std::make_pair(neighbor, hops));
+    }
+  else if (hops < it->second)
+    {
+      it->second = hops;
+    }
+  if (hops > 0 && (m_hopCount == 0 || hops < m_hopCount))
+    {
+      m_hopCount = std::min<uint16_t>(hops, UINT8_MAX);
+    }
+}
+
+const std::map<CarpAddr, uint16_t> &
+CarpCore::GetNeighbors() const
+{
+  return m_neighbor;
+}
+
+uint8_t
+CarpCore::GetHopCount() const
+{
+  return m_hopCount;
+}
+
+/*
+ * Frees an entry of a full neighbor table for a neighbor at hops from the
+ * sink. The neighbor furthest from the sink is evicted if it is further than
+ * hops and is neither the next hop nor the backup hop. Returns false if the
+ * new neighbor has to be left out.
+ */
+bool
+CarpCore::MakeRoom(uint16_t hops)
+{
+  if (m_maxNeighbors == 0 || m_neighbor.size() < m_maxNeighbors)
+    {
+      return true;
+    }
+  std::map<CarpAddr, uint16_t>::iterator worst = m_neighbor.end();
+  for (std::map<CarpAddr, uint16_t>::iterator it = m_neighbor.begin(); it != m_neighbor.end(); it++)
+    {
+      if (it->first != m_nextHop && it->first != m_backupHop
+          && (worst == m_neighbor.end() || it->second > worst->second))
+        {
+          worst = it;
+        }
+    }
+  if (worst == m_neighbor.end() || worst->second <= hops)
+    {
+      return false;
+    }
+  m_acks.erase(worst->first);
+  m_neighborLq.erase(worst->first);
+  for (std::vector<CarpRelay>::iterator r = m_relaySet.begin(); r != m_relaySet.end(); r++)
+    {
+      if (r->m_addr == worst->first)
+        {
+          m_relaySet.erase(r);
+          m_drrIndex = 0;
+          break;
+        }
+    }
+  m_neighbor.erase(worst);
+  return true;
+}
+
+/*
+ * A neighbor is a relay candidate if it is closer to the sink than this
+ * node. Hop counts are kept as heard, so that is the case for the neighbors
+ * whose HELLO gave this node its hop count. Nothing qualifies as long as the
+ * hop count of this node is unknown.
+ */
+bool
+CarpCore::IsUpstream(CarpAddr neighbor) const
+{
+  std::map<CarpAddr, uint16_t>::const_iterator it = m_neighbor.find(neighbor);
+  return m_hopCount > 0 && it != m_neighbor.end() && it->second <= m_hopCount;
+}
+
+/*
+ * Opens a selection window and probes every neighbor closer to the sink. The
+ * ACK counts start from zero in every window.
+ */
+void
+CarpCore::StartProbes()
+{
+  m_probeStart = m_env ? m_env->GetTime() : 0;
+  m_acks.clear();
+  for (std::map<CarpAddr, uint16_t>::iterator it = m_neighbor.begin(); it != m_neighbor.end(); it++)
+    {
+      if (!IsUpstream(it->first))
+        {
+          continue;
+        }
+      m_acks.insert(std::make_pair(it->first, 0));
+      if (m_env)
+        {
+          m_env->SendProbe(it->first, m_numPkt);
+        }
+    }
+}
+
+bool
+CarpCore::InProbeWindow(int64_t window)
+{
+  return !m_env || m_env->GetTime() - m_probeStart <= window;
+}
+
+void
+CarpCore::RecvProbeAck(CarpAddr neighbor)
+{
+  std::map<CarpAddr, int>::iterator it = m_acks.find(neighbor);
+  if (it != m_acks.end())
+    {
+      it->second++;
+    }
+}
+
+/*
+ * Closes the selection window with the PSR measured by the probes.
+ */
+void
+CarpCore::EndProbes()
+{
+  std::map<CarpAddr, double> psr;
+  for (std::map<CarpAddr, int>::iterator it = m_acks.begin(); it != m_acks.end(); it++)
+    {
+      psr[it->first] = (double) it->second / m_numPkt;
+    }
+  EndWindow(psr);
+}
+
+/*
+ * Folds the PSR of every neighbor of the window into its link quality
+ * estimate and selects the relay with the best estimate, keeping the
+ * runner-up for fast reroute. The PSRs come from the probes or from a
+ * channel model. Only neighbors closer to the sink are candidates.
+ */
+void
+CarpCore::EndWindow(const std::map<CarpAddr, double> &psr)
+{
+  double testVal = 0;
+  double runnerUpVal = 0;
+  CarpAddr best = m_nextHop;
+  CarpAddr runnerUp = 0;
+  for (std::map<CarpAddr, double>::const_iterator it = psr.begin(); it != psr.end(); it++)
+    {
+      if (!IsUpstream(it->first))
+        {
+          continue;
+        }
+      double lqVal = UpdateLinkQuality(it->first, it->second, m_alpha);
+      if (lqVal > testVal)
+        {
+          if (testVal > 0)
+            {
+              runnerUpVal = testVal;
+              runnerUp = best;
+            }
+          testVal = lqVal;
+          best = it->first;
+        }
+      else if (lqVal > runnerUpVal)
+        {
+          runnerUpVal = lqVal;
+          runnerUp = it->first;
+        }
+    }
+  m_backupHop = runnerUp;
+  m_linkQuality = testVal;
+  m_nextHop = best;
+  UpdateRelaySet(psr);
+}
+
+/*
+ * lq = weight * sample + (1 - weight) * lq_old
+ */
+double
+CarpCore::UpdateLinkQuality(CarpAddr neighbor, double sample, double weight)
+{
+  double &lqVal = m_neighborLq[neighbor];
+  lqVal = weight * sample + (1 - weight) * lqVal;
+  return lqVal;
+}
+
+/*
+ * Uses the outcome of a unicast MAC exchange as a link quality sample of its
+ * next hop. Outcomes of nodes that are not in the tables are ignored.
+ */
+void
+CarpCore::RecvTxOutcome(CarpAddr dst, bool success, double weight)
+{
+  if (m_neighborLq.find(dst) == m_neighborLq.end() && m_neighbor.find(dst) == m_neighbor.end())
+    {
+      return;
+    }
+  double lqVal = UpdateLinkQuality(dst, success ? 1.0 : 0.0, weight);
+  for (std::vector<CarpRelay>::iterator it = m_relaySet.begin(); it != m_relaySet.end(); it++)
+    {
+      if (it->m_addr == dst)
+        {
+          it->m_weight = lqVal;
+        }
+    }
+  if (dst == m_nextHop)
+    {
+      m_linkQuality = lqVal;
+    }
+}
+
+const std::map<CarpAddr, double> &
+CarpCore::GetNeighborLq() const
+{
+  return m_neighborLq;
+}
+
+uint32_t
+CarpCore::GetProbedCount() const
+{
+  return m_acks.size();
+}
+
+double
+CarpCore::GetLinkQuality() const
+{
+  return m_linkQuality;
+}
+
+/*
+ * Rebuilds the multipath relay set from the candidate neighbors. Those
+ * whose link quality lies within m_multipathTolerance of the best relay are
+ * kept, and relays surviving from the previous window keep their counters.
+ */
+void
+CarpCore::UpdateRelaySet(const std::map<CarpAddr, double> &candidates)
+{
+  std::vector<CarpRelay> relays;
+  for (std::map<CarpAddr, double>::const_iterator it = candidates.begin(); it != candidates.end(); it++)
+    {
+      double score = m_neighborLq[it->first];
+      if (!IsUpstream(it->first) || score <= 0 || score < m_linkQuality - m_multipathTolerance)
+        {
+          continue;
+        }
+      CarpRelay r;
+      r.m_addr = it->first;
+      r.m_weight = score;
+      r.m_credit = 0;
+      r.m_count = 0;
+      for (std::vector<CarpRelay>::iterator old = m_relaySet.begin(); old != m_relaySet.end(); old++)
+        {
+          if (old->m_addr == r.m_addr)
+            {
+              r.m_count = old->m_count;
+            }
+        }
+      relays.push_back(r);
+    }
+  m_relaySet.swap(relays);
+  m_drrIndex = 0;
+}
+
+/*
+ * Picks the relay of the next data packet. Falls back to the next hop unless
+ * multipath is enabled and more than one relay qualifies, in which case count
+ * receives the number of packets handed to the chosen relay so far. Relays
+ * whose weight MAC feedback has brought down to 0 get no packets.
+ */
+CarpAddr
+CarpCore::SelectRelay(uint32_t pktSize, uint32_t *count)
+{
+  if (count)
+    {
+      *count = 0;
+    }
+  if (!m_multipath || m_relaySet.size() < 2)
+    {
+      return m_nextHop;
+    }
+
+  CarpRelay *chosen = 0;
+  if (m_scheduler == DEFICIT_RR)
+    {
+      // The best relay earns one packet worth of credit per round, the others in proportion to their weight
+      double maxWeight = 0;
+      for (std::vector<CarpRelay>::iterator it = m_relaySet.begin(); it != m_relaySet.end(); it++)
+        {
+          maxWeight = std::max(maxWeight, it->m_weight);
+        }
+      if (maxWeight <= 0)
+        {
+          // MAC feedback wrote every relay off, there is nothing to share
+          return m_nextHop;
+        }
+      uint32_t size = std::max(pktSize, (uint32_t) 1);
+      while (!chosen)
+        {
+          CarpRelay &r = m_relaySet[m_drrIndex];
+          if (r.m_weight > 0 && r.m_credit >= size)
+            {
+              r.m_credit -= size;
+              chosen = &r;
+            }
+          else
+            {
+              m_drrIndex = (m_drrIndex + 1) % m_relaySet.size();
+              m_relaySet[m_drrIndex].m_credit += size * m_relaySet[m_drrIndex].m_weight / maxWeight;
+            }
+        }
+    }
+  else
+    {
+      // Smooth weighted round robin: every relay gains its weight, the leader pays back the total
+      double total = 0;
+      for (std::vector<CarpRelay>::iterator it = m_relaySet.begin(); it != m_relaySet.end(); it++)
+        {
+          if (it->m_weight <= 0)
+            {
+              continue;
+            }
+          it->m_credit += it->m_weight;
+          total += it->m_weight;
+          if (!chosen || it->m_credit > chosen->m_credit)
+            {
+              chosen = &(*it);
+            }
+        }
+      if (!chosen)
+        {
+          return m_nextHop;
+        }
+      chosen->m_credit -= total;
+    }
+  chosen->m_count++;
+  if (count)
+    {
+      *count = chosen->m_count;
+    }
+  return chosen->m_addr;
+}
+
+/*
+ * Drops a failed relay from the relay set, writes its link quality off and
+ * switches to the runner-up when it was the next hop. The best remaining
+ * relay then becomes the runner-up, so that no failed relay is picked again
+ * before a selection window has measured it anew.
+ */
+void
+CarpCore::Reroute(CarpAddr failed)
+{
+  for (std::vector<CarpRelay>::iterator it = m_relaySet.begin(); it != m_relaySet.end(); it++)
+    {
+      if (it->m_addr == failed)
+        {
+          m_relaySet.erase(it);
+          break;
+        }
+    }
+  m_drrIndex = 0;
+  std::map<CarpAddr, double>::iterator failedLq = m_neighborLq.find(failed);
+  if (failedLq != m_neighborLq.end())
+    {
+      failedLq->second = 0;
+    }
+  if (failed == m_nextHop)
+    {
+      m_nextHop = m_backupHop == failed ? 0 : m_backupHop;
+      m_backupHop = 0;
+      std::map<CarpAddr, double>::iterator lq = m_neighborLq.find(m_nextHop);
+      m_linkQuality = lq == m_neighborLq.end() ? 0 : lq->second;
+    }
+  if (failed == m_backupHop)
+    {
+      m_backupHop = 0;
+    }
+  if (!m_backupHop)
+    {
+      m_backupHop = FindRunnerUp();
+    }
+}
+
+/*
+ * Best relay other than the next hop with a link quality above 0, from the
+ * relay set first and from the link quality table of the neighbors closer to
+ * the sink otherwise. 0 if there is none.
+ */
+CarpAddr
+CarpCore::FindRunnerUp() const
+{
+  CarpAddr runnerUp = 0;
+  double runnerUpVal = 0;
+  for (std::vector<CarpRelay>::const_iterator it = m_relaySet.begin(); it != m_relaySet.end(); it++)
+    {
+      if (it->m_addr != m_nextHop && it->m_weight > runnerUpVal)
+        {
+          runnerUpVal = it->m_weight;
+          runnerUp = it->m_addr;
+        }
+    }
+  if (runnerUp)
+    {
+      return runnerUp;
+    }
+  for (std::map<CarpAddr, double>::const_iterator it = m_neighborLq.begin(); it != m_neighborLq.end(); it++)
+    {
+      if (it->first != m_nextHop && it->second > runnerUpVal && IsUpstream(it->first))
+        {
+          runnerUpVal = it->second;
+          runnerUp = it->first;
+        }
+    }
+  return runnerUp;
+}
+
+CarpAddr
+CarpCore::GetNextHop() const
+{
+  return m_nextHop;
+}
+
+CarpAddr
+CarpCore::GetBackupHop() const
+{
+  return m_backupHop;
+}
+
+const std::vector<CarpRelay> &
+CarpCore::GetRelaySet() const
+{
+  return m_relaySet;
+}
+
+CarpCoreState
+CarpCore::Save() const
+{
+  CarpCoreState state;
+  state.m_hopCount = m_hopCount;
+  state.m_nextHop = m_nextHop;
+  state.m_backupHop = m_backupHop;
+  state.m_linkQuality = m_linkQuality;
+  state.m_neighbor = m_neighbor;
+  state.m_neighborLq = m_neighborLq;
+  return state;
+}
+
+/*
+ * Replaces the tables with those of a converged node. The neighbors with a
+ * link quality estimate form the relay set.
+ */
+void
+CarpCore::Restore(const CarpCoreState &state)
+{
+  m_hopCount = state.m_hopCount;
+  m_neighbor = state.m_neighbor;
+  m_neighborLq = state.m_neighborLq;
+  m_acks.clear();
+  m_nextHop = state.m_nextHop;
+  m_backupHop = state.m_backupHop;
+  m_linkQuality = state.m_linkQuality;
+  UpdateRelaySet(m_neighborLq);
+}
+
+static const char g_snapshotMagic[8] = {'C', 'A', 'R', 'P', 'S', 'N', 'A', 'P'};
+static const uint32_t g_snapshotVersion = 2; // 1 was written in host byte order
+
+// Writes the bytes-wide integer v least significant byte first
+static void
+SnapshotPut(std::ostream &os, uint64_t v, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+    {
+      os.put((char) ((v >> (8 * i)) & 0xff));
+    }
+}
+
+static uint64_t
+SnapshotGet(std::istream &is, int bytes)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++)
+    {
+      int c = is.get();
+      v |= (uint64_t) (c & 0xff) << (8 * i);
+    }
+  return v;
+}
+
+static void
+SnapshotPutDouble(std::ostream &os, double d)
+{
+  uint64_t v;
+  std::memcpy(&v, &d, sizeof(v));
+  SnapshotPut(os, v, 8);
+}
+
+static double
+SnapshotGetDouble(std::istream &is)
+{
+  uint64_t v = SnapshotGet(is, 8);
+  double d;
+  std::memcpy(&d, &v, sizeof(d));
+  return d;
+}
+
+void
+ns3::CarpWriteSnapshot(std::ostream &os, const std::map<CarpAddr, CarpCoreState> &nodes)
+{
+  os.write(g_snapshotMagic, sizeof(g_snapshotMagic));
+  SnapshotPut(os, g_snapshotVersion, 4);
+  SnapshotPut(os, nodes.size(), 4);
+  for (std::map<CarpAddr, CarpCoreState>::const_iterator it = nodes.begin(); it != nodes.end(); it++)
+    {
+      const CarpCoreState &state = it->second;
+      // Neighbors known only through their hop count are saved as well
+      std::map<CarpAddr, double> lq = state.m_neighborLq;
+      for (std::map<CarpAddr, uint16_t>::const_iterator h = state.m_neighbor.begin(); h != state.m_neighbor.end(); h++)
+        {
+          lq.insert(std::make_pair(h->first, 0.0));
+        }
+      SnapshotPut(os, it->first, 2);
+      SnapshotPut(os, state.m_hopCount, 1);
+      SnapshotPut(os, state.m_nextHop, 2);
+      SnapshotPut(os, state.m_backupHop, 2);
+      SnapshotPutDouble(os, state.m_linkQuality);
+      SnapshotPut(os, lq.size(), 2);
+      for (std::map<CarpAddr, double>::iterator l = lq.begin(); l != lq.end(); l++)
+        {
+          std::map<CarpAddr, uint16_t>::const_iterator h = state.m_neighbor.find(l->first);
+          SnapshotPut(os, l->first, 2);
+          SnapshotPut(os, h != state.m_neighbor.end() ? h->second : 0, 2);
+          SnapshotPutDouble(os, l->second);
+        }
+    }
+}
+
+bool
+ns3::CarpReadSnapshot(std::istream &is, std::map<CarpAddr, CarpCoreState> &nodes, std::string &error)
+{
+  char magic[sizeof(g_snapshotMagic)];
+  if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, g_snapshotMagic, sizeof(magic)) != 0)
+    {
+      error = "not a CARP snapshot";
+      return false;
+    }
+  uint32_t version = SnapshotGet(is, 4);
+  if (!is || version != g_snapshotVersion)
+    {
+      error = "unsupported snapshot version";
+      return false;
+    }
+  nodes.clear();
+  uint32_t n = SnapshotGet(is, 4);
+  for (uint32_t i = 0; i < n && is; i++)
+    {
+      CarpCoreState &state = nodes[SnapshotGet(is, 2)];
+      state.m_hopCount = SnapshotGet(is, 1);
+      state.m_nextHop = SnapshotGet(is, 2);
+      state.m_backupHop = SnapshotGet(is, 2);
+      state.m_linkQuality = SnapshotGetDouble(is);
+      uint16_t neighbors = SnapshotGet(is, 2);
+      for (uint16_t j = 0; j < neighbors && is; j++)
+        {
+          CarpAddr neighbor = SnapshotGet(is, 2);
+          uint16_t hops = SnapshotGet(is, 2);
+          double lqVal = SnapshotGetDouble(is);
+          if (hops > 0)
+            {
+              state.m_neighbor[neighbor] = hops;
+            }
+          state.m_neighborLq[neighbor] = lqVal;
+        }
+    }
+  if (!is)
+    {
+      error = "truncated snapshot";
+      return false;
+    }
+  if (is.peek() != std::char_traits<char>::eof())
+    {
+      error = "trailing bytes after the last node";
+      return false;
+    }
+  return true;
+}
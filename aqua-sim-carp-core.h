@@ -0,0 +1,187 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Routing decisions of CARP: neighbor table, hop count gradient, PSR and
+ * link quality estimation and relay selection. This header has no ns-3
+ * dependency so that the decisions can be driven, benchmarked and checked
+ * outside a simulation, as tools/carp-core-bench does.
+ */
+
+#ifndef AQUA_SIM_CARP_CORE_H
+#define AQUA_SIM_CARP_CORE_H
+
+#include <stdint.h>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+// Node address as carried by AquaSimAddress, 0 for none
+typedef uint16_t CarpAddr;
+
+// A relay in the multipath set together with its scheduling state
+struct CarpRelay
+{
+  CarpAddr m_addr;
+  double m_weight;  // Link quality score of the relay from the last selection window
+  double m_credit;  // Scheduling credit (current weight for WRR, deficit for DRR)
+  uint32_t m_count; // Number of packets handed to this relay
+};
+
+// Converged routing state of one node, as saved in a warm-start snapshot
+struct CarpCoreState
+{
+  uint8_t m_hopCount;
+  CarpAddr m_nextHop;
+  CarpAddr m_backupHop;
+  double m_linkQuality;
+  std::map<CarpAddr, uint16_t> m_neighbor; // Hop count of every neighbor from the sink
+  std::map<CarpAddr, double> m_neighborLq; // Link quality estimate of every neighbor
+};
+
+/*
+ * Warm-start snapshot of the states of every node, keyed by node address.
+ * The layout is fixed little-endian whatever the host:
+ * "CARPSNAP", uint32 version, uint32 number of nodes, then per node
+ * uint16 address, uint8 hop count, uint16 next hop, uint16 backup hop,
+ * float64 link quality, uint16 number of neighbors and per neighbor
+ * uint16 address, uint16 hop count (0 if unknown), float64 link quality.
+ * CarpReadSnapshot rejects other magics and versions as well as truncated
+ * files and trailing bytes, with the reason in error.
+ */
+void CarpWriteSnapshot(std::ostream &os, const std::map<CarpAddr, CarpCoreState> &nodes);
+bool CarpReadSnapshot(std::istream &is, std::map<CarpAddr, CarpCoreState> &nodes, std::string &error);
+
+/*
+ * What the core needs from its surroundings: the current time and a way to
+ * send a train of link-quality probes. Everything it receives comes in
+ * through the Recv* methods of CarpCore.
+ */
+class CarpCoreEnv
+{
+public:
+  virtual ~CarpCoreEnv() {}
+  // Current time (ns)
+  virtual int64_t GetTime() = 0;
+  // Sends frames LQ_DATA probes to neighbor, each to be acknowledged by RecvProbeAck
+  virtual void SendProbe(CarpAddr neighbor, uint8_t frames) = 0;
+};
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Routing state and decisions of one CARP node
+  *
+  * A selection window starts with StartProbes, collects the ACKs of the
+  * probes with RecvProbeAck and ends with EndProbes, which folds the PSR of
+  * every neighbor into its link quality and picks the relay, its runner-up
+  * and the multipath relay set among the neighbors closer to the sink. EndWindow does the same with PSRs computed
+  * elsewhere, without probes. SelectRelay then picks the relay of every
+  * data packet.
+  *
+  * Every table is bounded by the neighbor table: once it holds
+  * MaxNeighbors entries, a new neighbor only gets in by evicting the
+  * neighbor furthest from the sink, if it is closer.
+  */
+class CarpCore
+{
+public:
+  enum Scheduler
+  {
+    WEIGHTED_RR = 0,
+    DEFICIT_RR = 1
+  };
+
+  explicit CarpCore(CarpCoreEnv *env = 0);
+  void SetEnv(CarpCoreEnv *env);
+
+  void SetMultipath(bool multipath);
+  bool GetMultipath() const;
+  void SetMultipathTolerance(double tolerance);
+  double GetMultipathTolerance() const;
+  void SetScheduler(Scheduler scheduler);
+  Scheduler GetScheduler() const;
+  void SetProbeCount(uint8_t frames);
+  uint8_t GetProbeCount() const;
+  void SetLinkQualityWeight(double alpha);
+  // Bound of the neighbor table, 0 for none
+  void SetMaxNeighbors(uint32_t neighbors);
+  uint32_t GetMaxNeighbors() const;
+
+  // Neighbor table and hop count gradient
+  void RecvHello(CarpAddr neighbor, uint16_t hops);
+  const std::map<CarpAddr, uint16_t> &GetNeighbors() const;
+  uint8_t GetHopCount() const;
+  bool IsUpstream(CarpAddr neighbor) const;
+
+  // PSR and link quality estimation
+  void StartProbes();
+  bool InProbeWindow(int64_t window);
+  void RecvProbeAck(CarpAddr neighbor);
+  void EndProbes();
+  // Closes a window with the PSR of every neighbor given instead of probed
+  void EndWindow(const std::map<CarpAddr, double> &psr);
+  double UpdateLinkQuality(CarpAddr neighbor, double sample, double weight);
+  void RecvTxOutcome(CarpAddr dst, bool success, double weight);
+  const std::map<CarpAddr, double> &GetNeighborLq() const;
+  uint32_t GetProbedCount() const;
+  double GetLinkQuality() const;
+
+  // Relay selection
+  CarpAddr SelectRelay(uint32_t pktSize, uint32_t *count = 0);
+  void Reroute(CarpAddr failed);
+  CarpAddr GetNextHop() const;
+  CarpAddr GetBackupHop() const;
+  const std::vector<CarpRelay> &GetRelaySet() const;
+
+  // Warm start
+  CarpCoreState Save() const;
+  void Restore(const CarpCoreState &state);
+
+private:
+  bool MakeRoom(uint16_t hops);
+  CarpAddr FindRunnerUp() const;
+  void UpdateRelaySet(const std::map<CarpAddr, double> &candidates);
+
+  CarpCoreEnv *m_env;
+  bool m_multipath;
+  double m_multipathTolerance;
+  Scheduler m_scheduler;
+  uint8_t m_numPkt; // Probes sent to every neighbor per selection window
+  double m_alpha;   // Weight of the PSR of a window in the link quality estimate
+  uint32_t m_maxNeighbors;
+
+  uint8_t m_hopCount;
+  std::map<CarpAddr, uint16_t> m_neighbor;
+  std::map<CarpAddr, int> m_acks; // Probe ACKs of every neighbor probed in the current window
+  int64_t m_probeStart;
+  std::map<CarpAddr, double> m_neighborLq;
+  double m_linkQuality;
+  CarpAddr m_nextHop;
+  CarpAddr m_backupHop; // Runner-up relay of the last selection window
+  std::vector<CarpRelay> m_relaySet;
+  uint32_t m_drrIndex;
+};  // class CarpCore
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_CARP_CORE_H */
@@ -0,0 +1,115 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-carp-diag.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace ns3;
+
+std::vector<CarpTraceRecord> CarpEventRing::s_ring;
+uint32_t CarpEventRing::s_capacity = 0;
+uint64_t CarpEventRing::s_next = 0;
+std::terminate_handler CarpEventRing::s_previous = 0;
+
+void
+CarpEventRing::Enable(uint32_t capacity)
+{
+  s_ring.assign(capacity, CarpTraceRecord());
+  s_capacity = capacity;
+  s_next = 0;
+  if (capacity && !s_previous)
+    {
+      s_previous = std::set_terminate(&CarpEventRing::Terminate);
+    }
+}
+
+uint64_t
+CarpEventRing::GetRecorded()
+{
+  return s_next;
+}
+
+const char *
+CarpEventRing::GetName(uint8_t event)
+{
+  switch (event)
+    {
+    case CARP_TRACE_TX:
+      return "tx";
+    case CARP_TRACE_RX:
+      return "rx";
+    case CARP_TRACE_DELIVER:
+      return "deliver";
+    case CARP_TRACE_DROP:
+      return "drop";
+    case CARP_TRACE_SEND:
+      return "send";
+    case CARP_DIAG_NEXT_HOP:
+      return "next-hop";
+    case CARP_DIAG_REROUTE:
+      return "reroute";
+    default:
+      return "?";
+    }
+}
+
+void
+CarpEventRing::Dump(std::ostream &os)
+{
+  uint64_t kept = std::min<uint64_t>(s_next, s_capacity);
+  os << "CarpEventRing: last " << kept << " of " << s_next << " events\n"
+     << "time(s) node event type uid src dst next hops size\n";
+  char line[160];
+  for (uint64_t i = s_next - kept; i < s_next; i++)
+    {
+      const CarpTraceRecord &r = s_ring[i % s_capacity];
+      std::snprintf(line, sizeof(line), "%.9f %u %s %u %llu %u %u %u %u %u\n", r.m_time * 1e-9,
+                    r.m_node, GetName(r.m_event), (unsigned) r.m_type, (unsigned long long) r.m_uid,
+                    (unsigned) r.m_src, (unsigned) r.m_dst, (unsigned) r.m_next, (unsigned) r.m_hops,
+                    (unsigned) r.m_size);
+      os << line;
+    }
+  os.flush();
+}
+
+void
+CarpEventRing::Dump()
+{
+  Dump(std::cerr);
+}
+
+/* Prints the ring once, then lets the previous handler abort */
+void
+CarpEventRing::Terminate()
+{
+  if (s_capacity)
+    {
+      Dump();
+      s_capacity = 0;
+    }
+  if (s_previous)
+    {
+      s_previous();
+    }
+  std::abort();
+}
@@ -0,0 +1,129 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Diagnostics of the CARP module.
+ *
+ * CARP_LOG_WARN, CARP_LOG_INFO and CARP_LOG_FUNCTION are the NS_LOG calls
+ * of the module, filtered at compile time by CARP_LOG_LEVEL. It defaults to
+ * CARP_LOG_LEVEL_FUNCTION in builds with ns-3 logging and to
+ * CARP_LOG_LEVEL_NONE otherwise, where the macros expand to nothing.
+ * -DCARP_LOG_LEVEL=1 (warnings only) drops the per-packet logs of a debug
+ * build as well.
+ *
+ * CarpEventRing keeps the last packet and routing events of all the nodes
+ * in memory, to be dumped when a run dies.
+ */
+
+#ifndef AQUA_SIM_CARP_DIAG_H
+#define AQUA_SIM_CARP_DIAG_H
+
+#include "aqua-sim-carp-trace-record.h"
+#include "ns3/log.h"
+
+#include <exception>
+#include <ostream>
+#include <vector>
+
+#define CARP_LOG_LEVEL_NONE 0
+#define CARP_LOG_LEVEL_WARN 1
+#define CARP_LOG_LEVEL_INFO 2
+#define CARP_LOG_LEVEL_FUNCTION 3
+
+#ifndef CARP_LOG_LEVEL
+#ifdef NS3_LOG_ENABLE
+#define CARP_LOG_LEVEL CARP_LOG_LEVEL_FUNCTION
+#else
+#define CARP_LOG_LEVEL CARP_LOG_LEVEL_NONE
+#endif
+#endif
+
+#if CARP_LOG_LEVEL >= CARP_LOG_LEVEL_WARN
+#define CARP_LOG_WARN(msg) NS_LOG_WARN (msg)
+#else
+#define CARP_LOG_WARN(msg)
+#endif
+
+#if CARP_LOG_LEVEL >= CARP_LOG_LEVEL_INFO
+#define CARP_LOG_INFO(msg) NS_LOG_INFO (msg)
+#else
+#define CARP_LOG_INFO(msg)
+#endif
+
+#if CARP_LOG_LEVEL >= CARP_LOG_LEVEL_FUNCTION
+#define CARP_LOG_FUNCTION(args) NS_LOG_FUNCTION (args)
+#else
+#define CARP_LOG_FUNCTION(args)
+#endif
+
+namespace ns3 {
+
+// Routing events kept in the ring next to the CarpTraceEvent packet events
+enum CarpDiagEvent
+{
+  CARP_DIAG_NEXT_HOP = 16, // Selection window closed, m_next is the relay and m_size the link quality in percent
+  CARP_DIAG_REROUTE = 17   // Relay m_dst failed, m_next is the relay that replaces it
+};
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Process-wide ring of the last CARP events
+  *
+  * Disabled until Enable is called, and then costs a copy of a 32-byte
+  * record per event. Enable also installs a terminate handler, so that
+  * NS_FATAL_ERROR and failed NS_ASSERTs print the ring on stderr before
+  * aborting. Dump can be called from a debugger as well.
+  */
+class CarpEventRing
+{
+public:
+  // Keeps the last capacity events, 0 disables the ring
+  static void Enable(uint32_t capacity);
+  static bool IsEnabled()
+  {
+    return s_capacity != 0;
+  }
+  static void Record(const CarpTraceRecord &r)
+  {
+    if (s_capacity)
+      {
+        s_ring[s_next++ % s_capacity] = r;
+      }
+  }
+  // Events ever recorded, including those overwritten
+  static uint64_t GetRecorded();
+  static const char *GetName(uint8_t event);
+
+  // Oldest event first, one per line
+  static void Dump(std::ostream &os);
+  static void Dump();
+
+private:
+  static void Terminate();
+
+  static std::vector<CarpTraceRecord> s_ring;
+  static uint32_t s_capacity;
+  static uint64_t s_next;
+  static std::terminate_handler s_previous;
+};  // class CarpEventRing
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_CARP_DIAG_H */
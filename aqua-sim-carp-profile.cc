@@ -0,0 +1,166 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-carp-profile.h"
+
+#ifdef CARP_PROFILE
+
+#include "ns3/simulator.h"
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+using namespace ns3;
+
+static const char *g_handlerNames[CARP_H_COUNT] =
+  { "Recv", "RecvHello", "SendPing", "SendPong", "RecvPong", "SetNextHop", "RecvAck", "ForwardData" };
+
+std::map<const CarpProfile *, uint32_t> CarpProfiler::s_live;
+std::map<uint32_t, CarpProfile> CarpProfiler::s_done;
+bool CarpProfiler::s_scheduled = false;
+
+CarpProfile::CarpProfile()
+{
+  std::memset(m_calls, 0, sizeof(m_calls));
+  std::memset(m_ticks, 0, sizeof(m_ticks));
+}
+
+void
+CarpProfile::Add(const CarpProfile &other)
+{
+  for (uint32_t h = 0; h < CARP_H_COUNT; h++)
+    {
+      m_calls[h] += other.m_calls[h];
+      m_ticks[h] += other.m_ticks[h];
+    }
+}
+
+uint64_t
+CarpProfile::GetCalls() const
+{
+  uint64_t n = 0;
+  for (uint32_t h = 0; h < CARP_H_COUNT; h++)
+    {
+      n += m_calls[h];
+    }
+  return n;
+}
+
+uint64_t
+CarpProfile::GetTicks() const
+{
+  // Handlers nest (Recv calls most of the others), so this counts the
+  // outermost handler only
+  return m_ticks[CARP_H_RECV] + m_ticks[CARP_H_SEND_PING];
+}
+
+uint64_t
+CarpProfiler::Now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+const char *
+CarpProfiler::GetName(uint8_t handler)
+{
+  return (handler < CARP_H_COUNT) ? g_handlerNames[handler] : "?";
+}
+
+void
+CarpProfiler::Register(uint32_t node, const CarpProfile *profile)
+{
+  s_live[profile] = node;
+  if (!s_scheduled)
+    {
+      Simulator::ScheduleDestroy(&CarpProfiler::Dump);
+      s_scheduled = true;
+    }
+}
+
+void
+CarpProfiler::Unregister(const CarpProfile *profile)
+{
+  std::map<const CarpProfile *, uint32_t>::iterator it = s_live.find(profile);
+  if (it != s_live.end())
+    {
+      s_done[it->second].Add(*profile);
+      s_live.erase(it);
+    }
+}
+
+void
+CarpProfiler::Print(std::ostream &os)
+{
+  std::map<uint32_t, CarpProfile> nodes = s_done;
+  for (std::map<const CarpProfile *, uint32_t>::const_iterator it = s_live.begin(); it != s_live.end(); it++)
+    {
+      nodes[it->second].Add(*it->first);
+    }
+
+  os << "CARP profile, calls per handler\n" << std::setw(6) << "node";
+  for (uint32_t h = 0; h < CARP_H_COUNT; h++)
+    {
+      os << std::setw(12) << g_handlerNames[h];
+    }
+  os << std::setw(16) << "ticks" << "\n";
+  CarpProfile total;
+  for (std::map<uint32_t, CarpProfile>::const_iterator it = nodes.begin(); it != nodes.end(); it++)
+    {
+      os << std::setw(6) << it->first;
+      for (uint32_t h = 0; h < CARP_H_COUNT; h++)
+        {
+          os << std::setw(12) << it->second.m_calls[h];
+        }
+      os << std::setw(16) << it->second.GetTicks() << "\n";
+      total.Add(it->second);
+    }
+
+  os << "CARP profile, all " << nodes.size() << " nodes\n"
+     << std::setw(12) << "handler" << std::setw(14) << "calls" << std::setw(18) << "ticks"
+     << std::setw(14) << "ticks/call" << "\n";
+  for (uint32_t h = 0; h < CARP_H_COUNT; h++)
+    {
+      os << std::setw(12) << g_handlerNames[h] << std::setw(14) << total.m_calls[h]
+         << std::setw(18) << total.m_ticks[h]
+         << std::setw(14) << (total.m_calls[h] ? total.m_ticks[h] / total.m_calls[h] : 0) << "\n";
+    }
+}
+
+void
+CarpProfiler::Dump()
+{
+  Print(std::cout);
+  s_live.clear();
+  s_done.clear();
+  s_scheduled = false;
+}
+
+#endif /* CARP_PROFILE */
@@ -0,0 +1,95 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Per-handler profile of the CARP hot path. Everything here only exists
+ * when the module is built with -DCARP_PROFILE; otherwise the
+ * CARP_PROFILE_SCOPE markers in the handlers expand to nothing.
+ */
+
+#ifndef AQUA_SIM_CARP_PROFILE_H
+#define AQUA_SIM_CARP_PROFILE_H
+
+#ifdef CARP_PROFILE
+
+#include <map>
+#include <ostream>
+#include <stdint.h>
+
+namespace ns3 {
+
+// Handlers of AquaSimCarp marked with CARP_PROFILE_SCOPE
+enum CarpHandler
+{
+  CARP_H_RECV = 0,
+  CARP_H_RECV_HELLO,
+  CARP_H_SEND_PING,
+  CARP_H_SEND_PONG,
+  CARP_H_RECV_PONG,
+  CARP_H_SET_NEXT_HOP,
+  CARP_H_RECV_ACK,
+  CARP_H_FORWARD_DATA,
+  CARP_H_COUNT
+};
+
+// Calls into and time spent in each handler of one node
+struct CarpProfile
+{
+  CarpProfile();
+  void Add(const CarpProfile &other);
+  uint64_t GetCalls() const;
+  uint64_t GetTicks() const;
+
+  uint64_t m_calls[CARP_H_COUNT];
+  uint64_t m_ticks[CARP_H_COUNT]; // Includes the handlers called from this one
+};
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Collects the CarpProfile of every node and prints it at Simulator::Destroy
+  *
+  * Ticks are TSC cycles on x86 and nanoseconds of the steady clock elsewhere.
+  */
+class CarpProfiler
+{
+public:
+  static uint64_t Now();
+  static const char *GetName(uint8_t handler);
+
+  // Profile of a node that is live until Unregister; schedules the dump on first use
+  static void Register(uint32_t node, const CarpProfile *profile);
+  // Keeps the counters of a node whose routing is disposed
+  static void Unregister(const CarpProfile *profile);
+
+  // Per-node calls and total ticks, then calls and ticks per handler over all nodes
+  static void Print(std::ostream &os);
+  static void Dump();
+
+private:
+  static std::map<const CarpProfile *, uint32_t> s_live;
+  static std::map<uint32_t, CarpProfile> s_done;
+  static bool s_scheduled;
+};  // class CarpProfiler
+
+}  // namespace ns3
+
+#endif /* CARP_PROFILE */
+
+#endif /* AQUA_SIM_CARP_PROFILE_H */
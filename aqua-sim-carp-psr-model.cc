@@ -0,0 +1,160 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-carp-psr-model.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ns3;
+
+CarpPsrModel::CarpPsrModel() :
+  m_frequency(25),
+  m_bandwidth(4),
+  m_sourceLevel(120),
+  m_spreading(1.5),
+  m_shipping(0.5),
+  m_wind(0)
+{
+}
+
+void
+CarpPsrModel::SetFrequency(double kHz)
+{
+  m_frequency = kHz;
+}
+
+double
+CarpPsrModel::GetFrequency() const
+{
+  return m_frequency;
+}
+
+void
+CarpPsrModel::SetBandwidth(double kHz)
+{
+  m_bandwidth = kHz;
+}
+
+double
+CarpPsrModel::GetBandwidth() const
+{
+  return m_bandwidth;
+}
+
+void
+CarpPsrModel::SetSourceLevel(double dB)
+{
+  m_sourceLevel = dB;
+}
+
+double
+CarpPsrModel::GetSourceLevel() const
+{
+  return m_sourceLevel;
+}
+
+void
+CarpPsrModel::SetSpreading(double k)
+{
+  m_spreading = k;
+}
+
+double
+CarpPsrModel::GetSpreading() const
+{
+  return m_spreading;
+}
+
+void
+CarpPsrModel::SetShipping(double s)
+{
+  m_shipping = s;
+}
+
+double
+CarpPsrModel::GetShipping() const
+{
+  return m_shipping;
+}
+
+void
+CarpPsrModel::SetWindSpeed(double ms)
+{
+  m_wind = ms;
+}
+
+double
+CarpPsrModel::GetWindSpeed() const
+{
+  return m_wind;
+}
+
+double
+CarpPsrModel::Thorp(double f)
+{
+  double f2 = f * f;
+  return 0.11 * f2 / (1 + f2) + 44 * f2 / (4100 + f2) + 2.75e-4 * f2 + 0.003;
+}
+
+/*
+ * Sums the Wenz components in linear power.
+ */
+double
+CarpPsrModel::Wenz(double f, double shipping, double wind)
+{
+  double turbulence = 17 - 30 * std::log10(f);
+  double ships = 40 + 20 * (shipping - 0.5) + 26 * std::log10(f) - 60 * std::log10(f + 0.03);
+  double waves = 50 + 7.5 * std::sqrt(wind) + 20 * std::log10(f) - 40 * std::log10(f + 0.4);
+  double thermal = -15 + 20 * std::log10(f);
+  return 10 * std::log10(std::pow(10, turbulence / 10) + std::pow(10, ships / 10)
+                         + std::pow(10, waves / 10) + std::pow(10, thermal / 10));
+}
+
+double
+CarpPsrModel::GetTransmissionLoss(double distance) const
+{
+  double d = std::max(distance, 1.0);
+  return m_spreading * 10 * std::log10(d) + Thorp(m_frequency) * d / 1000;
+}
+
+double
+CarpPsrModel::GetNoiseLevel() const
+{
+  return Wenz(m_frequency, m_shipping, m_wind) + 10 * std::log10(m_bandwidth * 1000);
+}
+
+double
+CarpPsrModel::GetSnr(double distance) const
+{
+  return m_sourceLevel - GetTransmissionLoss(distance) - GetNoiseLevel();
+}
+
+double
+CarpPsrModel::GetBer(double distance) const
+{
+  double snr = std::pow(10, GetSnr(distance) / 10);
+  return 0.5 * std::erfc(std::sqrt(snr));
+}
+
+double
+CarpPsrModel::GetPsr(double distance, uint32_t bytes) const
+{
+  return std::pow(1 - GetBer(distance), 8.0 * bytes);
+}
@@ -0,0 +1,87 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Expected packet success rate of an acoustic link, for the analytical link
+ * quality mode of CARP. Like CarpCore, it has no ns-3 dependency.
+ */
+
+#ifndef AQUA_SIM_CARP_PSR_MODEL_H
+#define AQUA_SIM_CARP_PSR_MODEL_H
+
+#include <stdint.h>
+
+namespace ns3 {
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Expected PSR from distance, frequency and packet size
+  *
+  * The transmission loss is Urick's spreading loss, k * 10 log10(d), plus
+  * Thorp's absorption over d. The noise is the sum of the four Wenz
+  * components (turbulence, shipping, wind and thermal) at the carrier
+  * frequency, integrated over the bandwidth. The SNR over the bandwidth is
+  * taken as Eb/N0 of BPSK on an AWGN channel, and every bit of the packet
+  * is assumed to fail independently.
+  */
+class CarpPsrModel
+{
+public:
+  CarpPsrModel();
+
+  void SetFrequency(double kHz);
+  double GetFrequency() const;
+  void SetBandwidth(double kHz);
+  double GetBandwidth() const;
+  // Source level (dB re 1 uPa at 1 m)
+  void SetSourceLevel(double dB);
+  double GetSourceLevel() const;
+  // 1 for cylindrical, 1.5 for practical, 2 for spherical spreading
+  void SetSpreading(double k);
+  double GetSpreading() const;
+  // Shipping activity between 0 and 1
+  void SetShipping(double s);
+  double GetShipping() const;
+  void SetWindSpeed(double ms);
+  double GetWindSpeed() const;
+
+  // Absorption coefficient (dB/km) at f kHz
+  static double Thorp(double f);
+  // Noise power spectral density (dB re 1 uPa per Hz) at f kHz
+  static double Wenz(double f, double shipping, double wind);
+
+  double GetTransmissionLoss(double distance) const;
+  double GetNoiseLevel() const;
+  double GetSnr(double distance) const;
+  double GetBer(double distance) const;
+  double GetPsr(double distance, uint32_t bytes) const;
+
+private:
+  double m_frequency;
+  double m_bandwidth;
+  double m_sourceLevel;
+  double m_spreading;
+  double m_shipping;
+  double m_wind;
+};  // class CarpPsrModel
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_CARP_PSR_MODEL_H */
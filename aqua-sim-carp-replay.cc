@@ -0,0 +1,289 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-carp-replay.h"
+#include "aqua-sim-routing-carp.h"
+#include "aqua-sim-header-routing.h"
+#include "aqua-sim-net-device.h"
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/node-list.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("CarpRecvReplay");
+NS_OBJECT_ENSURE_REGISTERED(AquaSimReplayMac);
+
+// Records are written in large blocks instead of one system call per packet
+static const size_t g_bufferSize = 1 << 20;
+
+static Ptr<AquaSimCarp>
+GetCarp(Ptr<Node> node)
+{
+  for (uint32_t i = 0; i < node->GetNDevices(); i++)
+    {
+      Ptr<AquaSimNetDevice> dev = DynamicCast<AquaSimNetDevice>(node->GetDevice(i));
+      Ptr<AquaSimCarp> carp = dev ? DynamicCast<AquaSimCarp>(dev->GetRouting()) : 0;
+      if (carp)
+        {
+          return carp;
+        }
+    }
+  return 0;
+}
+
+CarpRecvRecorder::CarpRecvRecorder(std::string fileName) :
+  m_buffer(0),
+  m_records(0)
+{
+  m_file = std::fopen(fileName.c_str(), "wb");
+  if (!m_file)
+    {
+      NS_FATAL_ERROR("CarpRecvRecorder: cannot open " << fileName);
+    }
+  m_buffer = new char[g_bufferSize];
+  std::setvbuf(m_file, m_buffer, _IOFBF, g_bufferSize);
+
+  CarpRecvFileHeader header;
+  std::memcpy(header.m_magic, "CARPRCV1", sizeof(header.m_magic));
+  header.m_recordSize = sizeof(CarpRecvRecord);
+  header.m_reserved = 0;
+  std::fwrite(&header, sizeof(header), 1, m_file);
+}
+
+CarpRecvRecorder::~CarpRecvRecorder()
+{
+  Close();
+}
+
+void
+CarpRecvRecorder::EnableAll()
+{
+  for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End(); n++)
+    {
+      Ptr<AquaSimCarp> carp = GetCarp(*n);
+      if (carp)
+        {
+          // The context carries the node id, which the records need
+          std::ostringstream context;
+          context << (*n)->GetId();
+          carp->TraceConnect("RecvInput", context.str(), MakeCallback(&CarpRecvRecorder::Record, this));
+        }
+    }
+}
+
+void
+CarpRecvRecorder::Record(std::string context, Ptr<const Packet> p, const Address &dest, uint16_t protocolNumber)
+{
+  if (!m_file)
+    {
+      return;
+    }
+  CarpRecvRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.m_time = Simulator::Now().GetNanoSeconds();
+  CarpTimestampTag tag;
+  record.m_timestamp = p->FindFirstMatchingByteTag(tag) ? tag.GetTimestamp().GetNanoSeconds() : INT64_MIN;
+  record.m_node = std::strtoul(context.c_str(), 0, 10);
+  record.m_size = p->GetSize();
+  record.m_protocol = protocolNumber;
+  dest.CopyAllTo(record.m_dest, sizeof(record.m_dest));
+
+  m_bytes.resize(record.m_size);
+  p->CopyData(m_bytes.data(), record.m_size);
+  std::fwrite(&record, sizeof(record), 1, m_file);
+  std::fwrite(m_bytes.data(), 1, record.m_size, m_file);
+  m_records++;
+}
+
+void
+CarpRecvRecorder::Close()
+{
+  if (m_file)
+    {
+      std::fclose(m_file);
+      m_file = 0;
+    }
+  delete[] m_buffer;
+  m_buffer = 0;
+}
+
+uint64_t
+CarpRecvRecorder::GetRecords() const
+{
+  return m_records;
+}
+
+CarpRecvReplayer::CarpRecvReplayer(std::string fileName) :
+  m_replayed(0)
+{
+  m_file = std::fopen(fileName.c_str(), "rb");
+  if (!m_file)
+    {
+      NS_FATAL_ERROR("CarpRecvReplayer: cannot open " << fileName);
+    }
+  CarpRecvFileHeader header;
+  if (std::fread(&header, sizeof(header), 1, m_file) != 1
+      || std::memcmp(header.m_magic, "CARPRCV1", sizeof(header.m_magic)) != 0
+      || header.m_recordSize != sizeof(CarpRecvRecord))
+    {
+      NS_FATAL_ERROR("CarpRecvReplayer: " << fileName << " is not a CARP reception recording of this build");
+    }
+}
+
+CarpRecvReplayer::~CarpRecvReplayer()
+{
+  if (m_file)
+    {
+      std::fclose(m_file);
+    }
+}
+
+uint32_t
+CarpRecvReplayer::GetNodes()
+{
+  long start = std::ftell(m_file);
+  uint32_t nodes = 0;
+  while (ReadNext())
+    {
+      nodes = std::max(nodes, m_next.m_node + 1);
+    }
+  std::fseek(m_file, start, SEEK_SET);
+  return nodes;
+}
+
+void
+CarpRecvReplayer::Start()
+{
+  if (ReadNext())
+    {
+      Simulator::Schedule(NanoSeconds(m_next.m_time) - Simulator::Now(), &CarpRecvReplayer::Deliver, this);
+    }
+}
+
+uint64_t
+CarpRecvReplayer::GetReplayed() const
+{
+  return m_replayed;
+}
+
+bool
+CarpRecvReplayer::ReadNext()
+{
+  if (std::fread(&m_next, sizeof(m_next), 1, m_file) != 1)
+    {
+      return false;
+    }
+  m_bytes.resize(m_next.m_size);
+  if (m_next.m_size > 0 && std::fread(m_bytes.data(), 1, m_next.m_size, m_file) != m_next.m_size)
+    {
+      NS_LOG_WARN("CarpRecvReplayer: recording ends within a packet");
+      return false;
+    }
+  return true;
+}
+
+/* Hands the record read last to its node and schedules the one after it.
+ * Records of the same instant keep their order, as the simulator runs
+ * events of equal time in the order they were scheduled. */
+void
+CarpRecvReplayer::Deliver()
+{
+  Ptr<AquaSimCarp> carp = m_next.m_node < NodeList::GetNNodes() ? GetCarp(NodeList::GetNode(m_next.m_node)) : 0;
+  if (carp)
+    {
+      Ptr<Packet> p = Create<Packet>(m_bytes.data(), m_next.m_size);
+      if (m_next.m_timestamp != INT64_MIN)
+        {
+          CarpTimestampTag tag;
+          tag.SetTimestamp(NanoSeconds(m_next.m_timestamp));
+          p->AddByteTag(tag);
+        }
+      Address dest;
+      dest.CopyAllFrom(m_next.m_dest, sizeof(m_next.m_dest));
+      carp->Recv(p, dest, m_next.m_protocol);
+      m_replayed++;
+    }
+  else
+    {
+      NS_LOG_WARN("CarpRecvReplayer: node " << m_next.m_node << " has no CARP instance, record skipped");
+    }
+  Start();
+}
+
+AquaSimReplayMac::AquaSimReplayMac() :
+  m_txPackets(0),
+  m_txBytes(0)
+{
+}
+
+TypeId
+AquaSimReplayMac::GetTypeId(void)
+{
+  static TypeId tid = TypeId("ns3::AquaSimReplayMac")
+    .SetParent<AquaSimMac>()
+    .AddConstructor<AquaSimReplayMac>()
+    .AddTraceSource ("Tx", "The routing layer handed a frame to the MAC. ",
+                     MakeTraceSourceAccessor (&AquaSimReplayMac::m_txTrace),
+                     "ns3::Packet::TracedCallback")
+    ;
+  return tid;
+}
+
+int64_t
+AquaSimReplayMac::AssignStreams(int64_t stream)
+{
+  return 0;
+}
+
+bool
+AquaSimReplayMac::RecvProcess(Ptr<Packet> p)
+{
+  // Nothing reaches the MAC from below during a replay
+  return false;
+}
+
+bool
+AquaSimReplayMac::TxProcess(Ptr<Packet> p)
+{
+  m_txPackets++;
+  m_txBytes += p->GetSize();
+  m_txTrace(p);
+  return true;
+}
+
+uint64_t
+AquaSimReplayMac::GetTxPackets() const
+{
+  return m_txPackets;
+}
+
+uint64_t
+AquaSimReplayMac::GetTxBytes() const
+{
+  return m_txBytes;
+}
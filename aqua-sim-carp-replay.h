@@ -0,0 +1,150 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef AQUA_SIM_CARP_REPLAY_H
+#define AQUA_SIM_CARP_REPLAY_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "ns3/simple-ref-count.h"
+#include "ns3/packet.h"
+#include "ns3/address.h"
+#include "ns3/traced-callback.h"
+#include "aqua-sim-mac.h"
+
+namespace ns3 {
+
+/*
+ * A recording is a CarpRecvFileHeader followed by one CarpRecvRecord per
+ * call of AquaSimCarp::Recv, each followed by the m_size bytes of the
+ * packet, in the byte order of the host that wrote them.
+ */
+struct CarpRecvFileHeader
+{
+  char m_magic[8];       // "CARPRCV1"
+  uint32_t m_recordSize; // sizeof (CarpRecvRecord) of the writer
+  uint32_t m_reserved;
+};
+
+struct CarpRecvRecord
+{
+  int64_t m_time;      // Simulation time of the call (ns)
+  int64_t m_timestamp; // CarpTimestampTag of the packet (ns), INT64_MIN if it has none
+  uint32_t m_node;     // Node id
+  uint32_t m_size;     // Bytes of the packet that follow the record
+  uint16_t m_protocol;
+  uint8_t m_dest[22];  // Destination address as written by Address::CopyAllTo
+};
+
+static_assert (sizeof (CarpRecvFileHeader) == 16, "CarpRecvFileHeader must stay 16 bytes");
+static_assert (sizeof (CarpRecvRecord) == 48, "CarpRecvRecord must stay 48 bytes");
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Records every packet handed to AquaSimCarp::Recv
+  *
+  * Hooks the RecvInput trace source of every CARP instance. The recording
+  * is read back by CarpRecvReplayer, which feeds it to CARP without the
+  * PHY, channel and MAC that produced it.
+  */
+class CarpRecvRecorder : public SimpleRefCount<CarpRecvRecorder>
+{
+public:
+  explicit CarpRecvRecorder(std::string fileName);
+  ~CarpRecvRecorder();
+
+  // Connects to every CARP instance existing at the time of the call
+  void EnableAll();
+  void Record(std::string context, Ptr<const Packet> p, const Address &dest, uint16_t protocolNumber);
+  void Close();
+  uint64_t GetRecords() const;
+
+private:
+  FILE *m_file;
+  char *m_buffer;
+  std::vector<uint8_t> m_bytes;
+  uint64_t m_records;
+};  // class CarpRecvRecorder
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Feeds a recording of CarpRecvRecorder back into AquaSimCarp::Recv
+  *
+  * Every record is handed to the CARP instance of its node at its recorded
+  * time. The records are read one at a time, each scheduling the next, so a
+  * recording of any length replays in constant memory. The replay is open
+  * loop: what CARP sends does not change what it receives next.
+  */
+class CarpRecvReplayer : public SimpleRefCount<CarpRecvReplayer>
+{
+public:
+  explicit CarpRecvReplayer(std::string fileName);
+  ~CarpRecvReplayer();
+
+  // Number of nodes the recording refers to, found by a pass over the file
+  uint32_t GetNodes();
+  // Schedules the first record, the rest follow during the run
+  void Start();
+  uint64_t GetReplayed() const;
+
+private:
+  bool ReadNext();
+  void Deliver();
+
+  FILE *m_file;
+  CarpRecvRecord m_next;
+  std::vector<uint8_t> m_bytes;
+  uint64_t m_replayed;
+};  // class CarpRecvReplayer
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief MAC that only counts what the routing hands it
+  *
+  * Stands in for the MAC when a recording is replayed, so that the cost of
+  * a run is that of the routing layer. Every frame is reported through the
+  * Tx trace source and dropped.
+  */
+class AquaSimReplayMac : public AquaSimMac
+{
+public:
+  AquaSimReplayMac();
+  static TypeId GetTypeId(void);
+  int64_t AssignStreams(int64_t stream);
+
+  virtual bool RecvProcess(Ptr<Packet> p);
+  virtual bool TxProcess(Ptr<Packet> p);
+
+  uint64_t GetTxPackets() const;
+  uint64_t GetTxBytes() const;
+
+private:
+  uint64_t m_txPackets;
+  uint64_t m_txBytes;
+  TracedCallback<Ptr<const Packet> > m_txTrace;
+};  // class AquaSimReplayMac
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_CARP_REPLAY_H */
@@ -0,0 +1,298 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-carp-scenario.h"
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include "ns3/mobility-helper.h"
+#include "ns3/position-allocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("CarpScenarioHelper");
+
+/* Source and relays of the published topologies, the sink sits at (80, 35) */
+static const double g_topologyI[][2] = {
+  {0, 0}, {10, 0}, {10, 20}, {25, 20}, {35, 15}, {30, 40}, {40, 30}, {45, 20}
+};
+static const double g_topologyII[][2] = {
+  {0, 0}, {5, 10}, {15, 10}, {25, 5}, {28, 25}, {45, 5}, {50, 35}, {55, 15}
+};
+static const Vector g_presetSink = Vector(80, 35, 0);
+
+CarpScenarioHelper::CarpScenarioHelper() :
+  m_deployment(TOPOLOGY_II),
+  m_nodes(3),
+  m_sinks(1),
+  m_area(1000),
+  m_depth(0),
+  m_clusters(4)
+{
+  m_uniform = CreateObject<UniformRandomVariable> ();
+  m_normal = CreateObject<NormalRandomVariable> ();
+}
+
+void
+CarpScenarioHelper::SetDeployment(Deployment deployment)
+{
+  m_deployment = deployment;
+}
+
+bool
+CarpScenarioHelper::SetDeployment(std::string name)
+{
+  for (int d = GRID; d <= TOPOLOGY_II; d++)
+    {
+      if (GetDeploymentName((Deployment) d) == name)
+        {
+          m_deployment = (Deployment) d;
+          return true;
+        }
+    }
+  return false;
+}
+
+void
+CarpScenarioHelper::SetNodes(uint32_t nodes)
+{
+  m_nodes = nodes;
+}
+void
+CarpScenarioHelper::SetSinks(uint32_t sinks)
+{
+  m_sinks = sinks;
+}
+void
+CarpScenarioHelper::SetArea(double area)
+{
+  m_area = area;
+}
+void
+CarpScenarioHelper::SetDepth(double depth)
+{
+  m_depth = depth;
+}
+void
+CarpScenarioHelper::SetClusters(uint32_t clusters)
+{
+  m_clusters = std::max(clusters, (uint32_t) 1);
+}
+
+int64_t
+CarpScenarioHelper::AssignStreams(int64_t stream)
+{
+  m_uniform->SetStream(stream);
+  m_normal->SetStream(stream + 1);
+  return 2;
+}
+
+CarpScenarioHelper::Deployment
+CarpScenarioHelper::GetDeployment() const
+{
+  return m_deployment;
+}
+uint32_t
+CarpScenarioHelper::GetNodes() const
+{
+  return m_nodes;
+}
+uint32_t
+CarpScenarioHelper::GetSinks() const
+{
+  return m_sinks;
+}
+
+std::string
+CarpScenarioHelper::GetDeploymentName(Deployment deployment)
+{
+  switch (deployment)
+    {
+    case GRID:        return "grid";
+    case UNIFORM:     return "random";
+    case CLUSTERED:   return "cluster";
+    case COLUMN:      return "column";
+    case TOPOLOGY_I:  return "topo1";
+    case TOPOLOGY_II: return "topo2";
+    }
+  return "";
+}
+
+std::vector<Vector>
+CarpScenarioHelper::CreatePositions()
+{
+  std::vector<Vector> pos;
+  pos.reserve(m_nodes + m_sinks);
+  switch (m_deployment)
+    {
+    case GRID:        Grid(pos); break;
+    case UNIFORM:     Uniform(pos); break;
+    case CLUSTERED:   Clustered(pos); break;
+    case COLUMN:      Column(pos); break;
+    case TOPOLOGY_I:  Preset(pos, g_topologyI, sizeof(g_topologyI) / sizeof(g_topologyI[0])); break;
+    case TOPOLOGY_II: Preset(pos, g_topologyII, sizeof(g_topologyII) / sizeof(g_topologyII[0])); break;
+    }
+
+  bool preset = (m_deployment == TOPOLOGY_I || m_deployment == TOPOLOGY_II);
+  for (uint32_t i = 0; i < m_sinks; i++)
+    {
+      if (preset && i == 0)
+        {
+          pos.push_back(g_presetSink);
+          continue;
+        }
+      pos.push_back(Vector(m_area * (i + 0.5) / m_sinks, m_area, 0));
+    }
+  return pos;
+}
+
+void
+CarpScenarioHelper::Install(NodeContainer nodes, NodeContainer sinks)
+{
+  NS_ASSERT_MSG(nodes.GetN() == m_nodes && sinks.GetN() == m_sinks,
+                "CarpScenarioHelper: container sizes do not match the scenario");
+  NodeContainer all(nodes, sinks);
+  Install(all, CreatePositions());
+}
+
+void
+CarpScenarioHelper::Install(NodeContainer c, const std::vector<Vector> &pos)
+{
+  NS_ASSERT_MSG(c.GetN() == pos.size(), "CarpScenarioHelper: one position per node is needed");
+  Ptr<ListPositionAllocator> alloc = CreateObject<ListPositionAllocator> ();
+  for (std::vector<Vector>::const_iterator it = pos.begin(); it != pos.end(); it++)
+    {
+      alloc->Add(*it);
+    }
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator(alloc);
+  mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+  mobility.Install(c);
+}
+
+std::vector<uint32_t>
+CarpScenarioHelper::Partition(const std::vector<Vector> &pos, uint32_t ranks,
+                              std::vector<double> &bounds) const
+{
+  ranks = std::max(ranks, (uint32_t) 1);
+  std::vector<double> xs;
+  for (uint32_t i = 0; i < m_nodes && i < pos.size(); i++)
+    {
+      xs.push_back(pos[i].x);
+    }
+  std::sort(xs.begin(), xs.end());
+
+  // Slab edges sit halfway between the sensor nodes at the rank quantiles
+  bounds.assign(ranks + 1, 0);
+  bounds[0] = -std::numeric_limits<double>::infinity();
+  bounds[ranks] = std::numeric_limits<double>::infinity();
+  for (uint32_t r = 1; r < ranks; r++)
+    {
+      size_t k = (size_t) r * xs.size() / ranks;
+      bounds[r] = (k == 0 || k >= xs.size()) ? bounds[r - 1] : (xs[k - 1] + xs[k]) / 2;
+    }
+
+  std::vector<uint32_t> owner(pos.size(), 0);
+  for (size_t i = 0; i < pos.size(); i++)
+    {
+      owner[i] = std::upper_bound(bounds.begin() + 1, bounds.end() - 1, pos[i].x) - (bounds.begin() + 1);
+    }
+  return owner;
+}
+
+void
+CarpScenarioHelper::Grid(std::vector<Vector> &pos)
+{
+  uint32_t side = std::ceil(std::sqrt((double) m_nodes));
+  double spacing = (side > 1) ? m_area / (side - 1) : 0;
+  for (uint32_t i = 0; i < m_nodes; i++)
+    {
+      pos.push_back(Vector((i % side) * spacing, (i / side) * spacing, 0));
+    }
+}
+
+void
+CarpScenarioHelper::Uniform(std::vector<Vector> &pos)
+{
+  for (uint32_t i = 0; i < m_nodes; i++)
+    {
+      double x = m_uniform->GetValue(0, m_area);
+      double y = m_uniform->GetValue(0, m_area);
+      double z = m_uniform->GetValue(0, m_depth);
+      pos.push_back(Vector(x, y, z));
+    }
+}
+
+void
+CarpScenarioHelper::Clustered(std::vector<Vector> &pos)
+{
+  std::vector<Vector> heads;
+  for (uint32_t c = 0; c < m_clusters; c++)
+    {
+      heads.push_back(Vector(m_uniform->GetValue(0, m_area),
+                             m_uniform->GetValue(0, m_area),
+                             m_uniform->GetValue(0, m_depth)));
+    }
+  // Members stay within a quarter of the per-cluster share of the area
+  double sigma = m_area / (4 * std::sqrt((double) m_clusters));
+  for (uint32_t i = 0; i < m_nodes; i++)
+    {
+      const Vector &h = heads[i % m_clusters];
+      double x = std::min(std::max(h.x + sigma * m_normal->GetValue(), 0.0), m_area);
+      double y = std::min(std::max(h.y + sigma * m_normal->GetValue(), 0.0), m_area);
+      double z = std::min(std::max(h.z + sigma * m_normal->GetValue(), 0.0), m_depth);
+      pos.push_back(Vector(x, y, z));
+    }
+}
+
+void
+CarpScenarioHelper::Column(std::vector<Vector> &pos)
+{
+  // Roughly as many nodes per mooring as there are moorings
+  uint32_t moorings = std::ceil(std::sqrt((double) m_nodes));
+  uint32_t perMooring = std::ceil((double) m_nodes / moorings);
+  uint32_t side = std::ceil(std::sqrt((double) moorings));
+  double spacing = m_area / side;
+  double step = (perMooring > 1) ? m_depth / (perMooring - 1) : 0;
+  for (uint32_t i = 0; i < m_nodes; i++)
+    {
+      uint32_t m = i / perMooring;
+      uint32_t level = i % perMooring;
+      pos.push_back(Vector((m % side + 0.5) * spacing,
+                           (m / side + 0.5) * spacing,
+                           level * step));
+    }
+}
+
+void
+CarpScenarioHelper::Preset(std::vector<Vector> &pos, const double (*preset)[2], uint32_t size)
+{
+  if (m_nodes > size)
+    {
+      NS_FATAL_ERROR("CarpScenarioHelper: " << GetDeploymentName(m_deployment) <<
+                     " defines only " << size << " nodes, " << m_nodes << " requested");
+    }
+  for (uint32_t i = 0; i < m_nodes; i++)
+    {
+      pos.push_back(Vector(preset[i][0], preset[i][1], 0));
+    }
+}
@@ -0,0 +1,117 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef AQUA_SIM_CARP_SCENARIO_H
+#define AQUA_SIM_CARP_SCENARIO_H
+
+#include <string>
+#include <vector>
+
+#include "ns3/vector.h"
+#include "ns3/node-container.h"
+#include "ns3/random-variable-stream.h"
+
+namespace ns3 {
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Generates node deployments for CARP scenarios
+  *
+  * Sensor nodes are placed by one of the deployments below and sinks are
+  * spread along the surface at the far edge of the area (y = area, z = 0).
+  * The two hand-placed topologies of the published CARP results are kept as
+  * presets; they use the first \c nodes positions of the preset.
+  *
+  *  - grid:    square grid in the z = 0 plane
+  *  - random:  uniform in the area, z uniform in [0, depth]
+  *  - cluster: Gaussian clusters around uniformly placed heads
+  *  - column:  vertical moorings on a square grid, nodes evenly spaced in depth
+  *  - topo1:   Topology I (source and 7 relays)
+  *  - topo2:   Topology II (source and 7 relays)
+  */
+class CarpScenarioHelper
+{
+public:
+  enum Deployment
+  {
+    GRID,
+    UNIFORM,
+    CLUSTERED,
+    COLUMN,
+    TOPOLOGY_I,
+    TOPOLOGY_II
+  };
+
+  CarpScenarioHelper();
+
+  void SetDeployment(Deployment deployment);
+  bool SetDeployment(std::string name); // false if the name is unknown
+  void SetNodes(uint32_t nodes);
+  void SetSinks(uint32_t sinks);
+  void SetArea(double area);   // side of the square area (m)
+  void SetDepth(double depth); // water depth (m)
+  void SetClusters(uint32_t clusters);
+  int64_t AssignStreams(int64_t stream);
+
+  Deployment GetDeployment() const;
+  uint32_t GetNodes() const;
+  uint32_t GetSinks() const;
+
+  /*
+   * Positions of the sensor nodes followed by the positions of the sinks.
+   * Presets abort if more nodes are requested than they define.
+   */
+  std::vector<Vector> CreatePositions();
+
+  // Installs constant position mobility on the nodes and then the sinks
+  void Install(NodeContainer nodes, NodeContainer sinks);
+  // Installs constant position mobility at the given positions, in order
+  static void Install(NodeContainer c, const std::vector<Vector> &pos);
+
+  /*
+   * Spatial decomposition for split-area runs. The area is cut along x into one slab
+   * per rank, each holding the same number of sensor nodes; bounds receives
+   * the ranks + 1 slab edges. Returns the rank owning every position.
+   */
+  std::vector<uint32_t> Partition(const std::vector<Vector> &pos, uint32_t ranks,
+                                  std::vector<double> &bounds) const;
+
+  static std::string GetDeploymentName(Deployment deployment);
+
+private:
+  void Grid(std::vector<Vector> &pos);
+  void Uniform(std::vector<Vector> &pos);
+  void Clustered(std::vector<Vector> &pos);
+  void Column(std::vector<Vector> &pos);
+  void Preset(std::vector<Vector> &pos, const double (*preset)[2], uint32_t size);
+
+  Deployment m_deployment;
+  uint32_t m_nodes;
+  uint32_t m_sinks;
+  double m_area;
+  double m_depth;
+  uint32_t m_clusters;
+  Ptr<UniformRandomVariable> m_uniform;
+  Ptr<NormalRandomVariable> m_normal;
+};  // class CarpScenarioHelper
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_CARP_SCENARIO_H */
@@ -0,0 +1,331 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-carp-stats.h"
+#include "aqua-sim-routing-carp.h"
+#include "aqua-sim-net-device.h"
+#include "aqua-sim-header-routing.h"
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/node-list.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <set>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("CarpStatsCollector");
+
+// Lower edge of the first delay bin, bins grow by a quarter octave
+static const double g_delayBase = 1e-3;
+
+// Layout of GetCounters, the delay histogram comes last
+enum
+{
+  COUNTER_SENT,
+  COUNTER_DELIVERED,
+  COUNTER_BYTES,
+  COUNTER_DELAY_SUM,
+  COUNTER_DELAY_COUNT,
+  COUNTER_HOP_SUM,
+  COUNTER_HOP_COUNT,
+  COUNTER_DATA_BYTES,
+  COUNTER_CONTROL_BYTES,
+  COUNTER_CONTROL_PACKETS,
+  COUNTER_FLOWS,
+  COUNTER_DELAY_HIST
+};
+
+/*
+ * Upper edge of the bin of a quarter-octave delay histogram that holds the
+ * q quantile (s), capped by the largest delay seen.
+ */
+template <typename T>
+static double
+DelayPercentile(const T *hist, uint32_t bins, double count, double q, double max)
+{
+  if (count <= 0)
+    {
+      return 0;
+    }
+  double target = q * count;
+  double seen = 0;
+  for (uint32_t bin = 0; bin < bins; bin++)
+    {
+      seen += hist[bin];
+      if (seen >= target && seen > 0)
+        {
+          return std::min(g_delayBase * std::pow(2.0, (bin + 1) / 4.0), max);
+        }
+    }
+  return max;
+}
+
+CarpStatsCollector::CarpStatsCollector() :
+  m_delayMax(0),
+  m_dataBytes(0),
+  m_controlBytes(0),
+  m_controlPackets(0)
+{
+  std::memset(m_delayHist, 0, sizeof(m_delayHist));
+  std::memset(m_hopHist, 0, sizeof(m_hopHist));
+}
+
+void
+CarpStatsCollector::EnableAll()
+{
+  for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End(); n++)
+    {
+      for (uint32_t i = 0; i < (*n)->GetNDevices(); i++)
+        {
+          Ptr<AquaSimNetDevice> dev = DynamicCast<AquaSimNetDevice>((*n)->GetDevice(i));
+          Ptr<AquaSimCarp> carp = dev ? DynamicCast<AquaSimCarp>(dev->GetRouting()) : 0;
+          if (carp)
+            {
+              carp->TraceConnectWithoutContext("PacketEvent", MakeCallback(&CarpStatsCollector::PacketEvent, this));
+              carp->TraceConnectWithoutContext("Delivery", MakeCallback(&CarpStatsCollector::Delivery, this));
+            }
+        }
+    }
+}
+
+void
+CarpStatsCollector::EnableAll(const NodeContainer &owned)
+{
+  std::set<uint32_t> ids;
+  for (NodeContainer::Iterator n = owned.Begin(); n != owned.End(); n++)
+    {
+      ids.insert((*n)->GetId());
+    }
+  for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End(); n++)
+    {
+      for (uint32_t i = 0; i < (*n)->GetNDevices(); i++)
+        {
+          Ptr<AquaSimNetDevice> dev = DynamicCast<AquaSimNetDevice>((*n)->GetDevice(i));
+          Ptr<AquaSimCarp> carp = dev ? DynamicCast<AquaSimCarp>(dev->GetRouting()) : 0;
+          if (!carp)
+            {
+              continue;
+            }
+          if (ids.count((*n)->GetId()))
+            {
+              carp->TraceConnectWithoutContext("PacketEvent", MakeCallback(&CarpStatsCollector::PacketEvent, this));
+            }
+          carp->TraceConnectWithoutContext("Delivery", MakeCallback(&CarpStatsCollector::Delivery, this));
+        }
+    }
+}
+
+void
+CarpStatsCollector::PacketEvent(const CarpTraceRecord &record)
+{
+  if (record.m_event == CARP_TRACE_SEND)
+    {
+      m_flows[FlowId(AquaSimAddress(record.m_src), AquaSimAddress(record.m_dst))].m_sent++;
+    }
+  else if (record.m_event == CARP_TRACE_TX)
+    {
+      if (record.m_type == DATA || record.m_type == AGG)
+        {
+          m_dataBytes += record.m_size;
+        }
+      else
+        {
+          m_controlBytes += record.m_size;
+          m_controlPackets++;
+        }
+    }
+}
+
+void
+CarpStatsCollector::Delivery(AquaSimAddress src, AquaSimAddress dst, uint32_t size, Time delay, uint8_t hops)
+{
+  Flow &flow = m_flows[FlowId(src, dst)];
+  flow.m_delivered++;
+  flow.m_bytes += size;
+  m_hopHist[hops]++;
+  if (delay.IsNegative())
+    {
+      return;
+    }
+  double d = delay.GetSeconds();
+  flow.m_delaySum += d;
+  flow.m_delayCount++;
+  m_delayMax = std::max(m_delayMax, d);
+  int bin = (d > g_delayBase) ? (int) std::floor(4 * std::log2(d / g_delayBase)) : 0;
+  m_delayHist[std::min(bin, (int) DELAY_BINS - 1)]++;
+}
+
+uint64_t
+CarpStatsCollector::GetSent() const
+{
+  uint64_t n = 0;
+  for (std::map<FlowId, Flow>::const_iterator it = m_flows.begin(); it != m_flows.end(); it++)
+    {
+      n += it->second.m_sent;
+    }
+  return n;
+}
+
+uint64_t
+CarpStatsCollector::GetDelivered() const
+{
+  uint64_t n = 0;
+  for (std::map<FlowId, Flow>::const_iterator it = m_flows.begin(); it != m_flows.end(); it++)
+    {
+      n += it->second.m_delivered;
+    }
+  return n;
+}
+
+uint64_t
+CarpStatsCollector::GetDeliveredBytes() const
+{
+  uint64_t n = 0;
+  for (std::map<FlowId, Flow>::const_iterator it = m_flows.begin(); it != m_flows.end(); it++)
+    {
+      n += it->second.m_bytes;
+    }
+  return n;
+}
+
+double
+CarpStatsCollector::GetDelaySum() const
+{
+  double sum = 0;
+  for (std::map<FlowId, Flow>::const_iterator it = m_flows.begin(); it != m_flows.end(); it++)
+    {
+      sum += it->second.m_delaySum;
+    }
+  return sum;
+}
+
+uint64_t
+CarpStatsCollector::GetDelayCount() const
+{
+  uint64_t n = 0;
+  for (std::map<FlowId, Flow>::const_iterator it = m_flows.begin(); it != m_flows.end(); it++)
+    {
+      n += it->second.m_delayCount;
+    }
+  return n;
+}
+
+double
+CarpStatsCollector::GetDelayPercentile(double q) const
+{
+  return DelayPercentile(m_delayHist, DELAY_BINS, GetDelayCount(), q, m_delayMax);
+}
+
+double
+CarpStatsCollector::GetMeanHops() const
+{
+  uint64_t n = 0;
+  uint64_t sum = 0;
+  for (uint32_t h = 0; h < 256; h++)
+    {
+      n += m_hopHist[h];
+      sum += h * m_hopHist[h];
+    }
+  return n ? (double) sum / n : 0;
+}
+
+uint64_t
+CarpStatsCollector::GetControlPackets() const
+{
+  return m_controlPackets;
+}
+
+const std::map<CarpStatsCollector::FlowId, CarpStatsCollector::Flow> &
+CarpStatsCollector::GetFlows() const
+{
+  return m_flows;
+}
+
+double
+CarpStatsCollector::GetDelayMax() const
+{
+  return m_delayMax;
+}
+
+std::vector<double>
+CarpStatsCollector::GetCounters() const
+{
+  std::vector<double> c(COUNTER_DELAY_HIST + DELAY_BINS, 0);
+  c[COUNTER_SENT] = GetSent();
+  c[COUNTER_DELIVERED] = GetDelivered();
+  c[COUNTER_BYTES] = GetDeliveredBytes();
+  c[COUNTER_DELAY_SUM] = GetDelaySum();
+  c[COUNTER_DELAY_COUNT] = GetDelayCount();
+  for (uint32_t h = 0; h < 256; h++)
+    {
+      c[COUNTER_HOP_SUM] += (double) h * m_hopHist[h];
+      c[COUNTER_HOP_COUNT] += m_hopHist[h];
+    }
+  c[COUNTER_DATA_BYTES] = m_dataBytes;
+  c[COUNTER_CONTROL_BYTES] = m_controlBytes;
+  c[COUNTER_CONTROL_PACKETS] = m_controlPackets;
+  c[COUNTER_FLOWS] = m_flows.size();
+  std::copy(m_delayHist, m_delayHist + DELAY_BINS, c.begin() + COUNTER_DELAY_HIST);
+  return c;
+}
+
+void
+CarpStatsCollector::Print(std::ostream &os, Time activeTime) const
+{
+  PrintCounters(os, GetCounters(), m_delayMax, activeTime);
+}
+
+void
+CarpStatsCollector::PrintCounters(std::ostream &os, const std::vector<double> &c, double delayMax, Time activeTime)
+{
+  double sent = c[COUNTER_SENT];
+  double delivered = c[COUNTER_DELIVERED];
+  double delayCount = c[COUNTER_DELAY_COUNT];
+  double seconds = activeTime.GetSeconds();
+  const double *hist = &c[COUNTER_DELAY_HIST];
+  uint32_t bins = c.size() - COUNTER_DELAY_HIST;
+  os << "CARP_SUMMARY psr=" << (sent ? delivered / sent : 0)
+     << " throughput=" << (seconds > 0 ? c[COUNTER_BYTES] * 8 / seconds : 0)
+     << " latency=" << (delayCount ? c[COUNTER_DELAY_SUM] / delayCount : 0)
+     << " sent=" << (uint64_t) sent << " received=" << (uint64_t) delivered
+     << " delay_p50=" << DelayPercentile(hist, bins, delayCount, 0.5, delayMax)
+     << " delay_p95=" << DelayPercentile(hist, bins, delayCount, 0.95, delayMax)
+     << " delay_max=" << delayMax
+     << " hops=" << (c[COUNTER_HOP_COUNT] ? c[COUNTER_HOP_SUM] / c[COUNTER_HOP_COUNT] : 0)
+     << " data_bytes=" << (uint64_t) c[COUNTER_DATA_BYTES]
+     << " control_bytes=" << (uint64_t) c[COUNTER_CONTROL_BYTES]
+     << " control_packets=" << (uint64_t) c[COUNTER_CONTROL_PACKETS]
+     << " flows=" << (uint64_t) c[COUNTER_FLOWS] << "\n";
+}
+
+void
+CarpStatsCollector::PrintFlows(std::ostream &os) const
+{
+  for (std::map<FlowId, Flow>::const_iterator it = m_flows.begin(); it != m_flows.end(); it++)
+    {
+      const Flow &f = it->second;
+      os << "CARP_FLOW src=" << it->first.first << " dst=" << it->first.second
+         << " sent=" << f.m_sent << " received=" << f.m_delivered
+         << " psr=" << (f.m_sent ? (double) f.m_delivered / f.m_sent : 0)
+         << " latency=" << (f.m_delayCount ? f.m_delaySum / f.m_delayCount : 0) << "\n";
+    }
+}
@@ -0,0 +1,118 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef AQUA_SIM_CARP_STATS_H
+#define AQUA_SIM_CARP_STATS_H
+
+#include <map>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "ns3/node-container.h"
+#include "ns3/simple-ref-count.h"
+#include "ns3/nstime.h"
+#include "aqua-sim-address.h"
+#include "aqua-sim-carp-trace-record.h"
+
+namespace ns3 {
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief On-line KPIs of the CARP nodes of a run
+  *
+  * Hooks the PacketEvent and Delivery trace sources of every CARP instance
+  * and keeps, in memory that does not grow with the run length:
+  *  - packets sent and delivered, delivered bytes and delay per flow
+  *  - a histogram of the end-to-end delay in quarter-octave bins from 1 ms
+  *  - the distribution of the hop count of delivered packets
+  *  - bytes of data and of control frames handed to the MAC, and the number
+  *    of control frames
+  *
+  * Print writes them as the single CARP_SUMMARY line read by tools/carp-sweep.
+  */
+class CarpStatsCollector : public SimpleRefCount<CarpStatsCollector>
+{
+public:
+  struct Flow
+  {
+    Flow() : m_sent(0), m_delivered(0), m_bytes(0), m_delaySum(0), m_delayCount(0) {}
+    uint64_t m_sent;
+    uint64_t m_delivered;
+    uint64_t m_bytes;    // Delivered payload bytes
+    double m_delaySum;   // Sum of the end-to-end delays (s)
+    uint64_t m_delayCount;
+  };
+  typedef std::pair<AquaSimAddress, AquaSimAddress> FlowId; // Source and destination
+
+  CarpStatsCollector();
+
+  // Connects to every CARP instance existing at the time of the call
+  void EnableAll();
+  /*
+   * Same, but only counts the packets sent and the frames transmitted by
+   * the owned nodes, for a process that also simulates the border of the
+   * partitions of other processes. Deliveries are counted at every node.
+   */
+  void EnableAll(const NodeContainer &owned);
+
+  void PacketEvent(const CarpTraceRecord &record);
+  void Delivery(AquaSimAddress src, AquaSimAddress dst, uint32_t size, Time delay, uint8_t hops);
+
+  uint64_t GetSent() const;
+  uint64_t GetDelivered() const;
+  uint64_t GetDeliveredBytes() const;
+  double GetDelaySum() const;
+  uint64_t GetDelayCount() const;
+  double GetDelayPercentile(double q) const; // Upper edge of the bin holding the q quantile (s)
+  double GetMeanHops() const;
+  uint64_t GetControlPackets() const; // Control frames handed to the MAC
+  const std::map<FlowId, Flow> &GetFlows() const;
+
+  /*
+   * Writes the run summary as one line of key=value pairs. Throughput is
+   * taken over the given active time of the sources.
+   */
+  void Print(std::ostream &os, Time activeTime) const;
+  /*
+   * The state behind Print as additive counters, to be summed over the
+   * processes of a partitioned run and printed with PrintCounters. The
+   * delay maximum is not additive and is kept apart.
+   */
+  std::vector<double> GetCounters() const;
+  double GetDelayMax() const;
+  static void PrintCounters(std::ostream &os, const std::vector<double> &counters, double delayMax, Time activeTime);
+  void PrintFlows(std::ostream &os) const;
+
+private:
+  static const uint32_t DELAY_BINS = 96;
+
+  std::map<FlowId, Flow> m_flows;
+  uint64_t m_delayHist[DELAY_BINS];
+  double m_delayMax;
+  uint64_t m_hopHist[256];
+  uint64_t m_dataBytes;
+  uint64_t m_controlBytes;
+  uint64_t m_controlPackets;
+};  // class CarpStatsCollector
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_CARP_STATS_H */
@@ -0,0 +1,79 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Layout of the CARP binary packet trace. This header has no ns-3
+ * dependency so that the tools reading traces can share it.
+ *
+ * A trace file is a CarpTraceFileHeader followed by fixed-size records in
+ * the byte order of the host that wrote them.
+ */
+
+#ifndef AQUA_SIM_CARP_TRACE_RECORD_H
+#define AQUA_SIM_CARP_TRACE_RECORD_H
+
+#include <stdint.h>
+
+namespace ns3 {
+
+enum CarpTraceEvent
+{
+  CARP_TRACE_TX = 0,      // Frame handed to the MAC
+  CARP_TRACE_RX = 1,      // Frame received from the MAC
+  CARP_TRACE_DELIVER = 2, // Data packet handed to the application at its destination
+  CARP_TRACE_DROP = 3,    // Frame discarded (loop or not addressed to this node)
+  CARP_TRACE_SEND = 4     // Data packet accepted from the application at its source
+};
+
+// Packet types of the control frames, the same as their PckType
+enum CarpTraceControlType
+{
+  CARP_TRACE_HELLO = 16,
+  CARP_TRACE_PING = 17,
+  CARP_TRACE_PONG = 18
+};
+
+struct CarpTraceFileHeader
+{
+  char m_magic[8];       // "CARPTRC1"
+  uint32_t m_recordSize; // sizeof (CarpTraceRecord) of the writer
+  uint32_t m_reserved;
+};
+
+struct CarpTraceRecord
+{
+  int64_t m_time;  // Simulation time (ns)
+  uint64_t m_uid;  // Packet uid
+  uint32_t m_node; // Node id
+  uint16_t m_size; // Packet size at the routing layer (bytes)
+  uint16_t m_src;  // Source of the packet
+  uint16_t m_dst;  // Final destination
+  uint16_t m_next; // Next hop
+  uint8_t m_event; // CarpTraceEvent
+  uint8_t m_type;  // CARP packet type (PckType or CarpTraceControlType)
+  uint8_t m_hops;  // Number of forwards so far
+  uint8_t m_pad;
+};
+
+static_assert (sizeof (CarpTraceFileHeader) == 16, "CarpTraceFileHeader must stay 16 bytes");
+static_assert (sizeof (CarpTraceRecord) == 32, "CarpTraceRecord must stay 32 bytes");
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_CARP_TRACE_RECORD_H */
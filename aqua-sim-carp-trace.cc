@@ -0,0 +1,177 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-carp-trace.h"
+#include "aqua-sim-routing-carp.h"
+#include "aqua-sim-net-device.h"
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/node-list.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("CarpTraceWriter");
+
+// Records are written in large blocks instead of one system call per event
+static const size_t g_bufferSize = 1 << 20;
+
+CarpTraceWriter::CarpTraceWriter(std::string fileName, bool async, uint32_t ringSize) :
+  m_buffer(0),
+  m_records(0),
+  m_async(async),
+  m_mask(0),
+  m_stalls(0),
+  m_head(0),
+  m_tail(0),
+  m_stop(false)
+{
+  m_file = std::fopen(fileName.c_str(), "wb");
+  if (!m_file)
+    {
+      NS_FATAL_ERROR("CarpTraceWriter: cannot open " << fileName);
+    }
+  m_buffer = new char[g_bufferSize];
+  std::setvbuf(m_file, m_buffer, _IOFBF, g_bufferSize);
+
+  CarpTraceFileHeader header;
+  std::memcpy(header.m_magic, "CARPTRC1", sizeof(header.m_magic));
+  header.m_recordSize = sizeof(CarpTraceRecord);
+  header.m_reserved = 0;
+  std::fwrite(&header, sizeof(header), 1, m_file);
+
+  if (m_async)
+    {
+      // Round up to a power of two so that slots are found with a mask
+      uint64_t size = 1;
+      while (size < ringSize)
+        {
+          size <<= 1;
+        }
+      m_ring.resize(size);
+      m_mask = size - 1;
+      m_writer = std::thread(&CarpTraceWriter::Drain, this);
+    }
+}
+
+CarpTraceWriter::~CarpTraceWriter()
+{
+  Close();
+}
+
+void
+CarpTraceWriter::EnableAll()
+{
+  for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End(); n++)
+    {
+      for (uint32_t i = 0; i < (*n)->GetNDevices(); i++)
+        {
+          Ptr<AquaSimNetDevice> dev = DynamicCast<AquaSimNetDevice>((*n)->GetDevice(i));
+          Ptr<AquaSimCarp> carp = dev ? DynamicCast<AquaSimCarp>(dev->GetRouting()) : 0;
+          if (carp)
+            {
+              carp->TraceConnectWithoutContext("PacketEvent", MakeCallback(&CarpTraceWriter::Write, this));
+            }
+        }
+    }
+}
+
+void
+CarpTraceWriter::Write(const CarpTraceRecord &record)
+{
+  if (!m_file)
+    {
+      return;
+    }
+  m_records++;
+  if (!m_async)
+    {
+      std::fwrite(&record, sizeof(record), 1, m_file);
+      return;
+    }
+  uint64_t head = m_head.load(std::memory_order_relaxed);
+  if (head - m_tail.load(std::memory_order_acquire) > m_mask)
+    {
+      m_stalls++;
+      while (head - m_tail.load(std::memory_order_acquire) > m_mask)
+        {
+          std::this_thread::yield();
+        }
+    }
+  m_ring[head & m_mask] = record;
+  m_head.store(head + 1, std::memory_order_release);
+}
+
+/* Body of the writer thread: writes out every run of records that is
+ * contiguous in the ring with a single fwrite, and exits once Close has
+ * been called and the ring is empty. */
+void
+CarpTraceWriter::Drain()
+{
+  while (true)
+    {
+      bool stop = m_stop.load(std::memory_order_acquire);
+      uint64_t head = m_head.load(std::memory_order_acquire);
+      uint64_t tail = m_tail.load(std::memory_order_relaxed);
+      if (head == tail)
+        {
+          if (stop)
+            {
+              return;
+            }
+          std::this_thread::sleep_for(std::chrono::microseconds(200));
+          continue;
+        }
+      uint64_t n = std::min(head - tail, m_mask + 1 - (tail & m_mask));
+      std::fwrite(&m_ring[tail & m_mask], sizeof(CarpTraceRecord), n, m_file);
+      m_tail.store(tail + n, std::memory_order_release);
+    }
+}
+
+void
+CarpTraceWriter::Close()
+{
+  if (m_writer.joinable())
+    {
+      m_stop.store(true, std::memory_order_release);
+      m_writer.join();
+    }
+  if (m_file)
+    {
+      std::fclose(m_file);
+      m_file = 0;
+    }
+  delete [] m_buffer;
+  m_buffer = 0;
+}
+
+uint64_t
+CarpTraceWriter::GetRecords() const
+{
+  return m_records;
+}
+
+uint64_t
+CarpTraceWriter::GetStalls() const
+{
+  return m_stalls;
+}
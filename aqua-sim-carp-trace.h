@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef AQUA_SIM_CARP_TRACE_H
+#define AQUA_SIM_CARP_TRACE_H
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ns3/simple-ref-count.h"
+#include "aqua-sim-carp-trace-record.h"
+
+namespace ns3 {
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Writes the PacketEvent trace of CARP as a binary trace
+  *
+  * Every event becomes one 32 byte CarpTraceRecord, against a few hundred
+  * bytes of formatted text per event for the ASCII traces. The file is read
+  * by tools/carp-trace, which can print it as text or CSV.
+  *
+  *   Ptr<CarpTraceWriter> trace = Create<CarpTraceWriter> ("carp.ctr");
+  *   trace->EnableAll ();
+  *
+  * The writer must stay alive until the simulation is destroyed.
+  *
+  * In asynchronous mode, records go into a single-producer single-consumer
+  * ring that a background thread drains to the file in batches. The
+  * simulator thread only blocks when the ring is full. The file is byte for
+  * byte the one the synchronous mode writes.
+  */
+class CarpTraceWriter : public SimpleRefCount<CarpTraceWriter>
+{
+public:
+  explicit CarpTraceWriter(std::string fileName, bool async = true, uint32_t ringSize = 1 << 16);
+  ~CarpTraceWriter();
+
+  // Connects to every CARP instance existing at the time of the call
+  void EnableAll();
+  void Write(const CarpTraceRecord &record);
+  void Close();
+  uint64_t GetRecords() const;
+  uint64_t GetStalls() const; // Records that waited for room in the ring
+
+private:
+  void Drain();
+
+  FILE *m_file;
+  char *m_buffer;
+  uint64_t m_records;
+
+  bool m_async;
+  std::vector<CarpTraceRecord> m_ring;
+  uint64_t m_mask;
+  uint64_t m_stalls;
+  char m_pad0[64];
+  std::atomic<uint64_t> m_head; // Next slot filled by the simulator thread
+  char m_pad1[64];              // Keeps the two threads off each other's cache line
+  std::atomic<uint64_t> m_tail; // Next slot written out by the writer thread
+  char m_pad2[64];
+  std::atomic<bool> m_stop;
+  std::thread m_writer;
+};  // class CarpTraceWriter
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_CARP_TRACE_H */
@@ -0,0 +1,196 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-grid-propagation.h"
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+
+#include <algorithm>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AquaSimGridPropagation");
+NS_OBJECT_ENSURE_REGISTERED(AquaSimGridPropagation);
+
+TypeId
+AquaSimGridPropagation::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::AquaSimGridPropagation")
+    .SetParent<AquaSimRangePropagation> ()
+    .AddConstructor<AquaSimGridPropagation> ()
+    .AddAttribute ("CellSize", "Side of the grid cells, at least the propagation range (m).",
+      DoubleValue (1000),
+      MakeDoubleAccessor (&AquaSimGridPropagation::SetCellSize,
+                          &AquaSimGridPropagation::GetCellSize),
+      MakeDoubleChecker<double> (1))
+    ;
+  return tid;
+}
+
+AquaSimGridPropagation::AquaSimGridPropagation () :
+  m_maxSpeed(0),
+  m_candidates(0)
+{
+}
+
+void
+AquaSimGridPropagation::SetCellSize (double cellSize)
+{
+  m_grid.SetCellSize(cellSize);
+}
+
+double
+AquaSimGridPropagation::GetCellSize (void) const
+{
+  return m_grid.GetCellSize();
+}
+
+uint64_t
+AquaSimGridPropagation::GetCandidates (void) const
+{
+  return m_candidates;
+}
+
+/* The channel only grows its device list, so the index is rebuilt when the
+ * list changes size and kept up to date through CourseChange otherwise. */
+void
+AquaSimGridPropagation::Index (const std::vector<Ptr<AquaSimNetDevice> > &dList)
+{
+  if (dList.size() == m_devices.size())
+    {
+      return;
+    }
+  NS_LOG_FUNCTION(this << dList.size());
+
+  std::map<Ptr<const MobilityModel>, uint32_t> previous;
+  previous.swap(m_ids);
+  m_grid.Clear();
+  m_moving.clear();
+  m_maxSpeed = 0;
+  m_devices = dList;
+  for (uint32_t id = 0; id < m_devices.size(); id++)
+    {
+      Ptr<MobilityModel> model = m_devices[id]->GetNode()->GetObject<MobilityModel>();
+      NS_ASSERT_MSG(model, "AquaSimGridPropagation: device " << id << " has no mobility model");
+      m_grid.Insert(id, model->GetPosition());
+      m_ids[model] = id;
+      if (previous.erase(model) == 0)
+        {
+          model->TraceConnectWithoutContext("CourseChange",
+                                            MakeCallback(&AquaSimGridPropagation::CourseChange, this));
+        }
+      double speed = CalculateDistance(model->GetVelocity(), Vector(0, 0, 0));
+      if (speed > 0)
+        {
+          m_moving[id] = model;
+          m_maxSpeed = std::max(m_maxSpeed, speed);
+        }
+    }
+  for (std::map<Ptr<const MobilityModel>, uint32_t>::iterator it = previous.begin(); it != previous.end(); it++)
+    {
+      ConstCast<MobilityModel>(it->first)->TraceDisconnectWithoutContext("CourseChange",
+                                            MakeCallback(&AquaSimGridPropagation::CourseChange, this));
+    }
+  m_lastRebucket = Simulator::Now();
+}
+
+void
+AquaSimGridPropagation::CourseChange (Ptr<const MobilityModel> model)
+{
+  std::map<Ptr<const MobilityModel>, uint32_t>::iterator it = m_ids.find(model);
+  if (it == m_ids.end())
+    {
+      return;
+    }
+  m_grid.Update(it->second, model->GetPosition());
+  double speed = CalculateDistance(model->GetVelocity(), Vector(0, 0, 0));
+  if (speed > 0)
+    {
+      m_moving[it->second] = model;
+      m_maxSpeed = std::max(m_maxSpeed, speed);
+    }
+  else
+    {
+      m_moving.erase(it->second);
+    }
+}
+
+/* Upper bound of the distance a moving device has covered since its position
+ * was last stored. Past half a cell the moving devices are rebucketed. */
+double
+AquaSimGridPropagation::Slack (void)
+{
+  if (m_moving.empty())
+    {
+      return 0;
+    }
+  double slack = m_maxSpeed * (Simulator::Now() - m_lastRebucket).GetSeconds();
+  if (slack <= m_grid.GetCellSize() / 2)
+    {
+      return slack;
+    }
+  m_maxSpeed = 0;
+  for (std::map<uint32_t, Ptr<const MobilityModel> >::iterator it = m_moving.begin(); it != m_moving.end(); it++)
+    {
+      m_grid.Update(it->first, it->second->GetPosition());
+      m_maxSpeed = std::max(m_maxSpeed, CalculateDistance(it->second->GetVelocity(), Vector(0, 0, 0)));
+    }
+  m_lastRebucket = Simulator::Now();
+  return 0;
+}
+
+std::vector<PktRecvUnit> *
+AquaSimGridPropagation::ReceivedCopies (Ptr<AquaSimNetDevice> s,
+                                        Ptr<Packet> p,
+                                        std::vector<Ptr<AquaSimNetDevice> > dList)
+{
+  Index(dList);
+  Ptr<MobilityModel> sender = s->GetNode()->GetObject<MobilityModel>();
+  // Stored positions of moving receivers may lag by up to the slack
+  double slack = Slack();
+  std::vector<uint32_t> ids;
+  m_grid.Query(sender->GetPosition(), m_grid.GetCellSize() + slack, ids);
+  std::sort(ids.begin(), ids.end());
+
+  std::vector<Ptr<AquaSimNetDevice> > candidates;
+  candidates.reserve(ids.size());
+  for (std::vector<uint32_t>::iterator it = ids.begin(); it != ids.end(); it++)
+    {
+      candidates.push_back(m_devices[*it]);
+    }
+  m_candidates += candidates.size();
+  return AquaSimRangePropagation::ReceivedCopies(s, p, candidates);
+}
+
+void
+AquaSimGridPropagation::DoDispose (void)
+{
+  for (std::map<Ptr<const MobilityModel>, uint32_t>::iterator it = m_ids.begin(); it != m_ids.end(); it++)
+    {
+      ConstCast<MobilityModel>(it->first)->TraceDisconnectWithoutContext("CourseChange",
+                                            MakeCallback(&AquaSimGridPropagation::CourseChange, this));
+    }
+  m_ids.clear();
+  m_moving.clear();
+  m_devices.clear();
+  m_grid.Clear();
+  AquaSimRangePropagation::DoDispose();
+}
@@ -0,0 +1,83 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef AQUA_SIM_GRID_PROPAGATION_H
+#define AQUA_SIM_GRID_PROPAGATION_H
+
+#include "aqua-sim-range-propagation.h"
+#include "aqua-sim-spatial-grid.h"
+#include "aqua-sim-net-device.h"
+#include "ns3/mobility-model.h"
+#include "ns3/nstime.h"
+
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Range propagation with a spatial index of the receivers
+  *
+  * The channel hands every transmission the full device list, so the range
+  * model looks at all N devices for every broadcast. This model keeps the
+  * device positions in an AquaSimSpatialGrid and passes on only the devices
+  * within CellSize of the sender, in channel order, so the received copies are
+  * the same as with AquaSimRangePropagation as long as CellSize is at least the
+  * propagation range.
+  *
+  * Positions follow the CourseChange trace of the mobility models. Devices in
+  * motion are rebucketed lazily: queries are widened by the distance they may
+  * have drifted since, and they are rebucketed once that exceeds half a cell.
+  */
+class AquaSimGridPropagation : public AquaSimRangePropagation
+{
+public:
+  static TypeId GetTypeId (void);
+  AquaSimGridPropagation ();
+
+  virtual std::vector<PktRecvUnit> * ReceivedCopies (Ptr<AquaSimNetDevice> s,
+                                                     Ptr<Packet> p,
+                                                     std::vector<Ptr<AquaSimNetDevice> > dList);
+
+  uint64_t GetCandidates (void) const; // Devices handed to the range model so far
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  void SetCellSize (double cellSize);
+  double GetCellSize (void) const;
+  void Index (const std::vector<Ptr<AquaSimNetDevice> > &dList);
+  void CourseChange (Ptr<const MobilityModel> model);
+  double Slack (void);
+
+  AquaSimSpatialGrid m_grid;
+  std::vector<Ptr<AquaSimNetDevice> > m_devices; // Indexed in channel order
+  std::map<Ptr<const MobilityModel>, uint32_t> m_ids;
+  std::map<uint32_t, Ptr<const MobilityModel> > m_moving;
+  double m_maxSpeed;
+  Time m_lastRebucket;
+  uint64_t m_candidates;
+};  // class AquaSimGridPropagation
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_GRID_PROPAGATION_H */
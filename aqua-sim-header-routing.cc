@@ -62,7 +62,7 @@ uint32_t
 DRoutingHeader::GetSerializedSize(void) const
 {
   //reserved bytes for header
-  return (2+3+1+4);
+  return (2+2+1+4);
 }
 
 void
@@ -136,7 +136,12 @@ DRoutingHeader::SetEntryNum(uint32_t entryNum)
 //NS_LOG_COMPONENT_DEFINE("CarpHeader");
 //NS_OBJECT_ENSURE_REGISTERED(CarpHeader);
 
-CarpHeader::CarpHeader()
+CarpHeader::CarpHeader() :
+  m_hopCount(0),
+  m_numPkt(0),
+  m_energy(0),
+  m_queue(0),
+  m_pckType(DATA)
 {
 }
 
@@ -160,16 +165,18 @@ CarpHeader::Deserialize(Buffer::Iterator start)
   Buffer::Iterator i = start;
   m_sAddr = (AquaSimAddress)i.ReadU16();
   m_dAddr = (AquaSimAddress)i.ReadU16();
-  m_numPkt = i.ReadU8();
   m_hopCount = i.ReadU8();
+  m_numPkt = i.ReadU8();
+  m_pckType = (PckType)i.ReadU8();
+  m_queue = i.ReadU8();
   return GetSerializedSize();
 }
 
 uint32_t
 CarpHeader::GetSerializedSize(void)const
 {
-  //HELLO, PING, PONG are 6 bytes individually
-  return (2+4);
+  //HELLO, PING, PONG are 8 bytes individually
+  return (2+2+1+1+1+1);
 }
 
 void
@@ -180,6 +187,8 @@ CarpHeader::Serialize(Buffer::Iterator start)const
   i.WriteU16(m_dAddr.GetAsInt());
   i.WriteU8(m_hopCount);
   i.WriteU8(m_numPkt);
+  i.WriteU8(m_pckType);
+  i.WriteU8(m_queue);
 }
 
 void
@@ -243,6 +252,11 @@ CarpHeader::SetQueue(uint8_t queue)
 {
   m_queue = queue;
 }
+uint8_t
+CarpHeader::GetQueue()
+{
+  return m_queue;
+}
 void
 CarpHeader::SetEnergy(double energy)
 {
@@ -260,9 +274,11 @@ CarpHeader::GetPacketType()
 }
 
 
-/* Hello Header Class Definition */
+/* Hello Header Class Definition
+ * The control frames keep the CarpHeader layout, so that Recv can tell them apart by their packet type */
 HelloHeader::HelloHeader()
 {
+  m_pckType = HELLO;
 }
 HelloHeader::~HelloHeader()
 {
@@ -275,21 +291,6 @@ HelloHeader::GetTypeId()
     .AddConstructor<HelloHeader>();
     return tid;
 }
-void
-HelloHeader::Serialize(Buffer::Iterator start)const
-{
-  Buffer::Iterator i = start;
-  i.WriteU16(m_sAddr.GetAsInt());
-  i.WriteU8(m_hopCount);
-}
-uint32_t
-HelloHeader::Deserialize(Buffer::Iterator start)
-{
-  Buffer::Iterator i = start;
-  m_sAddr = (AquaSimAddress)i.ReadU16();
-  m_hopCount = i.ReadU8();
-  return GetSerializedSize();
-}
 TypeId
 HelloHeader::GetInstanceTypeId(void)const
 {
@@ -299,6 +300,7 @@ HelloHeader::GetInstanceTypeId(void)const
 /* Ping Header Class Definition */
 PingHeader::PingHeader()
 {
+  m_pckType = PING;
 }
 PingHeader::~PingHeader()
 {
@@ -311,21 +313,6 @@ PingHeader::GetTypeId()
     .AddConstructor<PingHeader>();
     return tid;
 }
-void
-PingHeader::Serialize(Buffer::Iterator start)const
-{
-  Buffer::Iterator i = start;
-  i.WriteU16(m_sAddr.GetAsInt());
-  i.WriteU8(m_numPkt);
-}
-uint32_t
-PingHeader::Deserialize(Buffer::Iterator start)
-{
-  Buffer::Iterator i = start;
-  m_sAddr = (AquaSimAddress)i.ReadU16();
-  m_numPkt = i.ReadU8();
-  return GetSerializedSize();
-}
 TypeId
 PingHeader::GetInstanceTypeId(void)const
 {
@@ -335,6 +322,7 @@ PingHeader::GetInstanceTypeId(void)const
 /* Pong Header Classification */
 PongHeader:: PongHeader()
 {
+  m_pckType = PONG;
 }
 PongHeader::~PongHeader()
 {
@@ -347,35 +335,223 @@ PongHeader::GetTypeId()
     .AddConstructor<PongHeader>();
     return tid;
 }
+TypeId
+PongHeader::GetInstanceTypeId(void)const
+{
+  return GetTypeId();
+}
+
+/*
+* CARP aggregation header
+*/
+NS_OBJECT_ENSURE_REGISTERED(CarpAggHeader);
+
+CarpAggHeader::CarpAggHeader()
+{
+}
+
+CarpAggHeader::~CarpAggHeader()
+{
+}
+
+TypeId
+CarpAggHeader::GetTypeId()
+{
+  static TypeId tid = TypeId("ns3::CarpAggHeader")
+    .SetParent<Header>()
+    .AddConstructor<CarpAggHeader>()
+  ;
+  return tid;
+}
+
+uint32_t
+CarpAggHeader::Deserialize(Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  uint8_t num = i.ReadU8();
+  m_lengths.clear();
+  for (uint8_t n = 0; n < num; n++)
+    {
+      m_lengths.push_back(i.ReadU16());
+    }
+  return GetSerializedSize();
+}
+
+uint32_t
+CarpAggHeader::GetSerializedSize(void) const
+{
+  //packet count followed by one length per packet
+  return (1 + 2*m_lengths.size());
+}
+
 void
-PongHeader::Serialize(Buffer::Iterator start)const
+CarpAggHeader::Serialize(Buffer::Iterator start) const
 {
   Buffer::Iterator i = start;
-  i.WriteU16(m_sAddr.GetAsInt());
-  i.WriteU16(m_dAddr.GetAsInt());
-  i.WriteU8(m_queue);
-  i.WriteU8((uint8_t) (m_energy * 1000.0)); // Serialization of a double data type
-  i.WriteU8(m_hopCount);
- 
+  i.WriteU8(m_lengths.size());
+  for (std::vector<uint16_t>::const_iterator it = m_lengths.begin(); it != m_lengths.end(); it++)
+    {
+      i.WriteU16(*it);
+    }
+}
+
+void
+CarpAggHeader::Print(std::ostream &os) const
+{
+  os << "CARP Aggregation Header is: NumPackets=" << m_lengths.size() << "\n";
+}
+
+TypeId
+CarpAggHeader::GetInstanceTypeId(void) const
+{
+  return GetTypeId();
+}
+
+void
+CarpAggHeader::AddPacket(uint16_t length)
+{
+  m_lengths.push_back(length);
+}
+uint8_t
+CarpAggHeader::GetNumPackets()
+{
+  return m_lengths.size();
 }
+uint16_t
+CarpAggHeader::GetLength(uint8_t index)
+{
+  return m_lengths.at(index);
+}
+
+/*
+* CARP hop-by-hop acknowledgement header
+*/
+NS_OBJECT_ENSURE_REGISTERED(CarpAckHeader);
+
+CarpAckHeader::CarpAckHeader() :
+  m_uid(0)
+{
+}
+
+CarpAckHeader::~CarpAckHeader()
+{
+}
+
+TypeId
+CarpAckHeader::GetTypeId()
+{
+  static TypeId tid = TypeId("ns3::CarpAckHeader")
+    .SetParent<Header>()
+    .AddConstructor<CarpAckHeader>()
+  ;
+  return tid;
+}
+
 uint32_t
-PongHeader::Deserialize(Buffer::Iterator start)
+CarpAckHeader::Deserialize(Buffer::Iterator start)
 {
   Buffer::Iterator i = start;
-  m_sAddr = (AquaSimAddress)i.ReadU16();
-  m_dAddr = (AquaSimAddress)i.ReadU16();
-  m_queue = i.ReadU8();
-  m_energy= ((double) i.ReadU8())/1000.0; // Deserialization of a double data type
-  m_hopCount = i.ReadU8();
- 
+  m_uid = i.ReadU32();
   return GetSerializedSize();
 }
+
+uint32_t
+CarpAckHeader::GetSerializedSize(void) const
+{
+  return 4;
+}
+
+void
+CarpAckHeader::Serialize(Buffer::Iterator start) const
+{
+  Buffer::Iterator i = start;
+  i.WriteU32(m_uid);
+}
+
+void
+CarpAckHeader::Print(std::ostream &os) const
+{
+  os << "CARP ACK Header is: Uid=" << m_uid << "\n";
+}
+
 TypeId
-PongHeader::GetInstanceTypeId(void)const
+CarpAckHeader::GetInstanceTypeId(void) const
 {
   return GetTypeId();
 }
 
+void
+CarpAckHeader::SetUid(uint32_t uid)
+{
+  m_uid = uid;
+}
+uint32_t
+CarpAckHeader::GetUid()
+{
+  return m_uid;
+}
+
+/*
+* CARP origin timestamp tag
+*/
+NS_OBJECT_ENSURE_REGISTERED(CarpTimestampTag);
+
+CarpTimestampTag::CarpTimestampTag() :
+  m_timestamp(0)
+{
+}
+
+TypeId
+CarpTimestampTag::GetTypeId()
+{
+  static TypeId tid = TypeId("ns3::CarpTimestampTag")
+    .SetParent<Tag>()
+    .AddConstructor<CarpTimestampTag>()
+  ;
+  return tid;
+}
+
+TypeId
+CarpTimestampTag::GetInstanceTypeId(void) const
+{
+  return GetTypeId();
+}
+
+uint32_t
+CarpTimestampTag::GetSerializedSize(void) const
+{
+  return 8;
+}
+
+void
+CarpTimestampTag::Serialize(TagBuffer i) const
+{
+  i.WriteU64(m_timestamp);
+}
+
+void
+CarpTimestampTag::Deserialize(TagBuffer i)
+{
+  m_timestamp = i.ReadU64();
+}
+
+void
+CarpTimestampTag::Print(std::ostream &os) const
+{
+  os << "CarpTimestamp=" << m_timestamp << "ns";
+}
+
+void
+CarpTimestampTag::SetTimestamp(Time time)
+{
+  m_timestamp = time.GetNanoSeconds();
+}
+Time
+CarpTimestampTag::GetTimestamp() const
+{
+  return NanoSeconds(m_timestamp);
+}
+
 /*
 * Vector Based Routing
 */
@@ -845,21 +1021,21 @@ uint32_t
 DDOSHeader::Deserialize(Buffer::Iterator start)
 {
   m_pt = start.ReadU8();
-  m_index = (uint32_t) start.ReadU8();
+  m_index = start.ReadU32();
   return GetSerializedSize();
 }
 
 uint32_t
 DDOSHeader::GetSerializedSize() const
 {
-  return 2;
+  return 1+4;
 }
 
 void
 DDOSHeader::Serialize(Buffer::Iterator start) const
 {
   start.WriteU8(m_pt);
-  start.WriteU8((uint8_t) m_index);
+  start.WriteU32(m_index);
 }
 
 void
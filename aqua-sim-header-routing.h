@@ -23,8 +23,11 @@
 
 //#include <string>
 #include <iostream>
+#include <vector>
 
 #include "ns3/header.h"
+#include "ns3/tag.h"
+#include "ns3/nstime.h"
 //#include "ns3/nstime.h"
 #include "ns3/vector.h"
 
@@ -40,7 +43,12 @@ enum PckType
 {
 		ACK=0,
 		DATA=1,
-		LQ_DATA=2
+		LQ_DATA=2,
+		AGG=3,
+		DATA_ACK=4,
+		HELLO=16, // The control frames share the values of CarpTraceControlType
+		PING=17,
+		PONG=18
 };
 
 namespace ns3 {
@@ -145,8 +153,6 @@ public:
 	virtual ~HelloHeader();
 	static TypeId GetTypeId();
 
-	 void Serialize (Buffer::Iterator start)const; // Removed const
-	 uint32_t Deserialize (Buffer::Iterator start);
 	 TypeId GetInstanceTypeId(void)const;	// Removed const
 }; // class HelloHeader
 
@@ -158,8 +164,6 @@ public:
 	virtual ~PingHeader();
 	static TypeId GetTypeId();
 
-	 void Serialize (Buffer::Iterator start)const; // Removed const
-	 uint32_t Deserialize (Buffer::Iterator start);
 	 TypeId GetInstanceTypeId(void)const; // Removed const
 }; // class PingHeader
 
@@ -170,12 +174,98 @@ public:
 	virtual ~PongHeader();
 	static TypeId GetTypeId();
 
-	 void Serialize (Buffer::Iterator start)const; // Removed const
-	 uint32_t Deserialize (Buffer::Iterator start);
 	 TypeId GetInstanceTypeId(void)const; // Removed const
 }; // class PongHeader
 
 
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief CARP aggregation header
+  *
+  * Precedes the packets packed into one super-frame for a common next hop and
+  * records the length of each of them so the next hop can unpack the frame.
+  */
+class CarpAggHeader : public Header
+{
+public:
+  CarpAggHeader();
+  virtual ~CarpAggHeader();
+  static TypeId GetTypeId();
+
+  void AddPacket(uint16_t length);
+  uint8_t GetNumPackets();
+  uint16_t GetLength(uint8_t index);
+
+  //inherited methods
+  virtual uint32_t GetSerializedSize(void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+  virtual TypeId GetInstanceTypeId(void) const;
+
+private:
+  std::vector<uint16_t> m_lengths; // Length of each packed packet (in bytes)
+}; // class CarpAggHeader
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief CARP hop-by-hop acknowledgement header
+  *
+  * Follows the CarpHeader of a DATA_ACK and names the frame acknowledged, so
+  * that the relay releases that frame whatever order the ACKs arrive in.
+  */
+class CarpAckHeader : public Header
+{
+public:
+  CarpAckHeader();
+  virtual ~CarpAckHeader();
+  static TypeId GetTypeId();
+
+  void SetUid(uint32_t uid);
+  uint32_t GetUid();
+
+  //inherited methods
+  virtual uint32_t GetSerializedSize(void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+  virtual TypeId GetInstanceTypeId(void) const;
+
+private:
+  uint32_t m_uid; // Low 32 bits of the uid of the frame acknowledged
+}; // class CarpAckHeader
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Origin time of a CARP data packet
+  *
+  * Added as a byte tag when a packet enters CARP at its source, so that it
+  * travels without air time and survives aggregation into super-frames.
+  */
+class CarpTimestampTag : public Tag
+{
+public:
+  CarpTimestampTag();
+  static TypeId GetTypeId();
+
+  void SetTimestamp(Time time);
+  Time GetTimestamp() const;
+
+  //inherited methods
+  virtual TypeId GetInstanceTypeId(void) const;
+  virtual uint32_t GetSerializedSize(void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+
+private:
+  int64_t m_timestamp; // Origin time (ns)
+}; // class CarpTimestampTag
+
+
  /**
   * \brief Vector Based routing header
   * Protocol paper: engr.uconn.edu/~jcui/UWSN_papers/vbf_networking2006.pdf
@@ -0,0 +1,426 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-lite-channel.h"
+#include "aqua-sim-net-device.h"
+#include "aqua-sim-header.h"
+#include "ns3/log.h"
+#include "ns3/double.h"
+#include "ns3/string.h"
+#include "ns3/pointer.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AquaSimLiteChannel");
+NS_OBJECT_ENSURE_REGISTERED(AquaSimLiteChannel);
+NS_OBJECT_ENSURE_REGISTERED(AquaSimLiteMac);
+
+TypeId
+AquaSimLiteChannel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::AquaSimLiteChannel")
+    .SetParent<Object> ()
+    .AddConstructor<AquaSimLiteChannel> ()
+    .AddAttribute ("Range", "Distance up to which frames are received, without PsrFile (m).",
+      DoubleValue (1000),
+      MakeDoubleAccessor (&AquaSimLiteChannel::m_range),
+      MakeDoubleChecker<double> (0))
+    .AddAttribute ("Psr", "Probability that a receiver within Range gets a frame, without PsrFile.",
+      DoubleValue (1.0),
+      MakeDoubleAccessor (&AquaSimLiteChannel::m_psr),
+      MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("PsrFile", "File of links, one \"sender-node-id receiver-node-id psr\" per line, replacing Range and Psr. Empty uses the range model.",
+      StringValue (""),
+      MakeStringAccessor (&AquaSimLiteChannel::m_psrFile),
+      MakeStringChecker ())
+    .AddAttribute ("SoundSpeed", "Propagation speed of the frames (m/s).",
+      DoubleValue (1500),
+      MakeDoubleAccessor (&AquaSimLiteChannel::m_soundSpeed),
+      MakeDoubleChecker<double> (1))
+    .AddAttribute ("DataRate", "Bit rate at which the frames of a node are transmitted, one after the other (bps).",
+      DoubleValue (10000),
+      MakeDoubleAccessor (&AquaSimLiteChannel::m_dataRate),
+      MakeDoubleChecker<double> (1))
+    ;
+  return tid;
+}
+
+AquaSimLiteChannel::AquaSimLiteChannel () :
+  m_range(1000),
+  m_psr(1.0),
+  m_soundSpeed(1500),
+  m_dataRate(10000),
+  m_indexed(0),
+  m_transmissions(0),
+  m_delivered(0),
+  m_lost(0)
+{
+  m_rand = CreateObject<UniformRandomVariable> ();
+}
+
+void
+AquaSimLiteChannel::AddMac (Ptr<AquaSimLiteMac> mac)
+{
+  if (m_index.find(mac) != m_index.end())
+    {
+      return;
+    }
+  m_index[mac] = m_macs.size();
+  m_macs.push_back(mac);
+}
+
+int64_t
+AquaSimLiteChannel::AssignStreams (int64_t stream)
+{
+  m_rand->SetStream(stream);
+  return 1;
+}
+
+uint64_t
+AquaSimLiteChannel::GetTransmissions (void) const
+{
+  return m_transmissions;
+}
+
+uint64_t
+AquaSimLiteChannel::GetDelivered (void) const
+{
+  return m_delivered;
+}
+
+uint64_t
+AquaSimLiteChannel::GetLost (void) const
+{
+  return m_lost;
+}
+
+void
+AquaSimLiteChannel::PrintCounters (std::ostream &os) const
+{
+  os << "AquaSimLiteChannel: " << m_transmissions << " frames sent, " << m_delivered
+     << " copies received, " << m_lost << " copies lost\n";
+}
+
+/* The MACs register when they are created but only get their device and
+ * position later, so the index is built at the first transmission after
+ * a MAC was added. */
+void
+AquaSimLiteChannel::Index (void)
+{
+  if (m_indexed == m_macs.size())
+    {
+      return;
+    }
+  NS_LOG_FUNCTION(this << m_macs.size());
+  m_grid.SetCellSize(std::max(m_range, 1.0));
+  m_grid.Clear();
+  m_byAddress.clear();
+  m_models.resize(m_macs.size());
+  m_busyUntil.resize(m_macs.size());
+  for (uint32_t id = 0; id < m_macs.size(); id++)
+    {
+      Ptr<AquaSimNetDevice> dev = m_macs[id]->Device();
+      NS_ASSERT_MSG(dev, "AquaSimLiteChannel: MAC " << id << " has no device");
+      m_byAddress[AquaSimAddress::ConvertFrom(dev->GetAddress())] = id;
+      Ptr<MobilityModel> model = dev->GetNode()->GetObject<MobilityModel>();
+      NS_ASSERT_MSG(model, "AquaSimLiteChannel: node " << dev->GetNode()->GetId() << " has no mobility model");
+      m_grid.Insert(id, model->GetPosition());
+      if (m_ids.find(model) == m_ids.end())
+        {
+          model->TraceConnectWithoutContext("CourseChange", MakeCallback(&AquaSimLiteChannel::CourseChange, this));
+        }
+      m_ids[model] = id;
+      m_models[id] = model;
+    }
+  m_indexed = m_macs.size();
+  if (!m_psrFile.empty())
+    {
+      ReadPsrFile();
+    }
+}
+
+void
+AquaSimLiteChannel::ReadPsrFile (void)
+{
+  std::map<uint32_t, uint32_t> byNode;
+  for (uint32_t id = 0; id < m_macs.size(); id++)
+    {
+      byNode[m_macs[id]->Device()->GetNode()->GetId()] = id;
+    }
+  std::ifstream in(m_psrFile.c_str());
+  if (!in)
+    {
+      NS_FATAL_ERROR("AquaSimLiteChannel: cannot open " << m_psrFile);
+    }
+  m_matrix.assign(m_macs.size(), std::vector<Link>());
+  std::string line;
+  uint32_t links = 0;
+  while (std::getline(in, line))
+    {
+      line = line.substr(0, line.find('#'));
+      std::istringstream fields(line);
+      uint32_t from, to;
+      double psr;
+      if (!(fields >> from >> to >> psr))
+        {
+          continue;
+        }
+      std::map<uint32_t, uint32_t>::iterator s = byNode.find(from);
+      std::map<uint32_t, uint32_t>::iterator r = byNode.find(to);
+      if (s == byNode.end() || r == byNode.end() || s->second == r->second)
+        {
+          NS_LOG_WARN("AquaSimLiteChannel: link " << from << " " << to << " of " << m_psrFile << " ignored");
+          continue;
+        }
+      Link link;
+      link.m_receiver = r->second;
+      link.m_psr = std::min(std::max(psr, 0.0), 1.0);
+      m_matrix[s->second].push_back(link);
+      links++;
+    }
+  NS_LOG_INFO("AquaSimLiteChannel: " << links << " links read from " << m_psrFile);
+}
+
+void
+AquaSimLiteChannel::CourseChange (Ptr<const MobilityModel> model)
+{
+  std::map<Ptr<const MobilityModel>, uint32_t>::iterator it = m_ids.find(model);
+  if (it != m_ids.end() && it->second < m_indexed)
+    {
+      m_grid.Update(it->second, model->GetPosition());
+    }
+}
+
+/* A frame is sent once the frames queued before it at its sender are out.
+ * Every receiver that gets it is scheduled at the end of its transmission
+ * plus the propagation delay. Only unicast frames that are lost cost an
+ * event, to report their outcome to the sender. */
+bool
+AquaSimLiteChannel::Transmit (Ptr<AquaSimLiteMac> sender, Ptr<Packet> p)
+{
+  Index();
+  std::map<Ptr<AquaSimLiteMac>, uint32_t>::iterator si = m_index.find(sender);
+  NS_ASSERT_MSG(si != m_index.end(), "AquaSimLiteChannel: frame of an unknown MAC");
+  uint32_t s = si->second;
+
+  AquaSimHeader ash;
+  p->PeekHeader(ash);
+  AquaSimAddress dst = ash.GetNextHop();
+  Time now = Simulator::Now();
+  Time start = std::max(now, m_busyUntil[s]);
+  m_busyUntil[s] = start + Seconds(p->GetSize() * 8.0 / m_dataRate);
+  Time sent = m_busyUntil[s] - now;
+  m_transmissions++;
+
+  std::vector<Link> links;
+  if (dst != AquaSimAddress::GetBroadcast())
+    {
+      std::map<AquaSimAddress, uint32_t>::iterator r = m_byAddress.find(dst);
+      if (r != m_byAddress.end())
+        {
+          Link link;
+          link.m_receiver = r->second;
+          link.m_psr = 0;
+          if (!m_psrFile.empty())
+            {
+              for (std::vector<Link>::iterator it = m_matrix[s].begin(); it != m_matrix[s].end(); it++)
+                {
+                  if (it->m_receiver == r->second)
+                    {
+                      link.m_psr = it->m_psr;
+                    }
+                }
+            }
+          else if (CalculateDistance(m_grid.GetPosition(s), m_grid.GetPosition(r->second)) <= m_range)
+            {
+              link.m_psr = m_psr;
+            }
+          links.push_back(link);
+        }
+    }
+  else if (!m_psrFile.empty())
+    {
+      links = m_matrix[s];
+    }
+  else
+    {
+      std::vector<uint32_t> ids;
+      m_grid.Query(m_grid.GetPosition(s), m_range, ids);
+      std::sort(ids.begin(), ids.end());
+      for (std::vector<uint32_t>::iterator it = ids.begin(); it != ids.end(); it++)
+        {
+          if (*it != s)
+            {
+              Link link;
+              link.m_receiver = *it;
+              link.m_psr = m_psr;
+              links.push_back(link);
+            }
+        }
+    }
+
+  bool heard = false;
+  for (std::vector<Link>::iterator it = links.begin(); it != links.end(); it++)
+    {
+      Time delay = sent + Seconds(CalculateDistance(m_grid.GetPosition(s), m_grid.GetPosition(it->m_receiver)) / m_soundSpeed);
+      uint32_t context = m_macs[it->m_receiver]->Device()->GetNode()->GetId();
+      if (it->m_psr >= 1 || m_rand->GetValue() < it->m_psr)
+        {
+          heard = true;
+          Simulator::ScheduleWithContext(context, delay, &AquaSimLiteChannel::Deliver, this, s, it->m_receiver, p->Copy(), dst);
+        }
+      else
+        {
+          m_lost++;
+          if (dst != AquaSimAddress::GetBroadcast())
+            {
+              Simulator::ScheduleWithContext(context, delay, &AquaSimLiteChannel::Deliver, this, s, it->m_receiver, Ptr<Packet>(), dst);
+            }
+        }
+    }
+  if (links.empty() && dst != AquaSimAddress::GetBroadcast())
+    {
+      // No such neighbor, the sender learns it once the frame is out
+      m_lost++;
+      Simulator::Schedule(sent, &AquaSimLiteMac::NotifyTxOutcome, sender, dst, false);
+    }
+  return heard;
+}
+
+/* Hands a received copy to the MAC of its receiver, and reports the outcome
+ * of a unicast frame to its sender. A null packet is a lost copy. */
+void
+AquaSimLiteChannel::Deliver (uint32_t sender, uint32_t receiver, Ptr<Packet> p, AquaSimAddress dst)
+{
+  if (p)
+    {
+      m_delivered++;
+      AquaSimHeader ash;
+      p->RemoveHeader(ash);
+      ash.SetDirection(AquaSimHeader::UP);
+      p->AddHeader(ash);
+      m_macs[receiver]->RecvProcess(p);
+    }
+  if (dst != AquaSimAddress::GetBroadcast())
+    {
+      m_macs[sender]->NotifyTxOutcome(dst, p != 0);
+    }
+}
+
+void
+AquaSimLiteChannel::DoDispose (void)
+{
+  for (std::map<Ptr<const MobilityModel>, uint32_t>::iterator it = m_ids.begin(); it != m_ids.end(); it++)
+    {
+      ConstCast<MobilityModel>(it->first)->TraceDisconnectWithoutContext("CourseChange",
+                                            MakeCallback(&AquaSimLiteChannel::CourseChange, this));
+    }
+  m_ids.clear();
+  for (uint32_t id = 0; id < m_macs.size(); id++)
+    {
+      m_macs[id]->SetChannel(0);
+    }
+  m_macs.clear();
+  m_index.clear();
+  m_models.clear();
+  m_byAddress.clear();
+  m_matrix.clear();
+  m_grid.Clear();
+  m_rand = 0;
+  Object::DoDispose();
+}
+
+TypeId
+AquaSimLiteMac::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::AquaSimLiteMac")
+    .SetParent<AquaSimMac> ()
+    .AddConstructor<AquaSimLiteMac> ()
+    .AddAttribute ("Channel", "AquaSimLiteChannel the frames of this MAC go through, shared by all the MACs of a run.",
+      PointerValue (),
+      MakePointerAccessor (&AquaSimLiteMac::SetChannel, &AquaSimLiteMac::GetChannel),
+      MakePointerChecker<AquaSimLiteChannel> ())
+    .AddTraceSource ("TxOutcome", "A unicast frame reached its next hop or was lost. ",
+      MakeTraceSourceAccessor (&AquaSimLiteMac::m_txOutcome),
+      "ns3::AquaSimLiteMac::TxOutcomeCallback")
+    ;
+  return tid;
+}
+
+AquaSimLiteMac::AquaSimLiteMac ()
+{
+}
+
+int64_t
+AquaSimLiteMac::AssignStreams (int64_t stream)
+{
+  return 0;
+}
+
+void
+AquaSimLiteMac::SetChannel (Ptr<AquaSimLiteChannel> channel)
+{
+  m_channel = channel;
+  if (m_channel)
+    {
+      m_channel->AddMac(this);
+    }
+}
+
+Ptr<AquaSimLiteChannel>
+AquaSimLiteMac::GetChannel (void) const
+{
+  return m_channel;
+}
+
+bool
+AquaSimLiteMac::RecvProcess (Ptr<Packet> p)
+{
+  SendUp(p);
+  return true;
+}
+
+bool
+AquaSimLiteMac::TxProcess (Ptr<Packet> p)
+{
+  NS_ASSERT_MSG(m_channel, "AquaSimLiteMac: no Channel set");
+  m_channel->Transmit(this, p);
+  return true;
+}
+
+void
+AquaSimLiteMac::NotifyTxOutcome (AquaSimAddress dst, bool success)
+{
+  m_txOutcome(dst, success);
+}
+
+/* The channel is shared, so a MAC only drops its own reference to it */
+void
+AquaSimLiteMac::DoDispose (void)
+{
+  m_channel = 0;
+  AquaSimMac::DoDispose();
+}
@@ -0,0 +1,152 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef AQUA_SIM_LITE_CHANNEL_H
+#define AQUA_SIM_LITE_CHANNEL_H
+
+#include "aqua-sim-mac.h"
+#include "aqua-sim-address.h"
+#include "aqua-sim-spatial-grid.h"
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/mobility-model.h"
+#include "ns3/traced-callback.h"
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+class AquaSimLiteMac;
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Frame delivery for routing-only simulations
+  *
+  * Stands in for the PHY, the acoustic channel and the MAC contention when
+  * only whether and when a frame reaches a neighbor matters. A frame leaves
+  * its sender after the frames queued before it, takes its size over
+  * DataRate to transmit, and reaches every receiver after the propagation
+  * delay at SoundSpeed. There is no interference: every receiver gets the
+  * frame with its link PSR.
+  *
+  * The links are either all pairs within Range, each with the PSR of the
+  * Psr attribute, or the pairs of a PSR matrix file (PsrFile) with lines of
+  * "sender-node-id receiver-node-id psr". Unicast frames only reach their
+  * next hop, as the addressed MACs of the full stack filter them.
+  *
+  * Positions are read when a MAC first transmits and follow the CourseChange
+  * trace of the mobility models afterwards, so nodes moving at a constant
+  * velocity are seen at the position of their last course change.
+  */
+class AquaSimLiteChannel : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+  AquaSimLiteChannel ();
+
+  void AddMac (Ptr<AquaSimLiteMac> mac);
+  // Queues a frame of a MAC for transmission, returns false if no MAC hears it
+  bool Transmit (Ptr<AquaSimLiteMac> sender, Ptr<Packet> p);
+  int64_t AssignStreams (int64_t stream);
+
+  uint64_t GetTransmissions (void) const;
+  uint64_t GetDelivered (void) const;
+  uint64_t GetLost (void) const;
+  void PrintCounters (std::ostream &os) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct Link
+  {
+    uint32_t m_receiver; // Index of the receiving MAC
+    double m_psr;
+  };
+
+  void Index (void);
+  void ReadPsrFile (void);
+  void CourseChange (Ptr<const MobilityModel> model);
+  void Deliver (uint32_t sender, uint32_t receiver, Ptr<Packet> p, AquaSimAddress dst);
+
+  double m_range;
+  double m_psr;
+  std::string m_psrFile;
+  double m_soundSpeed;
+  double m_dataRate;
+  Ptr<UniformRandomVariable> m_rand;
+
+  std::vector<Ptr<AquaSimLiteMac> > m_macs;
+  std::vector<Ptr<MobilityModel> > m_models;
+  std::vector<Time> m_busyUntil; // End of the last frame queued at every MAC
+  std::map<Ptr<AquaSimLiteMac>, uint32_t> m_index;
+  std::map<AquaSimAddress, uint32_t> m_byAddress;
+  std::map<Ptr<const MobilityModel>, uint32_t> m_ids;
+  std::vector<std::vector<Link> > m_matrix; // Links of every sender, from PsrFile
+  AquaSimSpatialGrid m_grid;
+  uint32_t m_indexed; // MACs in the index
+
+  uint64_t m_transmissions;
+  uint64_t m_delivered;
+  uint64_t m_lost;
+};  // class AquaSimLiteChannel
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief MAC of the lightweight stack
+  *
+  * Hands every frame of the routing layer to its AquaSimLiteChannel and
+  * every frame delivered by the channel to the routing layer, skipping the
+  * PHY. The TxOutcome trace source reports for every unicast frame whether
+  * its next hop got it, which AquaSimCarp uses with MacFeedback.
+  */
+class AquaSimLiteMac : public AquaSimMac
+{
+public:
+  static TypeId GetTypeId (void);
+  AquaSimLiteMac ();
+  int64_t AssignStreams (int64_t stream);
+
+  virtual bool RecvProcess (Ptr<Packet> p);
+  virtual bool TxProcess (Ptr<Packet> p);
+
+  void NotifyTxOutcome (AquaSimAddress dst, bool success);
+
+  typedef void (* TxOutcomeCallback)(AquaSimAddress dst, bool success);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  void SetChannel (Ptr<AquaSimLiteChannel> channel);
+  Ptr<AquaSimLiteChannel> GetChannel (void) const;
+
+  Ptr<AquaSimLiteChannel> m_channel;
+  TracedCallback<AquaSimAddress, bool> m_txOutcome;
+};  // class AquaSimLiteMac
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_LITE_CHANNEL_H */
@@ -8,22 +8,74 @@
 #include "aqua-sim-header.h"
 #include "aqua-sim-pt-tag.h"
 #include "aqua-sim-propagation.h"
+#include "aqua-sim-mac.h"
 #include "ns3/log.h"
 #include "ns3/integer.h"
 #include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/enum.h"
+#include "ns3/trace-source-accessor.h"
 #include "ns3/mobility-model.h"
 #include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/node.h"
+#include "ns3/node-list.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sys/stat.h>
 
 using namespace ns3;
 
+NS_LOG_COMPONENT_DEFINE("AquaSimCarp");
+
 /**** AquaSimCarp ****/
 
+/* Counts the calls from the MAC (Recv and the TxOutcome trace) in progress of a node, whatever path they return by */
+class CarpRecvScope
+{
+public:
+  CarpRecvScope(uint32_t &depth) : m_depth(depth) { m_depth++; }
+  ~CarpRecvScope() { m_depth--; }
+private:
+  uint32_t &m_depth;
+};
 
 /* Constructor of CARP with initialization of wait_time Time object */
-AquaSimCarp::AquaSimCarp() : wait_time(MilliSeconds (6.0))
+AquaSimCarp::AquaSimCarp() : wait_time(MilliSeconds (6.0)),
+  m_sink(false),
+  m_aggregation(false),
+  m_aggSize(1000),
+  m_aggDelay(Seconds(1.0)),
+  m_hopAckTimeout(Seconds(0.0)),
+  m_maxUnacked(64),
+  m_inAggregate(false),
+  m_directSend(true),
+  m_recvDepth(0),
+  m_lqMode(LQ_PROBE),
+  m_analyticFrequency(25),
+  m_analyticBandwidth(4),
+  m_analyticSourceLevel(120),
+  m_analyticShipping(0.5),
+  m_analyticWind(0),
+  m_analyticPacketSize(100),
+  m_macFeedback(false),
+  m_macFeedbackWeight(0.1),
+  m_macFeedbackConnected(false),
+  m_congestionThreshold(8),
+  m_downstreamLevel(0),
+  m_congested(false),
+  m_warmStartChecked(false),
+  m_warmStarted(false)
+#ifdef CARP_PROFILE
+  , m_profileTimers(false),
+  m_profileRegistered(false)
+#endif
 {
 
   m_rand = CreateObject<UniformRandomVariable> ();
+  m_core.SetEnv(this);
 }
 
 /* This is used to create a Type Id for CARP during runtime
@@ -47,139 +99,280 @@ AquaSimCarp::GetTypeId(void)
       .AddAttribute("HelloTime", "Time duration for the HELLO broadcast. ",
 					TimeValue (Seconds (1.0)),
 					MakeTimeAccessor (&AquaSimCarp::hello_time),
-					MakeTimeChecker ());
-  cout<<"CARP Routing Protocl is in use "<< endl; 
+					MakeTimeChecker ())
+      .AddAttribute ("Sink", "This node is a sink: it starts the HELLO flood and collects the data packets. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AquaSimCarp::SetSink, &AquaSimCarp::GetSink),
+                   MakeBooleanChecker ())
+      .AddAttribute ("ProbeCount", "LQ_DATA probes sent to every neighbor per selection window. ",
+                   UintegerValue (4),
+                   MakeUintegerAccessor (&AquaSimCarp::SetProbeCount, &AquaSimCarp::GetProbeCount),
+                   MakeUintegerChecker<uint8_t> (1))
+      .AddAttribute ("Multipath", "Spread data packets over all relays whose link quality is within MultipathTolerance of the best relay. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AquaSimCarp::SetMultipath, &AquaSimCarp::GetMultipath),
+                   MakeBooleanChecker ())
+      .AddAttribute ("MultipathTolerance", "Maximum link quality difference from the best relay for a neighbor to join the relay set. ",
+                   DoubleValue (0.1),
+                   MakeDoubleAccessor (&AquaSimCarp::SetMultipathTolerance, &AquaSimCarp::GetMultipathTolerance),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+      .AddAttribute ("MultipathScheduler", "Scheduler used to spread packets over the relay set. ",
+                   EnumValue (WEIGHTED_RR),
+                   MakeEnumAccessor (&AquaSimCarp::SetMultipathScheduler, &AquaSimCarp::GetMultipathScheduler),
+                   MakeEnumChecker (WEIGHTED_RR, "WeightedRoundRobin",
+                                    DEFICIT_RR, "Deficit"))
+      .AddTraceSource ("RelayTx", "A data packet was handed to a relay of the multipath set. ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_relayTxTrace),
+                   "ns3::AquaSimCarp::RelayTxCallback")
+      .AddAttribute ("Aggregation", "Pack data packets waiting for the same next hop into one super-frame. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AquaSimCarp::m_aggregation),
+                   MakeBooleanChecker ())
+      .AddAttribute ("AggregationSize", "Size budget of a super-frame in bytes. ",
+                   UintegerValue (1000),
+                   MakeUintegerAccessor (&AquaSimCarp::m_aggSize),
+                   MakeUintegerChecker<uint32_t> ())
+      .AddAttribute ("AggregationDelay", "Maximum time a data packet waits for others sharing its next hop. ",
+                   TimeValue (Seconds (1.0)),
+                   MakeTimeAccessor (&AquaSimCarp::m_aggDelay),
+                   MakeTimeChecker ())
+      .AddAttribute ("HopAckTimeout", "Time to wait for the hop-by-hop ACK of a data frame before switching to the backup relay. Zero disables hop ACKs. ",
+                   TimeValue (Seconds (0.0)),
+                   MakeTimeAccessor (&AquaSimCarp::m_hopAckTimeout),
+                   MakeTimeChecker ())
+      .AddTraceSource ("Reroute", "Forwarding switched from a failed relay to the backup relay. ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_rerouteTrace),
+                   "ns3::AquaSimCarp::RerouteCallback")
+      .AddAttribute ("DirectSend", "Hand frames to the MAC at once when no MAC handler is on the stack, and batch the frames of a receive handler into one event. When false, every frame gets its own zero-delay event. ",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&AquaSimCarp::m_directSend),
+                   MakeBooleanChecker ())
+      .AddAttribute ("LinkQualityMode", "Source of the PSR of every neighbor in a selection window: probe trains, the analytical channel model, or probe trains compared with the model through the LinkQualityAgreement trace. ",
+                   EnumValue (LQ_PROBE),
+                   MakeEnumAccessor (&AquaSimCarp::m_lqMode),
+                   MakeEnumChecker (LQ_PROBE, "Probe",
+                                    LQ_ANALYTIC, "Analytic",
+                                    LQ_VALIDATE, "Validate"))
+      .AddAttribute ("AnalyticFrequency", "Carrier frequency of the analytical PSR model (kHz). ",
+                   DoubleValue (25),
+                   MakeDoubleAccessor (&AquaSimCarp::m_analyticFrequency),
+                   MakeDoubleChecker<double> (0.1))
+      .AddAttribute ("AnalyticBandwidth", "Bandwidth of the analytical PSR model (kHz). ",
+                   DoubleValue (4),
+                   MakeDoubleAccessor (&AquaSimCarp::m_analyticBandwidth),
+                   MakeDoubleChecker<double> (0.001))
+      .AddAttribute ("AnalyticSourceLevel", "Source level of the analytical PSR model (dB re 1 uPa at 1 m). ",
+                   DoubleValue (120),
+                   MakeDoubleAccessor (&AquaSimCarp::m_analyticSourceLevel),
+                   MakeDoubleChecker<double> ())
+      .AddAttribute ("AnalyticShipping", "Shipping activity of the Wenz noise of the analytical PSR model, between 0 and 1. ",
+                   DoubleValue (0.5),
+                   MakeDoubleAccessor (&AquaSimCarp::m_analyticShipping),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+      .AddAttribute ("AnalyticWindSpeed", "Wind speed of the Wenz noise of the analytical PSR model (m/s). ",
+                   DoubleValue (0),
+                   MakeDoubleAccessor (&AquaSimCarp::m_analyticWind),
+                   MakeDoubleChecker<double> (0.0))
+      .AddAttribute ("AnalyticPacketSize", "Packet size the analytical PSR is computed for (bytes). ",
+                   UintegerValue (100),
+                   MakeUintegerAccessor (&AquaSimCarp::m_analyticPacketSize),
+                   MakeUintegerChecker<uint32_t> (1))
+      .AddTraceSource ("LinkQualityAgreement", "A selection window closed in Validate mode, with the relay chosen from the probes and the one the analytical model would have chosen. ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_lqAgreementTrace),
+                   "ns3::AquaSimCarp::LinkQualityAgreementCallback")
+      .AddAttribute ("MacFeedback", "Feed the transmit outcome of every unicast MAC exchange into the link quality estimate of its next hop. Needs a MAC with a TxOutcome trace source, such as AquaSimLiteMac; the Aqua-Sim MACs (SFama, ...) have none and only log a warning. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AquaSimCarp::m_macFeedback),
+                   MakeBooleanChecker ())
+      .AddAttribute ("MacFeedbackWeight", "Weight of a single MAC outcome in the link quality estimate. ",
+                   DoubleValue (0.1),
+                   MakeDoubleAccessor (&AquaSimCarp::m_macFeedbackWeight),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+      .AddAttribute ("CongestionThreshold", "Number of frames waiting at a node or further down its path above which the path counts as congested. ",
+                   UintegerValue (8),
+                   MakeUintegerAccessor (&AquaSimCarp::m_congestionThreshold),
+                   MakeUintegerChecker<uint32_t> (1, 255))
+      .AddTraceSource ("Congestion", "The path from this node towards the sink became congested or recovered. ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_congestionTrace),
+                   "ns3::AquaSimCarp::CongestionCallback")
+      .AddTraceSource ("PacketEvent", "A CARP frame was sent, received, delivered or dropped, as a binary trace record. ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_packetTrace),
+                   "ns3::AquaSimCarp::PacketEventCallback")
+      .AddTraceSource ("Delivery", "A data packet reached its destination, with its end-to-end delay (negative if unknown) and hop count. ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_deliveryTrace),
+                   "ns3::AquaSimCarp::DeliveryCallback")
+      .AddAttribute ("MaxNeighbors", "Bound of the neighbor table and of the tables derived from it. Once full, a new neighbor evicts the one furthest from the sink if it is closer. Zero leaves it unbounded. ",
+                   UintegerValue (256),
+                   MakeUintegerAccessor (&AquaSimCarp::SetMaxNeighbors, &AquaSimCarp::GetMaxNeighbors),
+                   MakeUintegerChecker<uint32_t> ())
+      .AddAttribute ("MaxUnacked", "Frames kept per relay while waiting for their hop-by-hop ACK. The oldest is dropped when a frame is sent to a relay already holding that many. ",
+                   UintegerValue (64),
+                   MakeUintegerAccessor (&AquaSimCarp::m_maxUnacked),
+                   MakeUintegerChecker<uint32_t> (1))
+      .AddAttribute ("MemoryInterval", "Period of the MemoryUsage trace. Zero disables it. ",
+                   TimeValue (Seconds (0.0)),
+                   MakeTimeAccessor (&AquaSimCarp::m_memoryInterval),
+                   MakeTimeChecker ())
+      .AddTraceSource ("MemoryUsage", "Approximate bytes held by each per-node structure, every MemoryInterval. ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_memoryTrace),
+                   "ns3::AquaSimCarp::MemoryUsageCallback")
+      .AddTraceSource ("RecvInput", "A packet was handed to Recv, before CARP looked at it. The packets unpacked from a super-frame are not reported again. ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_recvInputTrace),
+                   "ns3::AquaSimCarp::RecvInputCallback")
+      .AddAttribute ("WarmStart", "Snapshot written by AquaSimCarp::SaveSnapshot to load the neighbor and link quality tables from, skipping discovery. Empty runs discovery. ",
+                   StringValue (""),
+                   MakeStringAccessor (&AquaSimCarp::m_warmStart),
+                   MakeStringChecker ())
+#ifdef CARP_PROFILE
+      .AddAttribute ("ProfileTimers", "Time every profiled handler in addition to counting its calls. ",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&AquaSimCarp::m_profileTimers),
+                   MakeBooleanChecker ())
+      .AddTraceSource ("HandlerProfile", "A profiled handler returned, with the ticks it took (zero unless ProfileTimers is set). ",
+                   MakeTraceSourceAccessor (&AquaSimCarp::m_handlerTrace),
+                   "ns3::AquaSimCarp::HandlerProfileCallback")
+#endif
+      ;
   return tid;
 }
 
-/* To generate HELLO broadcast by the sink and other sensor nodes
+/* To broadcast the hop count of this node from the sink, 0 at the sink
  * Param:  void
  * Return: void
  *  */
 void
-AquaSimCarp::SendHello(Ptr<Packet> p)
+AquaSimCarp::SendHello()
 {
-	// Ptr<Packet> p = Create<Packet>();	
+	Ptr<Packet> p = Create<Packet>();
 	AquaSimHeader ash;
 	HelloHeader hh;
-	uint16_t hopCount = ash.GetNumForwards(); // This might need to be stored and mapped with the neighbors data
-	hh.SetHopCount(hopCount);  // Assumes the initial hop count of the sink is 0
-	sAddr = RaAddr();
-	hh.SetSAddr(sAddr);
+	hh.SetHopCount(m_sink ? 0 : m_core.GetHopCount());
+	hh.SetSAddr(RaAddr());
+	hh.SetDAddr(AquaSimAddress::GetBroadcast());
 	
-	ash.SetNumForwards(ash.GetNumForwards() + 1);
+	ash.SetSAddr(RaAddr());
+	ash.SetDAddr(AquaSimAddress::GetBroadcast());
+	ash.SetNumForwards(1);
 	ash.SetNextHop(AquaSimAddress::GetBroadcast()); // This is used to broadcast the packet to all neighbors
+	ash.SetDirection(AquaSimHeader::DOWN);
 	p->AddHeader(hh);
 	p->AddHeader(ash);
-	Simulator::Schedule(Seconds(0.0),&AquaSimRouting::SendDown,this,p,AquaSimAddress::GetBroadcast(),Seconds(0.0));
-		
+	TraceRecord(CARP_TRACE_TX, CARP_TRACE_HELLO, p->GetSize(), p->GetUid(), ash);
+	SendFrame(p, AquaSimAddress::GetBroadcast());
 }
 
 /* To receive HELLO packet and update hop count information 
+ * A node passes the HELLO flood on, with its own hop count, only when the HELLO shortened its path to the sink,
+ * and selects its relay HelloTime after that
  * Param:  Ptr<Packet> p (A pointer to a packet class p)
  * Return: void
  * */
 void 
 AquaSimCarp::RecvHello(Ptr<Packet> p)
 {
-	if(p)
+	CARP_PROFILE_SCOPE(CARP_H_RECV_HELLO);
+	AquaSimHeader ash;
+	HelloHeader hh;
+	p->RemoveHeader(ash);
+	p->RemoveHeader(hh);
+	if (m_sink)
 	{
-		AquaSimHeader ash;
-		HelloHeader hh;
-		p->RemoveHeader(ash);
-		p->RemoveHeader(hh);
-		uint16_t numForwards = ash.GetNumForwards();
-		hh.SetHopCount(numForwards);
-		AquaSimAddress temp = hh.GetSAddr(); // Neighbor of the receiving node
-		/* Two key things are required
-		 * 1. The need to obtain the AquaSimNetDevice of the current node with the packet
-		 * 2. The node id of the current node
-		 *  */
-		Address pktNodeAddr = GetNetDevice()->GetAddress();
-		//m_nodeNeighbor[pktNodeAddr].m_neighborAddress.push_back(temp); // This maps the sender address and updates the neighbors vector holding the neighbor address of the interface
-	    uint16_t tempHopCount = numForwards;
-		
-		// HopCount check to store the least hop count of the node from the sink
-	    if ( m_nodeNeighbor[pktNodeAddr].m_neighbor[temp])
-	    {
-			if (tempHopCount < m_nodeNeighbor[pktNodeAddr].m_neighbor[temp])
-			{
-				m_nodeNeighbor[pktNodeAddr].m_neighbor[temp] = tempHopCount;
-			}
-		}
-		else
+		return; // The hop count of a sink is 0 whatever it hears
+	}
+	uint8_t hopCount = m_core.GetHopCount();
+	AddNeighbor(hh.GetSAddr(), hh.GetHopCount());
+	if (m_core.GetHopCount() != hopCount)
+	{
+		Time jitter = Seconds(m_rand->GetValue()*0.5);
+		Simulator::Schedule(jitter, &AquaSimCarp::SendHello, this);
+		if (!m_windowEvent.IsRunning())
 		{
-				m_nodeNeighbor[pktNodeAddr].m_neighbor.insert({temp, numForwards});
+			m_windowEvent = Simulator::Schedule(hello_time, &AquaSimCarp::ProcessHello, this);
 		}
-		ash.SetNumForwards(numForwards + 1);
-		ash.SetNextHop(AquaSimAddress::GetBroadcast());
-		p->AddHeader(hh);
-		p->AddHeader(ash);
-		Simulator::Schedule(Seconds(0.0),&AquaSimRouting::SendDown,this,p,ash.GetNextHop(),Seconds(0.0));
-		// SendHello(); Confirm if this method is needed
 	}
 }
 
-Time initial_time = Simulator::Now();
-/* Introduction of a timer for the HELLO broadcast 
+/* To enter a neighbor heard through a HELLO or a PONG in the neighbor table
+ * Param:  AquaSimAddress neighbor, uint16_t hopCount (Hop count of the neighbor from the sink)
+ * Return: void
+ * */
+void
+AquaSimCarp::AddNeighbor(AquaSimAddress neighbor, uint16_t hopCount)
+{
+	// The core keeps the hop count of this node through the neighbor, and the least one of them as its own
+	m_core.RecvHello(neighbor.GetAsInt(), hopCount + 1);
+	if (m_lqMode == LQ_VALIDATE)
+	{
+		m_shadow.RecvHello(neighbor.GetAsInt(), hopCount + 1);
+	}
+}
+
+/* To end the HELLO phase of a node and select its relay among the neighbors heard
  * Param:  void
- * Return: bool (true | false)
+ * Return: void
  * */
-bool
+void
 AquaSimCarp::ProcessHello ()
 {
-   Ptr<Packet> p = Create<Packet>();	
-   while(true)
-   {
-		SendHello(p);
-		RecvHello(p);
-			if ((Simulator::Now() - initial_time) > hello_time)
-		{
-			return 1;
-		}
+	if (m_sink)
+	{
+		return;
 	}
+	SetNextHop();
 } 
 
-/* To initiate a PING multicast to neighbors
+/* To start the HELLO flood from a sink, unless its tables come from a snapshot
+ * Param:  void
+ * Return: void
+ * */
+void
+AquaSimCarp::StartDiscovery ()
+{
+	if (LoadSnapshot())
+	{
+		return; // The tables of the snapshot replace the HELLO flood
+	}
+	SendHello();
+}
+
+/* To look for a relay when a data packet has none
+ * The neighbors answer the PING with their hop count and a selection window follows HelloTime later
+ * Param:  void
+ * Return: void
+ * */
+void
+AquaSimCarp::FindRoute ()
+{
+	if (m_sink || m_windowEvent.IsRunning())
+	{
+		return;
+	}
+	SendPing();
+	m_windowEvent = Simulator::Schedule(hello_time, &AquaSimCarp::ProcessHello, this);
+}
+
+/* To broadcast a PING asking the neighbors for their hop count from the sink
  * Param:  void
  * Return: void 
  * */
 void 
 AquaSimCarp::SendPing ()
 {
-  // The CarpHeader would most likely be a struct data type which houses its attributes
+	CARP_PROFILE_SCOPE(CARP_H_SEND_PING);
   Ptr<Packet> p = Create<Packet>();
   AquaSimHeader ash;
   PingHeader ph; // Header for the PING packet
-  ph.SetPktCount(m_numPkt); // Set the number of packets to be sent  
+  ph.SetPktCount(m_core.GetProbeCount()); // Number of probes each neighbor can expect
   ph.SetSAddr(RaAddr());
-  ash.SetSAddr(RaAddr()); // This is used to identify the source node ?
+  ph.SetDAddr(AquaSimAddress::GetBroadcast());
+  ash.SetSAddr(RaAddr());
+  ash.SetDAddr(AquaSimAddress::GetBroadcast());
+  ash.SetNextHop(AquaSimAddress::GetBroadcast());
   ash.SetDirection(AquaSimHeader::DOWN);
-  p->AddHeader(ph);  
-  
-  /* How to obtain the node_Id?
-   * The key of the map should be the node Address and not a pointer
-   * key,value = Address, Neighbor
-   *  */
-  Address pktNodeAddr = GetNetDevice()->GetAddress();
-  
-  // Extract the neighbors of the identified AquaSimNetDevice & iterate through all the neighbors of a node to send the PING packet
-  for (std::map<Address, Neighbor>::iterator iter = m_nodeNeighbor.begin();
-  iter!= m_nodeNeighbor.end(); iter++)
-  {
-	if (iter->first == pktNodeAddr)
-	{
-		for (std::map<AquaSimAddress, uint16_t>::iterator it = iter->second.m_neighbor.begin(); it!= iter->second.m_neighbor.end(); it++)
-		{  
-			ash.SetDAddr(it->first);
-			ash.SetNextHop(it->first);
-			p->AddHeader(ash);
-			Simulator::Schedule(Seconds(0.0),&AquaSimRouting::SendDown,this,p,ash.GetNextHop(),Seconds(0.0));
-	  
-		}
-	}
-  }
-
+  p->AddHeader(ph);
+  p->AddHeader(ash);
+  TraceRecord(CARP_TRACE_TX, CARP_TRACE_PING, p->GetSize(), p->GetUid(), ash);
+  SendFrame(p, AquaSimAddress::GetBroadcast());
 }
 
 /* To receive PING multicast from the sender 
@@ -189,7 +382,10 @@ AquaSimCarp::SendPing ()
 void 
 AquaSimCarp::RecvPing (Ptr<Packet> p)
 {
-	SendPong(p);
+	if (m_sink || m_core.GetHopCount() > 0)
+	{
+		SendPong(p); // Only nodes that know their way to the sink answer
+	}
 }
 
 /* To Forward Data Packet 
@@ -199,51 +395,384 @@ AquaSimCarp::RecvPing (Ptr<Packet> p)
 void 
 AquaSimCarp::ForwardData(Ptr<Packet> p)
 {
+	CARP_PROFILE_SCOPE(CARP_H_FORWARD_DATA);
 	AquaSimHeader ash;
+	CarpHeader crh;
+	p->RemoveHeader(ash);
+	p->PeekHeader(crh);
+	p->AddHeader(ash);
+	if (m_aggregation && crh.GetPacketType() == DATA && ash.GetNextHop() != AquaSimAddress::GetBroadcast())
+	{
+		Aggregate(p, ash.GetNextHop());
+		return;
+	}
+	if (crh.GetPacketType() == DATA)
+	{
+		TrackHopAck(p, ash.GetNextHop());
+	}
+	TracePacket(CARP_TRACE_TX, p, ash, crh);
+	SendFrame(p, ash.GetNextHop());
+}
+
+/* To queue a data packet until a super-frame for its next hop is full or its delay budget runs out
+ * Param:  Ptr<Packet> p, AquaSimAddress nextHop
+ * Return: void
+ * */
+void
+AquaSimCarp::Aggregate(Ptr<Packet> p, AquaSimAddress nextHop)
+{
+	std::map<AquaSimAddress, AggQueue>::iterator it = m_aggQueue.find(nextHop);
+	if (it != m_aggQueue.end() && !it->second.m_pkts.empty() && it->second.m_bytes + p->GetSize() > m_aggSize)
+	{
+		FlushAggregate(nextHop);
+	}
+	AggQueue &q = m_aggQueue[nextHop];
+	q.m_pkts.push_back(p);
+	q.m_bytes += p->GetSize();
+	if (q.m_bytes >= m_aggSize || q.m_pkts.size() == UINT8_MAX)
+	{
+		FlushAggregate(nextHop);
+	}
+	else if (!q.m_timer.IsRunning())
+	{
+		q.m_timer = Simulator::Schedule(m_aggDelay, &AquaSimCarp::FlushAggregate, this, nextHop);
+	}
+}
+
+/* To send the packets queued for a next hop, packed into one super-frame when there are several
+ * The queue of the next hop is removed once sent, so that only next hops with packets waiting hold one
+ * Param:  AquaSimAddress nextHop
+ * Return: void
+ * */
+void
+AquaSimCarp::FlushAggregate(AquaSimAddress nextHop)
+{
+	std::map<AquaSimAddress, AggQueue>::iterator qi = m_aggQueue.find(nextHop);
+	if (qi == m_aggQueue.end())
+	{
+		return;
+	}
+	AggQueue &q = qi->second;
+	q.m_timer.Cancel();
+	if (q.m_pkts.empty())
+	{
+		m_aggQueue.erase(qi);
+		return;
+	}
+	
+	Ptr<Packet> p;
+	AquaSimHeader ash;
+	CarpHeader crh;
+	if (q.m_pkts.size() == 1)
+	{
+		p = q.m_pkts.front();
+		p->RemoveHeader(ash);
+		p->PeekHeader(crh);
+		p->AddHeader(ash);
+	}
+	else
+	{
+		CarpAggHeader agh;
+		p = Create<Packet>();
+		for (std::vector<Ptr<Packet> >::iterator it = q.m_pkts.begin(); it != q.m_pkts.end(); it++)
+		{
+			agh.AddPacket((*it)->GetSize());
+			p->AddAtEnd(*it);
+		}
+		crh.SetPacketType(AGG);
+		crh.SetSAddr(RaAddr());
+		crh.SetDAddr(nextHop);
+		crh.SetPktCount(q.m_pkts.size());
+		ash.SetSAddr(RaAddr());
+		ash.SetDAddr(nextHop);
+		ash.SetNextHop(nextHop);
+		ash.SetDirection(AquaSimHeader::DOWN);
+		p->AddHeader(agh);
+		p->AddHeader(crh);
+		p->AddHeader(ash);
+	}
+	m_aggQueue.erase(qi);
+	TrackHopAck(p, nextHop);
+	TracePacket(CARP_TRACE_TX, p, ash, crh);
+	SendFrame(p, nextHop);
+}
+
+/* To unpack a super-frame and process each of its packets as if it was received on its own
+ * Param:  Ptr<Packet> p (Super-frame with the AquaSimHeader and CarpHeader removed)
+ *         const Address &dest, uint16_t protocolNumber
+ * Return: void
+ * */
+void
+AquaSimCarp::RecvAggregate(Ptr<Packet> p, const Address &dest, uint16_t protocolNumber)
+{
+	CarpAggHeader agh;
+	p->RemoveHeader(agh);
+	uint32_t offset = 0;
+	for (uint8_t i = 0; i < agh.GetNumPackets(); i++)
+	{
+		uint16_t len = agh.GetLength(i);
+		if (offset + len > p->GetSize())
+		{
+			CARP_LOG_INFO("RecvAggregate: truncated super-frame, dropping the remainder");
+			break;
+		}
+		// The super-frame reached this node, so each packet in it did as well
+		Ptr<Packet> pkt = p->CreateFragment(offset, len);
+		AquaSimHeader ash;
+		pkt->RemoveHeader(ash);
+		ash.SetNextHop(RaAddr());
+		pkt->AddHeader(ash);
+		m_inAggregate = true;
+		Recv(pkt, dest, protocolNumber);
+		m_inAggregate = false;
+		offset += len;
+	}
+}
+
+/* To acknowledge a data frame to the relay that transmitted it
+ * Param:  AquaSimAddress prevHop, uint32_t uid (Uid of the frame acknowledged)
+ * Return: void
+ * */
+void
+AquaSimCarp::SendDataAck(AquaSimAddress prevHop, uint32_t uid)
+{
+	Ptr<Packet> p = MakeACK(prevHop);
+	AquaSimHeader ash;
+	CarpHeader crh;
+	CarpAckHeader ach;
 	p->RemoveHeader(ash);
+	p->RemoveHeader(crh);
+	crh.SetPacketType(DATA_ACK);
+	crh.SetQueue(GetCongestionLevel()); // Carried back so that congestion propagates towards the sources
+	ach.SetUid(uid);
+	p->AddHeader(ach);
+	p->AddHeader(crh);
 	p->AddHeader(ash);
-	Simulator::Schedule(Seconds(0.0),&AquaSimRouting::SendDown,this,p,ash.GetNextHop(),Seconds(0.0));
+	TracePacket(CARP_TRACE_TX, p, ash, crh);
+	SendFrame(p, prevHop);
 }
 
-/* To send a PONG unicast to sender node
+/* To keep a copy of a data frame until the relay acknowledges it
+ * Only frames sent to a neighbor of the table are kept, not those that went to the next hop of the upper layer
+ * Param:  Ptr<Packet> p, AquaSimAddress nextHop
+ * Return: void
+ * */
+void
+AquaSimCarp::TrackHopAck(Ptr<Packet> p, AquaSimAddress nextHop)
+{
+	if (!m_hopAckTimeout.IsStrictlyPositive() || !m_core.GetNeighbors().count(nextHop.GetAsInt()))
+	{
+		return;
+	}
+	HopAckState &st = m_hopAck[nextHop];
+	if (st.m_unacked.size() >= m_maxUnacked)
+	{
+		Ptr<Packet> oldest = st.m_unacked.front();
+		st.m_unacked.pop_front();
+		AquaSimHeader ash;
+		CarpHeader crh;
+		oldest->RemoveHeader(ash);
+		oldest->PeekHeader(crh);
+		CARP_LOG_INFO("TrackHopAck: " << m_maxUnacked << " frames wait for " << nextHop << ", dropping packet=" << oldest);
+		TracePacket(CARP_TRACE_DROP, oldest, ash, crh);
+	}
+	st.m_unacked.push_back(p->Copy());
+	if (!st.m_timer.IsRunning())
+	{
+		st.m_timer = Simulator::Schedule(m_hopAckTimeout, &AquaSimCarp::HopAckTimeout, this, nextHop);
+	}
+	UpdateCongestion();
+}
+
+/* To compute the congestion level of the path from this node towards the sink
+ * The level is the larger of the frames waiting here and the level reported by the relay. Frames waiting for
+ * a relay that has left the neighbor table do not count.
+ * Param:  void
+ * Return: uint8_t
+ * */
+uint8_t
+AquaSimCarp::GetCongestionLevel()
+{
+	uint32_t backlog = 0;
+	for (std::map<AquaSimAddress, AggQueue>::iterator it = m_aggQueue.begin(); it != m_aggQueue.end(); it++)
+	{
+		backlog += it->second.m_pkts.size();
+	}
+	const std::map<CarpAddr, uint16_t> &neighbors = m_core.GetNeighbors();
+	for (std::map<AquaSimAddress, HopAckState>::iterator it = m_hopAck.begin(); it != m_hopAck.end(); it++)
+	{
+		if (neighbors.count(it->first.GetAsInt()))
+		{
+			backlog += it->second.m_unacked.size();
+		}
+	}
+	return std::min<uint32_t>(std::max<uint32_t>(backlog, m_downstreamLevel), UINT8_MAX);
+}
+
+/* To report a change of the congestion state to the sources listening on this node
+ * Param:  void
+ * Return: void
+ * */
+void
+AquaSimCarp::UpdateCongestion()
+{
+	uint8_t level = GetCongestionLevel();
+	bool congested = (level >= m_congestionThreshold);
+	if (congested != m_congested)
+	{
+		m_congested = congested;
+		m_congestionTrace(congested, level);
+	}
+}
+
+/* To release the frame acknowledged by the relay and take over its congestion level
+ * ACKs of frames no longer waiting, such as those already rerouted, are ignored
+ * Param:  AquaSimAddress relay, uint8_t level (Congestion level carried by the ACK), uint32_t uid
+ * Return: void
+ * */
+void
+AquaSimCarp::RecvDataAck(AquaSimAddress relay, uint8_t level, uint32_t uid)
+{
+	std::map<AquaSimAddress, HopAckState>::iterator it = m_hopAck.find(relay);
+	if (it == m_hopAck.end())
+	{
+		return;
+	}
+	HopAckState &st = it->second;
+	std::deque<Ptr<Packet> >::iterator frame = st.m_unacked.begin();
+	while (frame != st.m_unacked.end() && (uint32_t) (*frame)->GetUid() != uid)
+	{
+		frame++;
+	}
+	if (frame == st.m_unacked.end())
+	{
+		return;
+	}
+	m_downstreamLevel = level;
+	st.m_unacked.erase(frame);
+	st.m_timer.Cancel();
+	if (!st.m_unacked.empty())
+	{
+		st.m_timer = Simulator::Schedule(m_hopAckTimeout, &AquaSimCarp::HopAckTimeout, this, relay);
+	}
+	else
+	{
+		m_hopAck.erase(it);
+	}
+	UpdateCongestion();
+}
+
+/* To react to a relay that left a data frame unacknowledged
+ * Param:  AquaSimAddress relay
+ * Return: void
+ * */
+void
+AquaSimCarp::HopAckTimeout(AquaSimAddress relay)
+{
+	CARP_LOG_INFO("HopAckTimeout: relay " << relay << " did not acknowledge, rerouting");
+	Reroute(relay);
+}
+
+/* To react to a transmit failure reported by the MAC for a unicast frame
+ * Param:  AquaSimAddress nextHop
+ * Return: void
+ * */
+void
+AquaSimCarp::NotifyTxFailure(AquaSimAddress nextHop)
+{
+	if (nextHop == GetNextHop() || m_hopAck.count(nextHop))
+	{
+		Reroute(nextHop);
+	}
+}
+
+/* To switch forwarding from a failed relay to the runner-up of the last selection window
+ * Frames still waiting for the failed relay are retransmitted at once and a new selection window is opened in the background
+ * Param:  AquaSimAddress failed
+ * Return: void
+ * */
+void
+AquaSimCarp::Reroute(AquaSimAddress failed)
+{
+	m_core.Reroute(failed.GetAsInt());
+	m_rerouteTrace(failed, GetNextHop());
+	if (CarpEventRing::IsEnabled())
+	{
+		TraceRouting(CARP_DIAG_REROUTE, failed, GetNextHop(), 0);
+	}
+	
+	std::deque<Ptr<Packet> > pending;
+	std::map<AquaSimAddress, HopAckState>::iterator st = m_hopAck.find(failed);
+	if (st != m_hopAck.end())
+	{
+		st->second.m_timer.Cancel();
+		pending.swap(st->second.m_unacked);
+		m_hopAck.erase(st);
+	}
+	for (std::deque<Ptr<Packet> >::iterator it = pending.begin(); it != pending.end(); it++)
+	{
+		Ptr<Packet> p = *it;
+		AquaSimHeader ash;
+		CarpHeader crh;
+		p->RemoveHeader(ash);
+		p->PeekHeader(crh);
+		AquaSimAddress nextHop = SelectRelay(p->GetSize() + ash.GetSerializedSize());
+		if (nextHop == failed || nextHop == AquaSimAddress())
+		{
+			CARP_LOG_INFO("Reroute: no backup relay, dropping packet=" << p);
+			TracePacket(CARP_TRACE_DROP, p, ash, crh);
+			continue;
+		}
+		ash.SetNextHop(nextHop);
+		p->AddHeader(ash);
+		TrackHopAck(p, nextHop);
+		TracePacket(CARP_TRACE_TX, p, ash, crh);
+		SendFrame(p, nextHop);
+	}
+	m_downstreamLevel = 0; // Nothing is known yet about the path behind the new relay
+	UpdateCongestion();
+	// The window measures the neighbors anew, unless one is already under way; a node left without any relay asks with FindRoute
+	if (!m_windowEvent.IsRunning())
+	{
+		m_windowEvent = Simulator::ScheduleNow(&AquaSimCarp::SetNextHop, this);
+	}
+}
+
+/* To send a PONG unicast to sender node, carrying the hop count of this node
  * Param:  Ptr<Packet> p
  * Return: void
  * */
 void
 AquaSimCarp::SendPong(Ptr<Packet> p)
 {
+	CARP_PROFILE_SCOPE(CARP_H_SEND_PONG);
   AquaSimHeader ash;
   PingHeader ph; // This is the header used to encapsulate the PING packet
   PongHeader poh;	// Header for PONG packets. This header inherits some of the base CarpHeader methods
-  // Ipv4Header iph; // The CARP header is built on top of the Ipv4Header
   
   p->RemoveHeader(ash);
   p->RemoveHeader(ph);
   
   AquaSimAddress dest_addr = ph.GetSAddr();
+  Ptr<Packet> pong = Create<Packet>();
 
-	// Used to set attributes of the PONG packet
-	p->AddHeader(ash);
-	// poh.SetHopCount(p); // This is used if lq_y,z which is the best possible node of the neighbor were to be computed
-	p->RemoveHeader(ash);
 	poh.SetSAddr(RaAddr());  // Set the source of the packet
-	
-	// This process might be skipped because of the complexity
-	// poh.SetLinkQuality(Ptr<Neighbor> neig) // Computes the values of lq to all nodes using the position vector (Args: NetDevice, Nodes, Neighbors)
-	
-	poh.SetQueue(m_queue); // Indicates the available buffer space at the sender (This could be symmetric across all nodes)
-	poh.SetEnergy(m_energy);
+	poh.SetHopCount(m_sink ? 0 : m_core.GetHopCount());
+	// Buffer space is not modelled
+	poh.SetQueue(0);
 	poh.SetDAddr(dest_addr);
 	
 	ash.SetSAddr(RaAddr());
 	ash.SetDAddr(dest_addr); // This should be sent to the sender of the PING instead of broadcast 
-	// ash.SetDirection(AquaSimHeader::DOWN);
+	ash.SetNumForwards(1);
+	ash.SetDirection(AquaSimHeader::DOWN);
 	ash.SetNextHop(dest_addr); // The one hop destination is set as the next hop
   
-  p->AddHeader(poh);
-  p->AddHeader(ash);
+  pong->AddHeader(poh);
+  pong->AddHeader(ash);
+  TraceRecord(CARP_TRACE_TX, CARP_TRACE_PONG, pong->GetSize(), pong->GetUid(), ash);
   Time jitter = Seconds(m_rand->GetValue()*0.5);
-  Simulator::Schedule(jitter,&AquaSimRouting::SendDown,this,p,dest_addr,jitter);
+  Simulator::Schedule(jitter,&AquaSimRouting::SendDown,this,pong,dest_addr,jitter);
 }
 
 /* To create an ACK 
@@ -274,14 +803,14 @@ AquaSimCarp::MakeACK(AquaSimAddress DataSender)
 void
 AquaSimCarp::SendACK(Ptr<Packet> p)
 {
-	CarpHeader crh;
 	AquaSimHeader ash;
-	p->RemoveHeader(ash);
-	p->AddHeader(crh);
-	AquaSimAddress DataSender = crh.GetSAddr();
-	p->AddHeader(crh);
-	p->AddHeader(ash);
-	SendPacket(MakeACK(DataSender)); // Check this method and reference the ALOHA sent by Dmitrii
+	p->PeekHeader(ash);
+	AquaSimAddress DataSender = ash.GetSAddr(); // The node running the selection window
+	Ptr<Packet> ack = MakeACK(DataSender);
+	AquaSimHeader ackAsh;
+	ack->PeekHeader(ackAsh);
+	TraceRecord(CARP_TRACE_TX, ACK, ack->GetSize(), ack->GetUid(), ackAsh);
+	SendFrame(ack, DataSender);
 	p =0;
 }
 
@@ -311,6 +840,7 @@ AquaSimCarp::RecvTrain(Ptr<Packet> p)
 void
 AquaSimCarp::RecvAck(Ptr<Packet> p)
 {
+	CARP_PROFILE_SCOPE(CARP_H_RECV_ACK);
 	AquaSimHeader ash;
 	CarpHeader crh;
 	p->RemoveHeader(ash);
@@ -318,119 +848,415 @@ AquaSimCarp::RecvAck(Ptr<Packet> p)
 	AquaSimAddress neighbor = ash.GetSAddr();
 	if(crh.GetPacketType() == 0)
 	{
-		for (std::map<AquaSimAddress, int>::iterator it = pCount.begin(); it!= pCount.end(); it++)
-		{
-			if(it->first == neighbor)
-			{
-				it->second = it->second + 1;
-			}
-		}
+		m_core.RecvProbeAck(neighbor.GetAsInt());
 	}
 }
 
 /* To select next hop relay node based on the link quality estimat values
- * Param:  AquaSimAddress source, vector<AquaSimAddress> neighbor
+ * Every neighbor closer to the sink is probed with a train of packets, whose ACKs RecvAck counts until EndProbes
+ * closes the window <wait_time> later
+ * Param:  void
  * Return: void
  * */
 void
-AquaSimCarp::SetNextHop(AquaSimAddress src, std::map<AquaSimAddress, uint16_t> nei)
+AquaSimCarp::SetNextHop()
 {
-	
-	Ptr<Packet> p = Create<Packet>();
-	// vector<double_t>max_lq;
-	Time jitter = Seconds(m_rand->GetValue()*0.5);
-	uint16_t numForwards = 1;
-	
-	// Send 4 packets each to all neighbor nodes
-	for (std::map<AquaSimAddress, uint16_t>::iterator it = nei.begin(); it!= nei.end();
-	it++)
-	{
-		pCount.insert(std::pair<AquaSimAddress, int>(it->first,0)); // This map automatically keeps track of the ACKS from the neighbors for PSR estimation
-		for (uint8_t i = 0; i< 4; i++)
-		{
-			AquaSimHeader ash;
-			// PacketType var = PacketType::LQ_DATA;
-			CarpHeader crh;
-			crh.SetPacketType(LQ_DATA);
-			ash.SetNumForwards(numForwards);
-			ash.SetSAddr(src);
-			ash.SetDAddr(it->first);
-			ash.SetNextHop(it->first);
-			p->AddHeader(crh);
-			p->AddHeader(ash);
-			Simulator::Schedule(jitter, &AquaSimRouting::SendDown, this, p, ash.GetNextHop(), jitter);	
-		}
-	}
-	Time now = Simulator::Now();
-	while(true)
+	CARP_PROFILE_SCOPE(CARP_H_SET_NEXT_HOP);
+	if (m_lqMode == LQ_ANALYTIC)
 	{
-		/* Neighbors receiving a train of packets from sender in order to process an ACK */
-		
-		RecvTrain(p);
-		/* For everytime an Ack is received by a neighbor, the counter is increased */
-		RecvAck(p);
-		Time new_time = Simulator::Now();
-		if ( (new_time - now) > wait_time) // This allows the sender wait for the <wait_time> to elapse before selecting the next relay node
-		{
-			break;
-		}
+		EstimateNextHop();
+		return;
 	}
-		int testVal = 0;
-		for (std::map<AquaSimAddress, int>::iterator it = pCount.begin(); it!= pCount.end(); it++)
-		{
-			if(it->second > testVal)
-			{
-				testVal = it->second;
-			}
-		}
-		std::map<AquaSimAddress, int>::iterator valnextHop = pCount.find(testVal);
-		double_t psr = testVal /4;
-		m_linkQuality = psr *alpha;
-		m_nextHop = valnextHop->first;  // This is the selected relay node with maximum lq at time <t>
 	
-		// NS_LOG_INFO("The selected relay node has link quality of: " << m_linkQuality);
+	m_core.StartProbes(); // Sends the probe train to the neighbors through SendProbe
+	m_windowEvent = Simulator::Schedule(wait_time, &AquaSimCarp::EndProbes, this);
 }
 
-/* To retrieve the address of the relay node
+/* To close the selection window opened by SetNextHop
+ * The PSR of every neighbor over the window is folded into its link quality estimate
  * Param:  void
- * Return: AqauSimAddress
- *  */
-AquaSimAddress
-AquaSimCarp::GetNextHop()
-{
-	return m_nextHop;
-}
-
-/* To receive PONG unicast from the neighbors
- * Param:  Ptr<Packet> p
  * Return: void
- *  */
+ * */
 void
-AquaSimCarp::RecvPong(Ptr<Packet> p)
+AquaSimCarp::EndProbes()
 {
-	// The node with the maximum lq is selected as the relay node which is used as the DAddr() 
+	m_core.EndProbes();
+	if (m_lqMode == LQ_VALIDATE)
+	{
+		m_shadow.SetMaxNeighbors(m_core.GetMaxNeighbors());
+		m_shadow.EndWindow(GetExpectedPsr());
+		m_lqAgreementTrace(GetNextHop(), AquaSimAddress(m_shadow.GetNextHop()));
+	}
+		
+	CARP_LOG_INFO("The selected relay node has link quality of: " << m_core.GetLinkQuality());
+	if (CarpEventRing::IsEnabled())
+	{
+		TraceRouting(CARP_DIAG_NEXT_HOP, AquaSimAddress(), GetNextHop(), m_core.GetLinkQuality() * 100);
+	}
+}
+
+/* To send the probe train of the selection window to a neighbor
+ * Param:  CarpAddr neighbor, uint8_t frames
+ * Return: void
+ * */
+void
+AquaSimCarp::SendProbe(CarpAddr neighbor, uint8_t frames)
+{
+	Time jitter = Seconds(m_rand->GetValue()*0.5);
+	uint16_t numForwards = 1;
+	for (uint8_t i = 0; i< frames; i++)
+	{
+		Ptr<Packet> p = Create<Packet>();
+		AquaSimHeader ash;
+		CarpHeader crh;
+		crh.SetPacketType(LQ_DATA);
+		crh.SetSAddr(RaAddr());
+		crh.SetDAddr(AquaSimAddress(neighbor));
+		crh.SetPktCount(frames);
+		ash.SetNumForwards(numForwards);
+		ash.SetSAddr(RaAddr());
+		ash.SetDAddr(AquaSimAddress(neighbor));
+		ash.SetNextHop(AquaSimAddress(neighbor));
+		ash.SetDirection(AquaSimHeader::DOWN);
+		p->AddHeader(crh);
+		p->AddHeader(ash);
+		TracePacket(CARP_TRACE_TX, p, ash, crh);
+		Simulator::Schedule(jitter, &AquaSimRouting::SendDown, this, p, ash.GetNextHop(), jitter);	
+	}
+}
+
+/* To give the core the simulation time
+ * Param:  void
+ * Return: int64_t (Time in ns)
+ * */
+int64_t
+AquaSimCarp::GetTime()
+{
+	return Simulator::Now().GetNanoSeconds();
+}
+
+/* To subscribe to the transmit outcomes of the MAC below this node
+ * Param:  void
+ * Return: void
+ * */
+void
+AquaSimCarp::ConnectMacFeedback()
+{
+	m_macFeedbackConnected = true;
+	Ptr<AquaSimMac> mac = GetNetDevice()->GetMac();
+	if (!mac || !mac->TraceConnectWithoutContext("TxOutcome", MakeCallback(&AquaSimCarp::NotifyMacTx, this)))
+	{
+		CARP_LOG_WARN("AquaSimCarp: MAC of " << RaAddr() << " has no TxOutcome trace source, MAC feedback is disabled");
+	}
+}
+
+/* To use the outcome of a unicast MAC exchange as a free link quality sample
+ * Outcomes for a next hop that is not a neighbor, such as the sink addressed by the upper layer, are ignored
+ * Param:  AquaSimAddress dst (Next hop of the frame), bool success
+ * Return: void
+ * */
+void
+AquaSimCarp::NotifyMacTx(AquaSimAddress dst, bool success)
+{
+	if (!m_macFeedback || dst == AquaSimAddress::GetBroadcast() || !m_core.GetNeighbors().count(dst.GetAsInt()))
+	{
+		return;
+	}
+	CarpRecvScope macScope(m_recvDepth); // The MAC is still in its trace callback
+	m_core.RecvTxOutcome(dst.GetAsInt(), success, m_macFeedbackWeight);
+	if (!success)
+	{
+		NotifyTxFailure(dst);
+	}
+}
+
+/* Broadcast data frames remembered by every node */
+static const uint32_t g_seenBroadcasts = 64;
+
+/* To remember the broadcast data frames already handled, so that each is relayed and delivered once
+ * Param:  uint64_t uid
+ * Return: bool (true the first time uid is seen)
+ * */
+bool
+AquaSimCarp::IsNewBroadcast(uint64_t uid)
+{
+	if (std::find(m_seenBroadcasts.begin(), m_seenBroadcasts.end(), uid) != m_seenBroadcasts.end())
+	{
+		return false;
+	}
+	m_seenBroadcasts.push_back(uid);
+	if (m_seenBroadcasts.size() > g_seenBroadcasts)
+	{
+		m_seenBroadcasts.pop_front();
+	}
+	return true;
+}
+
+/* To pick the relay for the next data packet
+ * Falls back to the next hop unless multipath is enabled and more than one relay qualifies
+ * Param:  uint32_t pktSize (Size of the packet in bytes, used by the deficit scheduler)
+ * Return: AquaSimAddress
+ * */
+AquaSimAddress
+AquaSimCarp::SelectRelay(uint32_t pktSize)
+{
+	if (m_lqMode == LQ_ANALYTIC && m_core.GetNextHop() == 0 && !m_core.GetNeighbors().empty())
+	{
+		EstimateNextHop(); // Nothing to wait for, the first relay is chosen as soon as one is needed
+	}
+	uint32_t count;
+	AquaSimAddress relay = AquaSimAddress(m_core.SelectRelay(pktSize, &count));
+	if (count > 0)
+	{
+		m_relayTxTrace(relay, count);
+	}
+	return relay;
+}
+
+/* Node id of every AquaSimNetDevice address, built once per simulation */
+static std::map<CarpAddr, uint32_t> g_addressNodes;
+static bool g_addressNodesBuilt = false;
+
+/* To forget the node ids of the simulation being destroyed, so that the next one builds its own
+ * Param:  void
+ * Return: void
+ * */
+static void
+ClearAddressNodes()
+{
+	g_addressNodes.clear();
+	g_addressNodesBuilt = false;
+}
+
+/* To compute the expected PSR of every upstream neighbor from the distance to it and the analytical channel model
+ * Neighbors without a known position, and those the selection would skip anyway, are left out
+ * Param:  void
+ * Return: std::map<CarpAddr, double>
+ * */
+std::map<CarpAddr, double>
+AquaSimCarp::GetExpectedPsr()
+{
+	if (!g_addressNodesBuilt)
+	{
+		for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End(); n++)
+		{
+			for (uint32_t i = 0; i < (*n)->GetNDevices(); i++)
+			{
+				Ptr<AquaSimNetDevice> dev = DynamicCast<AquaSimNetDevice>((*n)->GetDevice(i));
+				if (dev)
+				{
+					g_addressNodes[AquaSimAddress::ConvertFrom(dev->GetAddress()).GetAsInt()] = (*n)->GetId();
+				}
+			}
+		}
+		g_addressNodesBuilt = true;
+		Simulator::ScheduleDestroy(&ClearAddressNodes);
+	}
+
+	CarpPsrModel model;
+	model.SetFrequency(m_analyticFrequency);
+	model.SetBandwidth(m_analyticBandwidth);
+	model.SetSourceLevel(m_analyticSourceLevel);
+	model.SetShipping(m_analyticShipping);
+	model.SetWindSpeed(m_analyticWind);
+	std::map<CarpAddr, double> psr;
+	Ptr<MobilityModel> self = GetNetDevice()->GetNode()->GetObject<MobilityModel>();
+	if (!self)
+	{
+		return psr;
+	}
+	const std::map<CarpAddr, uint16_t> &neighbors = m_core.GetNeighbors();
+	for (std::map<CarpAddr, uint16_t>::const_iterator it = neighbors.begin(); it != neighbors.end(); it++)
+	{
+		if (!m_core.IsUpstream(it->first))
+		{
+			continue;
+		}
+		std::map<CarpAddr, uint32_t>::iterator n = g_addressNodes.find(it->first);
+		Ptr<MobilityModel> other = n != g_addressNodes.end() ? NodeList::GetNode(n->second)->GetObject<MobilityModel>() : 0;
+		if (other)
+		{
+			psr[it->first] = model.GetPsr(self->GetDistanceFrom(other), m_analyticPacketSize);
+		}
+	}
+	return psr;
+}
+
+/* To run a selection window on the expected PSR of every neighbor, without sending probes
+ * Param:  void
+ * Return: void
+ * */
+void
+AquaSimCarp::EstimateNextHop()
+{
+	m_core.EndWindow(GetExpectedPsr());
+	CARP_LOG_INFO("The selected relay node has an expected link quality of: " << m_core.GetLinkQuality());
+	if (CarpEventRing::IsEnabled())
+	{
+		TraceRouting(CARP_DIAG_NEXT_HOP, AquaSimAddress(), GetNextHop(), m_core.GetLinkQuality() * 100);
+	}
+}
+
+/* To retrieve the address of the relay node
+ * Param:  void
+ * Return: AqauSimAddress
+ *  */
+AquaSimAddress
+AquaSimCarp::GetNextHop()
+{
+	return AquaSimAddress(m_core.GetNextHop());
+}
+
+/* To set and get the multipath attributes, which are kept by the core
+ * Param:  The attribute value (setters)
+ * Return: The attribute value (getters)
+ * */
+void
+AquaSimCarp::SetMultipath(bool multipath)
+{
+	m_core.SetMultipath(multipath);
+}
+
+bool
+AquaSimCarp::GetMultipath() const
+{
+	return m_core.GetMultipath();
+}
+
+void
+AquaSimCarp::SetMultipathTolerance(double tolerance)
+{
+	m_core.SetMultipathTolerance(tolerance);
+}
+
+double
+AquaSimCarp::GetMultipathTolerance() const
+{
+	return m_core.GetMultipathTolerance();
+}
+
+void
+AquaSimCarp::SetMultipathScheduler(MultipathScheduler scheduler)
+{
+	m_core.SetScheduler(scheduler == DEFICIT_RR ? CarpCore::DEFICIT_RR : CarpCore::WEIGHTED_RR);
+}
+
+AquaSimCarp::MultipathScheduler
+AquaSimCarp::GetMultipathScheduler() const
+{
+	return m_core.GetScheduler() == CarpCore::DEFICIT_RR ? DEFICIT_RR : WEIGHTED_RR;
+}
+
+void
+AquaSimCarp::SetMaxNeighbors(uint32_t neighbors)
+{
+	m_core.SetMaxNeighbors(neighbors);
+}
+
+uint32_t
+AquaSimCarp::GetMaxNeighbors() const
+{
+	return m_core.GetMaxNeighbors();
+}
+
+void
+AquaSimCarp::SetSink(bool sink)
+{
+	m_sink = sink;
+	m_discoveryEvent.Cancel();
+	if (sink)
+	{
+		m_discoveryEvent = Simulator::ScheduleNow(&AquaSimCarp::StartDiscovery, this);
+	}
+}
+
+bool
+AquaSimCarp::GetSink() const
+{
+	return m_sink;
+}
+
+void
+AquaSimCarp::SetProbeCount(uint8_t frames)
+{
+	m_core.SetProbeCount(frames);
+}
+
+uint8_t
+AquaSimCarp::GetProbeCount() const
+{
+	return m_core.GetProbeCount();
+}
+
+// Heap overhead of a node of a std::map on 64-bit targets
+static const uint64_t g_mapNodeBytes = 32;
+
+/* To estimate the heap bytes held by every per-node structure
+ * Map entries count their key and value plus the node overhead, queued packets their payload plus the Packet object
+ * Param:  void
+ * Return: CarpMemoryUsage
+ * */
+CarpMemoryUsage
+AquaSimCarp::GetMemoryUsage()
+{
+	CarpMemoryUsage u;
+	u.m_node = GetNetDevice()->GetNode()->GetId();
+	u.m_neighbors = m_core.GetNeighbors().size() * (g_mapNodeBytes + sizeof(std::pair<const CarpAddr, uint16_t>))
+	                + m_core.GetNeighborLq().size() * (g_mapNodeBytes + sizeof(std::pair<const CarpAddr, double>));
+	u.m_probes = m_core.GetProbedCount() * (g_mapNodeBytes + sizeof(std::pair<const CarpAddr, int>));
+	u.m_relays = m_core.GetRelaySet().capacity() * sizeof(CarpRelay);
+	u.m_aggregation = 0;
+	for (std::map<AquaSimAddress, AggQueue>::iterator it = m_aggQueue.begin(); it != m_aggQueue.end(); it++)
+	{
+		u.m_aggregation += g_mapNodeBytes + sizeof(std::pair<const AquaSimAddress, AggQueue>)
+		                   + it->second.m_pkts.capacity() * sizeof(Ptr<Packet>);
+		for (std::vector<Ptr<Packet> >::iterator p = it->second.m_pkts.begin(); p != it->second.m_pkts.end(); p++)
+		{
+			u.m_aggregation += sizeof(Packet) + (*p)->GetSize();
+		}
+	}
+	u.m_hopAck = 0;
+	for (std::map<AquaSimAddress, HopAckState>::iterator it = m_hopAck.begin(); it != m_hopAck.end(); it++)
+	{
+		u.m_hopAck += g_mapNodeBytes + sizeof(std::pair<const AquaSimAddress, HopAckState>);
+		for (std::deque<Ptr<Packet> >::iterator p = it->second.m_unacked.begin(); p != it->second.m_unacked.end(); p++)
+		{
+			u.m_hopAck += sizeof(Ptr<Packet>) + sizeof(Packet) + (*p)->GetSize();
+		}
+	}
+	return u;
+}
+
+/* To report the memory held by this node through the MemoryUsage trace source, every MemoryInterval
+ * Param:  void
+ * Return: void
+ * */
+void
+AquaSimCarp::SampleMemory()
+{
+	m_memoryTrace(GetMemoryUsage());
+	m_memoryEvent = Simulator::Schedule(m_memoryInterval, &AquaSimCarp::SampleMemory, this);
+}
+
+/* To receive PONG unicast from the neighbors
+ * A PONG carries the hop count of the neighbor as a HELLO does, the window opened with the PING selects the relay
+ * Param:  Ptr<Packet> p
+ * Return: void
+ *  */
+void
+AquaSimCarp::RecvPong(Ptr<Packet> p)
+{
+	CARP_PROFILE_SCOPE(CARP_H_RECV_PONG);
 	AquaSimHeader ash;
 	PongHeader poh;
 	p->RemoveHeader(ash);
 	p->RemoveHeader(poh);
-	CarpHeader crh;
-	
-	// Obtain the source address of the node via the AquaSimNetDevice interface
-	// Ptr<AquaSimNetDevice> dev = m_device->GetChannel()->GetDevice(m_nodeId);
-	Address pktNodeAddr = GetNetDevice()->GetAddress();
-	AquaSimAddress srcAddr = RaAddr();
-	Neighbor srcNeighbor;
-	srcNeighbor = m_nodeNeighbor[pktNodeAddr]; // Confirm if this process extract the struct Neighbor from the map
-	
-	SetNextHop(srcAddr, srcNeighbor.m_neighbor);
-	AquaSimAddress nextHop = GetNextHop(); // This should return the relay node address
-	crh.SetPacketType(DATA);
-	ash.SetNextHop(nextHop);
-	p->AddHeader(crh);
-	p->AddHeader(ash);
-	  		
-	ForwardData(p); // This module would be worked upon	
+	if (!m_sink)
+	{
+		AddNeighbor(poh.GetSAddr(), poh.GetHopCount());
+	}
 }
+
 /* To assign stream value
  * Param:  int64_t stream (Stream value of 64 bits signed integer type)
  * Return: int64_t
@@ -438,11 +1264,53 @@ AquaSimCarp::RecvPong(Ptr<Packet> p)
 int64_t
 AquaSimCarp::AssignStreams (int64_t stream)
 {
-  // NS_LOG_FUNCTION (this << stream);
+  CARP_LOG_FUNCTION (this << stream);
   m_rand->SetStream(stream);
   return 1;
 }
 
+/* To hand a frame to the MAC
+ * Recv and NotifyMacTx run from the MAC or the upper layer, which must not be re-entered, so the frames
+ * sent from them are queued and sent together by one zero-delay event. Frames sent from timers go down at once, unless
+ * frames are still queued, to keep their order.
+ * Param:  Ptr<Packet> p, AquaSimAddress nextHop
+ * Return: void
+ * */
+void
+AquaSimCarp::SendFrame(Ptr<Packet> p, AquaSimAddress nextHop)
+{
+	if (!m_directSend)
+	{
+		Simulator::Schedule(Seconds(0.0),&AquaSimRouting::SendDown,this,p,nextHop,Seconds(0.0));
+		return;
+	}
+	if (m_recvDepth == 0 && m_pendingFrames.empty())
+	{
+		SendDown(p, nextHop, Seconds(0.0));
+		return;
+	}
+	m_pendingFrames.push_back(std::make_pair(p, nextHop));
+	if (!m_flushEvent.IsRunning())
+	{
+		m_flushEvent = Simulator::ScheduleNow(&AquaSimCarp::FlushFrames, this);
+	}
+}
+
+/* To send the frames queued by SendFrame, in the order they were queued
+ * Param:  void
+ * Return: void
+ * */
+void
+AquaSimCarp::FlushFrames()
+{
+	std::vector<std::pair<Ptr<Packet>, AquaSimAddress> > frames;
+	frames.swap(m_pendingFrames);
+	for (std::vector<std::pair<Ptr<Packet>, AquaSimAddress> >::iterator it = frames.begin(); it != frames.end(); it++)
+	{
+		SendDown(it->first, it->second, Seconds(0.0));
+	}
+}
+
 /* To receive and send packets between layers of the routing protocol stack
  * Param:  Ptr<Packet> p, const Address &dest, uint16_t protocolNumber
  * Return: bool
@@ -450,44 +1318,345 @@ AquaSimCarp::AssignStreams (int64_t stream)
 bool
 AquaSimCarp::Recv(Ptr<Packet> p, const Address &dest, uint16_t protocolNumber)
 {
+	CARP_PROFILE_SCOPE(CARP_H_RECV);
+  CarpRecvScope recvScope(m_recvDepth);
+  if (!m_inAggregate)
+  {
+	// The packets of a super-frame are replayed by unpacking it again
+	m_recvInputTrace(p, dest, protocolNumber);
+  }
   AquaSimHeader ash;
   CarpHeader crh;
 
+  if (m_macFeedback && !m_macFeedbackConnected)
+  {
+	ConnectMacFeedback();
+  }
+  LoadSnapshot();
+  if (m_memoryInterval.IsStrictlyPositive() && !m_memoryEvent.IsRunning())
+  {
+	m_memoryEvent = Simulator::Schedule(m_memoryInterval, &AquaSimCarp::SampleMemory, this);
+  }
   p->RemoveHeader(ash);
-  p->RemoveHeader(crh);
+  if (ash.GetSAddr() == RaAddr() && ash.GetNumForwards() == 0)
+  {
+	// Packets handed down by the upper layer carry no CARP header yet
+	ash.SetDAddr(AquaSimAddress::ConvertFrom(dest));
+	crh.SetPacketType(DATA);
+	crh.SetSAddr(RaAddr());
+	crh.SetDAddr(ash.GetDAddr());
+	CarpTimestampTag tag;
+	tag.SetTimestamp(Simulator::Now());
+	p->AddByteTag(tag);
+	TracePacket(CARP_TRACE_SEND, p, ash, crh);
+  }
+  else
+  {
+	p->RemoveHeader(crh);
+	TracePacket(CARP_TRACE_RX, p, ash, crh);
+  }
   
   AquaSimAddress dst = ash.GetDAddr();
+  // Data frames are acknowledged hop by hop to the relay that transmitted them
+  if (m_hopAckTimeout.IsStrictlyPositive() && !m_inAggregate && ash.GetNextHop() == RaAddr()
+      && (crh.GetPacketType() == DATA || crh.GetPacketType() == AGG))
+  {
+	SendDataAck(crh.GetSAddr(), p->GetUid());
+  }
 	// This checks if the source address equals the nodeID
 	if (ash.GetSAddr() == RaAddr()) {
 		// If there exists a loop, must drop the packet, eliminating loop of infinity
 		if (ash.GetNumForwards() > 0) {
-			// NS_LOG_INFO("Recv: there exists a loop, dropping packet =" << p);
+			CARP_LOG_INFO("Recv: there exists a loop, dropping packet =" << p);
+			TracePacket(CARP_TRACE_DROP, p, ash, crh);
 			p=0;
 			return false;
 		}
 	}
 	else if( ash.GetNextHop() != AquaSimAddress::GetBroadcast() && ash.GetNextHop() != RaAddr() )
    {
-		// NS_LOG_INFO("Recv: duplicate, dropping packet=" << p);
+		CARP_LOG_INFO("Recv: duplicate, dropping packet=" << p);
+		TracePacket(CARP_TRACE_DROP, p, ash, crh);
 		p=0;
 		return false;
 	}
-	else if (dst == GetNetDevice()->GetAddress() && crh.GetPacketType() == 1)
+	else if (crh.GetPacketType() == DATA_ACK)
+	{
+		CarpAckHeader ach;
+		p->RemoveHeader(ach);
+		RecvDataAck(ash.GetSAddr(), crh.GetQueue(), ach.GetUid());
+		return true;
+	}
+	else if (crh.GetPacketType() == AGG)
+	{
+		RecvAggregate(p, dest, protocolNumber);
+		return true;
+	}
+	else if (crh.GetPacketType() != DATA)
 	{
-		// NS_LOG_INFO("AquaSimCarp::Recv address: " << 
-				//	GetNetDevice()->GetAddress() << " packet is delivered ");
+		// Control frames go to their handler with the headers they came with
+		p->AddHeader(crh);
+		p->AddHeader(ash);
+		switch (crh.GetPacketType())
+		{
+		case HELLO:
+			RecvHello(p);
+			break;
+		case PING:
+			RecvPing(p);
+			break;
+		case PONG:
+			RecvPong(p);
+			break;
+		case LQ_DATA:
+			RecvTrain(p);
+			break;
+		case ACK:
+			RecvAck(p);
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+	else if (ash.GetNextHop() == AquaSimAddress::GetBroadcast() && !IsNewBroadcast(p->GetUid()))
+	{
+		CARP_LOG_INFO("Recv: broadcast seen before, dropping packet=" << p);
+		TracePacket(CARP_TRACE_DROP, p, ash, crh);
+		return false;
+	}
+	else if (dst == GetNetDevice()->GetAddress() || m_sink)
+	{
+		// Every sink collects the data, whichever one the source addressed
+		CARP_LOG_INFO("AquaSimCarp::Recv address: " <<
+					GetNetDevice()->GetAddress() << " packet is delivered ");
+		TracePacket(CARP_TRACE_DELIVER, p, ash, crh);
+		CarpTimestampTag tag;
+		Time delay = p->FindFirstMatchingByteTag(tag) ? Simulator::Now() - tag.GetTimestamp() : Seconds(-1.0);
+		m_deliveryTrace(ash.GetSAddr(), ash.GetDAddr(), p->GetSize(), delay, std::min<uint32_t>(ash.GetNumForwards(), UINT8_MAX));
 		p->AddHeader(ash);
 		SendUp(p); // Sends the packet up the application layer
 		return true;
 	}
+	else if (ash.GetNextHop() == AquaSimAddress::GetBroadcast()
+	         && (m_core.GetHopCount() == 0 || m_core.GetHopCount() >= crh.GetHopCount()))
+	{
+		// A broadcast data frame is relayed only by the nodes closer to the sink than its last transmitter
+		TracePacket(CARP_TRACE_DROP, p, ash, crh);
+		return false;
+	}
   uint16_t numForward = ash.GetNumForwards() + 1;
   ash.SetNumForwards(numForward);
+  if (crh.GetPacketType() == DATA)
+  {
+	AquaSimAddress relay = SelectRelay(p->GetSize());
+	if (relay != AquaSimAddress())
+	{
+		ash.SetNextHop(relay);
+	}
+	else
+	{
+		// Without a relay the incoming next hop is kept if it names another node, else the frame is broadcast
+		if (ash.GetNextHop() == RaAddr() || ash.GetNextHop() == AquaSimAddress())
+		{
+			ash.SetNextHop(AquaSimAddress::GetBroadcast());
+		}
+		FindRoute();
+	}
+	crh.SetSAddr(RaAddr()); // The CARP source of a data frame is its last transmitter
+	crh.SetHopCount(m_core.GetHopCount() > 0 ? m_core.GetHopCount() : UINT8_MAX);
+  }
   p->AddHeader(crh);
   p->AddHeader(ash);
   ForwardData(p);
   return true;
 }
 
+/* To report a packet event through the PacketEvent trace source
+ * Param:  uint8_t event (CarpTraceEvent), uint8_t type (PckType or CarpTraceControlType),
+ *         uint32_t size (Size of the whole frame), uint64_t uid, AquaSimHeader &ash
+ * Return: void
+ * */
+void
+AquaSimCarp::TraceRecord(uint8_t event, uint8_t type, uint32_t size, uint64_t uid, AquaSimHeader &ash)
+{
+	CarpTraceRecord r;
+	r.m_time = Simulator::Now().GetNanoSeconds();
+	r.m_uid = uid;
+	r.m_node = GetNetDevice()->GetNode()->GetId();
+	r.m_size = std::min<uint32_t>(size, UINT16_MAX);
+	r.m_src = ash.GetSAddr().GetAsInt();
+	r.m_dst = ash.GetDAddr().GetAsInt();
+	r.m_next = ash.GetNextHop().GetAsInt();
+	r.m_event = event;
+	r.m_type = type;
+	r.m_hops = std::min<uint32_t>(ash.GetNumForwards(), UINT8_MAX);
+	r.m_pad = 0;
+	m_packetTrace(r);
+	CarpEventRing::Record(r);
+}
+
+/* To keep a routing decision in the CarpEventRing
+ * Param:  uint8_t event (CarpDiagEvent), AquaSimAddress dst, AquaSimAddress next, uint32_t size
+ *         See CarpDiagEvent for what dst, next and size hold
+ * Return: void
+ * */
+void
+AquaSimCarp::TraceRouting(uint8_t event, AquaSimAddress dst, AquaSimAddress next, uint32_t size)
+{
+	CarpTraceRecord r;
+	r.m_time = Simulator::Now().GetNanoSeconds();
+	r.m_uid = 0;
+	r.m_node = GetNetDevice()->GetNode()->GetId();
+	r.m_size = std::min<uint32_t>(size, UINT16_MAX);
+	r.m_src = RaAddr().GetAsInt();
+	r.m_dst = dst.GetAsInt();
+	r.m_next = next.GetAsInt();
+	r.m_event = event;
+	r.m_type = 0;
+	r.m_hops = 0;
+	r.m_pad = 0;
+	CarpEventRing::Record(r);
+}
+
+/* To report a packet event of a frame carrying a CarpHeader
+ * Param:  uint8_t event (CarpTraceEvent), Ptr<const Packet> p, AquaSimHeader &ash, CarpHeader &crh
+ *         The size recorded is that of p, plus its headers unless it is being sent
+ * Return: void
+ * */
+void
+AquaSimCarp::TracePacket(uint8_t event, Ptr<const Packet> p, AquaSimHeader &ash, CarpHeader &crh)
+{
+	uint32_t size = p->GetSize();
+	if (event != CARP_TRACE_TX)
+	{
+		size += ash.GetSerializedSize() + crh.GetSerializedSize();
+	}
+	TraceRecord(event, crh.GetPacketType(), size, p->GetUid(), ash);
+}
+
+/* Snapshot parsed per file, so that every node of a run reads it only once. The
+ * modification time and size of the file tell whether the parse is still current. */
+struct CarpSnapshotCache
+{
+	time_t m_mtime;
+	off_t m_size;
+	std::map<CarpAddr, CarpCoreState> m_nodes;
+};
+static std::map<std::string, CarpSnapshotCache> g_snapshots;
+
+/* To write the routing tables of every CARP node of the simulation to a snapshot
+ * The layout is that of CarpWriteSnapshot
+ * Param:  std::string fileName
+ * Return: void
+ * */
+void
+AquaSimCarp::SaveSnapshot(std::string fileName)
+{
+	std::map<CarpAddr, CarpCoreState> nodes;
+	for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End(); n++)
+	{
+		for (uint32_t i = 0; i < (*n)->GetNDevices(); i++)
+		{
+			Ptr<AquaSimNetDevice> dev = DynamicCast<AquaSimNetDevice>((*n)->GetDevice(i));
+			Ptr<AquaSimCarp> carp = dev ? DynamicCast<AquaSimCarp>(dev->GetRouting()) : 0;
+			if (carp)
+			{
+				nodes[carp->RaAddr().GetAsInt()] = carp->m_core.Save();
+			}
+		}
+	}
+
+	std::ofstream os(fileName.c_str(), std::ios::binary);
+	if (!os)
+	{
+		NS_FATAL_ERROR("AquaSimCarp: cannot write snapshot " << fileName);
+	}
+	CarpWriteSnapshot(os, nodes);
+	os.close();
+	g_snapshots.erase(fileName);
+	CARP_LOG_INFO("AquaSimCarp: saved the tables of " << nodes.size() << " nodes to " << fileName);
+}
+
+/* To save a snapshot once the tables have converged
+ * Param:  Time at (Simulation time of the snapshot), std::string fileName
+ * Return: void
+ * */
+void
+AquaSimCarp::ScheduleSnapshot(Time at, std::string fileName)
+{
+	Simulator::Schedule(at, &AquaSimCarp::SaveSnapshot, fileName);
+}
+
+/* To load the tables of this node from the WarmStart snapshot, once
+ * Param:  void
+ * Return: bool (true if the node was warm started)
+ * */
+bool
+AquaSimCarp::LoadSnapshot()
+{
+	if (m_warmStartChecked)
+	{
+		return m_warmStarted;
+	}
+	m_warmStartChecked = true;
+	if (m_warmStart.empty())
+	{
+		return false;
+	}
+
+	struct stat st;
+	if (stat(m_warmStart.c_str(), &st) != 0)
+	{
+		NS_FATAL_ERROR("AquaSimCarp: cannot read snapshot " << m_warmStart);
+	}
+	std::map<std::string, CarpSnapshotCache>::iterator cached = g_snapshots.find(m_warmStart);
+	if (cached == g_snapshots.end() || cached->second.m_mtime != st.st_mtime || cached->second.m_size != st.st_size)
+	{
+		CarpSnapshotCache &entry = g_snapshots[m_warmStart];
+		std::ifstream is(m_warmStart.c_str(), std::ios::binary);
+		std::string error;
+		if (!CarpReadSnapshot(is, entry.m_nodes, error))
+		{
+			g_snapshots.erase(m_warmStart);
+			NS_FATAL_ERROR("AquaSimCarp: " << m_warmStart << ": " << error);
+		}
+		entry.m_mtime = st.st_mtime;
+		entry.m_size = st.st_size;
+		cached = g_snapshots.find(m_warmStart);
+	}
+
+	std::map<CarpAddr, CarpCoreState>::iterator it = cached->second.m_nodes.find(RaAddr().GetAsInt());
+	if (it == cached->second.m_nodes.end())
+	{
+		CARP_LOG_WARN("AquaSimCarp: node " << RaAddr() << " is not in snapshot " << m_warmStart << ", it runs discovery");
+		return false;
+	}
+	m_core.Restore(it->second);
+	m_warmStarted = true;
+	return true;
+}
+
+#ifdef CARP_PROFILE
+/* To account one call of a profiled handler, on leaving it
+ * Param: uint8_t handler (CarpHandler), uint64_t start (CarpProfiler::Now on entry, 0 without timers)
+ * Return: void
+ * */
+void
+AquaSimCarp::ProfileExit(uint8_t handler, uint64_t start)
+{
+	if (!m_profileRegistered)
+	{
+		CarpProfiler::Register(GetNetDevice()->GetNode()->GetId(), &m_profile);
+		m_profileRegistered = true;
+	}
+	uint64_t ticks = m_profileTimers ? CarpProfiler::Now() - start : 0;
+	m_profile.m_calls[handler]++;
+	m_profile.m_ticks[handler] += ticks;
+	m_handlerTrace(handler, ticks);
+}
+#endif
+
 /* To terminate protocol memory object
  * Param: void
  * Return: void
@@ -495,6 +1664,29 @@ AquaSimCarp::Recv(Ptr<Packet> p, const Address &dest, uint16_t protocolNumber)
 void 
 AquaSimCarp::DoDispose()
 {
+  for (std::map<AquaSimAddress, AggQueue>::iterator it = m_aggQueue.begin(); it != m_aggQueue.end(); it++)
+  {
+	it->second.m_timer.Cancel();
+  }
+  m_aggQueue.clear();
+  for (std::map<AquaSimAddress, HopAckState>::iterator it = m_hopAck.begin(); it != m_hopAck.end(); it++)
+  {
+	it->second.m_timer.Cancel();
+  }
+  m_hopAck.clear();
+  m_memoryEvent.Cancel();
+  m_flushEvent.Cancel();
+  m_discoveryEvent.Cancel();
+  m_windowEvent.Cancel();
+  m_seenBroadcasts.clear();
+  m_pendingFrames.clear();
   m_rand=0;
+#ifdef CARP_PROFILE
+  if (m_profileRegistered)
+  {
+	CarpProfiler::Unregister(&m_profile);
+	m_profileRegistered = false;
+  }
+#endif
   AquaSimRouting::DoDispose();
 }
@@ -1,17 +1,27 @@
 /* Development of Channel-aware Routing Protocol using Aqua-Sim */
 
-//#ifndef AQUA_SIM_ROUTING_CARP_H
-//#define AQUA_SIM_ROUTING_CARP_H
+#ifndef AQUA_SIM_ROUTING_CARP_H
+#define AQUA_SIM_ROUTING_CARP_H
 
 #include "aqua-sim-routing.h"
 #include "aqua-sim-header-routing.h"
 #include "aqua-sim-address.h"
 #include "aqua-sim-datastructure.h"
 #include "aqua-sim-channel.h"
+#include "aqua-sim-header.h"
+#include "aqua-sim-carp-trace-record.h"
+#include "aqua-sim-carp-profile.h"
+#include "aqua-sim-carp-diag.h"
+#include "aqua-sim-carp-core.h"
+#include "aqua-sim-carp-psr-model.h"
 #include "ns3/vector.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/packet.h"
+#include "ns3/traced-callback.h"
+#include "ns3/event-id.h"
 #include <map>
+#include <deque>
+#include <string>
 #include <bits/stdc++.h>
 #include <vector>
 
@@ -19,36 +29,69 @@ namespace ns3{
 
 // class CarpHeader;
 
-struct Neighbor
+// Counts and optionally times the enclosing handler when built with -DCARP_PROFILE
+#ifdef CARP_PROFILE
+#define CARP_PROFILE_SCOPE(handler) CarpProfileScope carpProfileScope (this, handler)
+#else
+#define CARP_PROFILE_SCOPE(handler)
+#endif
+
+// Packets waiting to be packed into one super-frame for a common next hop
+struct AggQueue
 {
-	//std::vector<AquaSimAddress> m_neighborAddress;
-	std::map<AquaSimAddress, uint16_t> m_neighbor; // A container to store the address and hop count of neighbors from the sink
-	
+	AggQueue() : m_bytes(0) {}
+	std::vector<Ptr<Packet> > m_pkts;
+	uint32_t m_bytes; // Total size of the queued packets
+	EventId m_timer;  // Fires when the oldest queued packet exhausts the delay budget
 };
 
-//Neighbor() : m_neighborAddress(0)
-//{
-//}
+// Frames sent to a relay that still wait for its hop-by-hop ACK
+struct HopAckState
+{
+	std::deque<Ptr<Packet> > m_unacked; // Copies kept for retransmission to the backup relay
+	EventId m_timer;                    // Fires when the relay stays silent for the ACK timeout
+};
 
-class AquaSimCarp : public AquaSimRouting {
+// Approximate heap bytes held by the per-node structures of one AquaSimCarp
+struct CarpMemoryUsage
+{
+	uint32_t m_node;
+	uint64_t m_neighbors;   // Neighbor table and link quality estimates
+	uint64_t m_probes;      // ACK counts of the selection window
+	uint64_t m_relays;      // Multipath relay set
+	uint64_t m_aggregation; // Packets waiting for a super-frame
+	uint64_t m_hopAck;      // Frames waiting for their hop-by-hop ACK
+	uint64_t GetTotal() const { return m_neighbors + m_probes + m_relays + m_aggregation + m_hopAck; }
+};
+
+/* The routing decisions are taken by CarpCore, which knows nothing of ns-3.
+ * AquaSimCarp builds and parses the frames, runs the timers and feeds what
+ * it receives into the core. */
+class AquaSimCarp : public AquaSimRouting, public CarpCoreEnv {
 public:
   AquaSimCarp();
-  std::map<Address, Neighbor>m_nodeNeighbor; // This is used to retrieve the neighbors of a node via the netdevice
-  Neighbor* m_neigh; // This is a pointer to the struct holding the neighbors of each node
   static TypeId GetTypeId(void);
   bool Recv(Ptr<Packet> packet, const Address &dest, uint16_t protocolNumber);
   int64_t AssignStreams (int64_t stream);
   inline AquaSimAddress RaAddr() { return AquaSimAddress::ConvertFrom(GetNetDevice()->GetAddress()); }
-  std::map<AquaSimAddress, int>pCount;
+  
+  // CarpCoreEnv
+  int64_t GetTime();
+  void SendProbe(CarpAddr neighbor, uint8_t frames);
   
   // Processing of Ping Packet
   void SendPing ();
   void RecvPing (Ptr<Packet> packet);
 
   // Processing of Hello Packet
-  void SendHello (Ptr<Packet> p);
+  void SendHello ();
   void RecvHello (Ptr<Packet> packet);
-  bool ProcessHello ();
+  void AddNeighbor (AquaSimAddress neighbor, uint16_t hopCount);
+  void ProcessHello ();
+  void StartDiscovery ();
+  void FindRoute ();
+  void SetSink (bool sink);
+  bool GetSink () const;
   
   // Processing of Pong Packet
   void SendPong (Ptr<Packet> packet);
@@ -58,28 +101,177 @@ public:
   Ptr<Packet> MakeACK(AquaSimAddress src);
   void SendACK(Ptr<Packet> p);
   AquaSimAddress GetNextHop();
-  void SetNextHop(AquaSimAddress src, std::map<AquaSimAddress, uint16_t> nei);
+  void SetNextHop();
+  void EndProbes();
+  bool IsNewBroadcast(uint64_t uid);
+  
+  // Multipath forwarding across relays of near-equal link quality
+  enum MultipathScheduler
+  {
+	WEIGHTED_RR = 0,
+	DEFICIT_RR = 1
+  };
+  typedef void (* RelayTxCallback)(AquaSimAddress relay, uint32_t count);
+  AquaSimAddress SelectRelay(uint32_t pktSize);
+  void SetMultipath(bool multipath);
+  bool GetMultipath() const;
+  void SetMultipathTolerance(double tolerance);
+  double GetMultipathTolerance() const;
+  void SetMultipathScheduler(MultipathScheduler scheduler);
+  MultipathScheduler GetMultipathScheduler() const;
   void RecvTrain(Ptr<Packet> p);
   void RecvAck(Ptr<Packet> p);
   
+  // Frames for the MAC, sent at once outside Recv and batched into one event inside it
+  void SendFrame(Ptr<Packet> p, AquaSimAddress nextHop);
+  void FlushFrames();
+  
   // Sending Data Packet
   Ptr<UniformRandomVariable> m_rand;
   void ForwardData(Ptr<Packet> p);  // This is used to send packets to the mac layer for onward delivery to the destination or next hop
+  
+  // Aggregation of data packets sharing a next hop
+  void Aggregate(Ptr<Packet> p, AquaSimAddress nextHop);
+  void FlushAggregate(AquaSimAddress nextHop);
+  void RecvAggregate(Ptr<Packet> p, const Address &dest, uint16_t protocolNumber);
+  
+  // Fast reroute to the runner-up relay
+  typedef void (* RerouteCallback)(AquaSimAddress failed, AquaSimAddress backup);
+  void SendDataAck(AquaSimAddress prevHop, uint32_t uid);
+  void RecvDataAck(AquaSimAddress relay, uint8_t level, uint32_t uid);
+  void TrackHopAck(Ptr<Packet> p, AquaSimAddress nextHop);
+  void HopAckTimeout(AquaSimAddress relay);
+  void NotifyTxFailure(AquaSimAddress nextHop); // Entry point for transmit failures reported by the MAC
+  void Reroute(AquaSimAddress failed);
+  
+  // Link quality estimation
+  enum LinkQualityMode
+  {
+	LQ_PROBE = 0,    // PSR measured by probe trains
+	LQ_ANALYTIC = 1, // PSR computed from the channel model, no probes
+	LQ_VALIDATE = 2  // Probes decide, the analytical choice is only compared
+  };
+  typedef void (* LinkQualityAgreementCallback)(AquaSimAddress probed, AquaSimAddress analytic);
+  std::map<CarpAddr, double> GetExpectedPsr();
+  void EstimateNextHop();
+  void ConnectMacFeedback();
+  void NotifyMacTx(AquaSimAddress dst, bool success); // Transmit outcome of a unicast MAC exchange
+  
+  // Congestion feedback towards the sources
+  typedef void (* CongestionCallback)(bool congested, uint8_t level);
+  uint8_t GetCongestionLevel();
+  void UpdateCongestion();
+  
+  // Binary packet trace, written by CarpTraceWriter
+  typedef void (* PacketEventCallback)(const CarpTraceRecord &record);
+  typedef void (* DeliveryCallback)(AquaSimAddress src, AquaSimAddress dst, uint32_t size, Time delay, uint8_t hops);
+  void TraceRecord(uint8_t event, uint8_t type, uint32_t size, uint64_t uid, AquaSimHeader &ash);
+  void TracePacket(uint8_t event, Ptr<const Packet> p, AquaSimHeader &ash, CarpHeader &crh);
+  void TraceRouting(uint8_t event, AquaSimAddress dst, AquaSimAddress next, uint32_t size);
+  
+  // Input of Recv as handed over by the MAC or the upper layer, recorded by CarpRecvRecorder
+  typedef void (* RecvInputCallback)(Ptr<const Packet> p, const Address &dest, uint16_t protocolNumber);
+  
+  // Memory accounting
+  typedef void (* MemoryUsageCallback)(const CarpMemoryUsage &usage);
+  CarpMemoryUsage GetMemoryUsage();
+  void SampleMemory();
+  void SetMaxNeighbors(uint32_t neighbors);
+  uint32_t GetMaxNeighbors() const;
+  void SetProbeCount(uint8_t frames);
+  uint8_t GetProbeCount() const;
+  
+  // Warm start from the converged tables of an earlier run
+  static void SaveSnapshot(std::string fileName);
+  static void ScheduleSnapshot(Time at, std::string fileName);
+  bool LoadSnapshot();
   void DoDispose();
+  
+#ifdef CARP_PROFILE
+  // Per-handler profile, see CarpProfiler
+  typedef void (* HandlerProfileCallback)(uint8_t handler, uint64_t ticks);
+  void ProfileExit(uint8_t handler, uint64_t start);
+#endif
 
 // private:
   Time wait_time;
   Time hello_time = Seconds(1.0);
-  AquaSimAddress sAddr;
-  uint8_t m_hopCount;
-  uint8_t m_numPkt =4; // An assumption is made for the number of packets
-  AquaSimAddress dAddr;
-  double m_energy;
-  double m_linkQuality;
-  uint8_t m_queue;
-  double lq; 
-  double alpha = 0.85;
-  AquaSimAddress m_nextHop;
-  uint8_t m_nodeId =0;
+  
+  bool m_sink;              // Starts the HELLO flood and collects the data packets
+  CarpCore m_core; // Neighbor table, link quality estimates and relay selection
+  EventId m_discoveryEvent; // HELLO flood of a sink
+  EventId m_windowEvent;    // End of the HELLO phase or of the selection window in progress
+  std::deque<uint64_t> m_seenBroadcasts; // Uids of the last broadcast data frames handled
+  TracedCallback<AquaSimAddress, uint32_t> m_relayTxTrace; // Relay chosen for a packet and its running count
+  
+  bool m_aggregation;
+  uint32_t m_aggSize;
+  Time m_aggDelay;
+  std::map<AquaSimAddress, AggQueue> m_aggQueue;
+  
+  Time m_hopAckTimeout;
+  uint32_t m_maxUnacked; // Frames kept per relay for retransmission
+  std::map<AquaSimAddress, HopAckState> m_hopAck;
+  bool m_inAggregate;
+  TracedCallback<AquaSimAddress, AquaSimAddress> m_rerouteTrace;
+  
+  bool m_directSend;
+  uint32_t m_recvDepth; // Nesting of Recv and NotifyMacTx, in which the MAC may be on the stack
+  std::vector<std::pair<Ptr<Packet>, AquaSimAddress> > m_pendingFrames;
+  EventId m_flushEvent;
+  
+  LinkQualityMode m_lqMode;
+  double m_analyticFrequency;   // kHz
+  double m_analyticBandwidth;   // kHz
+  double m_analyticSourceLevel; // dB re 1 uPa at 1 m
+  double m_analyticShipping;
+  double m_analyticWind;        // m/s
+  uint32_t m_analyticPacketSize;
+  CarpCore m_shadow; // Analytical selection compared with the probes in LQ_VALIDATE
+  TracedCallback<AquaSimAddress, AquaSimAddress> m_lqAgreementTrace;
+  
+  bool m_macFeedback;
+  double m_macFeedbackWeight;
+  bool m_macFeedbackConnected;
+  
+  uint32_t m_congestionThreshold;
+  uint8_t m_downstreamLevel; // Congestion level last reported by the relay
+  bool m_congested;
+  TracedCallback<bool, uint8_t> m_congestionTrace;
+  
+  TracedCallback<const CarpTraceRecord &> m_packetTrace;
+  TracedCallback<AquaSimAddress, AquaSimAddress, uint32_t, Time, uint8_t> m_deliveryTrace;
+  TracedCallback<Ptr<const Packet>, const Address &, uint16_t> m_recvInputTrace;
+  
+  Time m_memoryInterval;
+  EventId m_memoryEvent;
+  TracedCallback<const CarpMemoryUsage &> m_memoryTrace;
+  
+  std::string m_warmStart; // Snapshot file to load instead of running discovery
+  bool m_warmStartChecked;
+  bool m_warmStarted;
+  
+#ifdef CARP_PROFILE
+  bool m_profileTimers; // Time the handlers as well as counting them
+  bool m_profileRegistered;
+  CarpProfile m_profile;
+  TracedCallback<uint8_t, uint64_t> m_handlerTrace;
+#endif
 };  // class AquaSimCarp 
+
+#ifdef CARP_PROFILE
+class CarpProfileScope
+{
+public:
+  CarpProfileScope(AquaSimCarp *carp, uint8_t handler) :
+    m_carp(carp), m_handler(handler), m_start(carp->m_profileTimers ? CarpProfiler::Now() : 0) {}
+  ~CarpProfileScope() { m_carp->ProfileExit(m_handler, m_start); }
+private:
+  AquaSimCarp *m_carp;
+  uint8_t m_handler;
+  uint64_t m_start;
+};
+#endif
 } // End of ns3
+
+#endif /* AQUA_SIM_ROUTING_CARP_H */
@@ -0,0 +1,198 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "aqua-sim-spatial-grid.h"
+#include "ns3/assert.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ns3;
+
+// Cell coordinates are packed into 21 bits each, enough for 10^6 cells per axis
+static const int64_t g_coordBias = 1 << 20;
+static const uint64_t g_coordMask = (1 << 21) - 1;
+
+AquaSimSpatialGrid::AquaSimSpatialGrid(double cellSize) :
+  m_cellSize(cellSize),
+  m_n(0)
+{
+  NS_ASSERT_MSG(cellSize > 0, "AquaSimSpatialGrid: the cell size must be positive");
+}
+
+void
+AquaSimSpatialGrid::SetCellSize(double cellSize)
+{
+  NS_ASSERT_MSG(cellSize > 0, "AquaSimSpatialGrid: the cell size must be positive");
+  if (cellSize == m_cellSize)
+    {
+      return;
+    }
+  m_cellSize = cellSize;
+  m_cells.clear();
+  for (uint32_t id = 0; id < m_pos.size(); id++)
+    {
+      if (m_present[id])
+        {
+          const Vector &pos = m_pos[id];
+          m_cellOf[id] = Key(Coord(pos.x), Coord(pos.y), Coord(pos.z));
+          m_cells[m_cellOf[id]].push_back(id);
+        }
+    }
+}
+
+double
+AquaSimSpatialGrid::GetCellSize() const
+{
+  return m_cellSize;
+}
+
+int64_t
+AquaSimSpatialGrid::Coord(double v) const
+{
+  return (int64_t) std::floor(v / m_cellSize);
+}
+
+uint64_t
+AquaSimSpatialGrid::Key(int64_t x, int64_t y, int64_t z) const
+{
+  return (((uint64_t) (x + g_coordBias) & g_coordMask) << 42) |
+         (((uint64_t) (y + g_coordBias) & g_coordMask) << 21) |
+         ((uint64_t) (z + g_coordBias) & g_coordMask);
+}
+
+void
+AquaSimSpatialGrid::Insert(uint32_t id, const Vector &pos)
+{
+  if (id >= m_pos.size())
+    {
+      m_pos.resize(id + 1);
+      m_cellOf.resize(id + 1);
+      m_present.resize(id + 1, false);
+    }
+  if (m_present[id])
+    {
+      Update(id, pos);
+      return;
+    }
+  m_present[id] = true;
+  m_n++;
+  m_pos[id] = pos;
+  m_cellOf[id] = Key(Coord(pos.x), Coord(pos.y), Coord(pos.z));
+  m_cells[m_cellOf[id]].push_back(id);
+}
+
+void
+AquaSimSpatialGrid::Update(uint32_t id, const Vector &pos)
+{
+  NS_ASSERT_MSG(Contains(id), "AquaSimSpatialGrid: unknown id " << id);
+  m_pos[id] = pos;
+  uint64_t key = Key(Coord(pos.x), Coord(pos.y), Coord(pos.z));
+  if (key == m_cellOf[id])
+    {
+      return;
+    }
+  std::vector<uint32_t> &old = m_cells[m_cellOf[id]];
+  old.erase(std::find(old.begin(), old.end(), id));
+  if (old.empty())
+    {
+      m_cells.erase(m_cellOf[id]);
+    }
+  m_cellOf[id] = key;
+  m_cells[key].push_back(id);
+}
+
+void
+AquaSimSpatialGrid::Remove(uint32_t id)
+{
+  if (!Contains(id))
+    {
+      return;
+    }
+  std::vector<uint32_t> &cell = m_cells[m_cellOf[id]];
+  cell.erase(std::find(cell.begin(), cell.end(), id));
+  if (cell.empty())
+    {
+      m_cells.erase(m_cellOf[id]);
+    }
+  m_present[id] = false;
+  m_n--;
+}
+
+void
+AquaSimSpatialGrid::Clear()
+{
+  m_pos.clear();
+  m_cellOf.clear();
+  m_present.clear();
+  m_cells.clear();
+  m_n = 0;
+}
+
+bool
+AquaSimSpatialGrid::Contains(uint32_t id) const
+{
+  return id < m_present.size() && m_present[id];
+}
+
+const Vector &
+AquaSimSpatialGrid::GetPosition(uint32_t id) const
+{
+  NS_ASSERT_MSG(Contains(id), "AquaSimSpatialGrid: unknown id " << id);
+  return m_pos[id];
+}
+
+uint32_t
+AquaSimSpatialGrid::GetN() const
+{
+  return m_n;
+}
+
+void
+AquaSimSpatialGrid::Query(const Vector &centre, double radius, std::vector<uint32_t> &out) const
+{
+  int64_t x0 = Coord(centre.x - radius), x1 = Coord(centre.x + radius);
+  int64_t y0 = Coord(centre.y - radius), y1 = Coord(centre.y + radius);
+  int64_t z0 = Coord(centre.z - radius), z1 = Coord(centre.z + radius);
+  double r2 = radius * radius;
+  for (int64_t x = x0; x <= x1; x++)
+    {
+      for (int64_t y = y0; y <= y1; y++)
+        {
+          for (int64_t z = z0; z <= z1; z++)
+            {
+              std::unordered_map<uint64_t, std::vector<uint32_t> >::const_iterator it =
+                m_cells.find(Key(x, y, z));
+              if (it == m_cells.end())
+                {
+                  continue;
+                }
+              for (std::vector<uint32_t>::const_iterator i = it->second.begin(); i != it->second.end(); i++)
+                {
+                  const Vector &p = m_pos[*i];
+                  double dx = p.x - centre.x, dy = p.y - centre.y, dz = p.z - centre.z;
+                  if (dx * dx + dy * dy + dz * dz <= r2)
+                    {
+                      out.push_back(*i);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef AQUA_SIM_SPATIAL_GRID_H
+#define AQUA_SIM_SPATIAL_GRID_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "ns3/vector.h"
+
+namespace ns3 {
+
+ /**
+  * \ingroup aqua-sim-ng
+  *
+  * \brief Uniform grid of points for range queries
+  *
+  * Points are identified by small dense ids and bucketed into cubic cells.
+  * With the cell size set to the query radius, a query visits the 27 cells
+  * around the centre instead of every point, and moving a point only touches
+  * the two cells involved.
+  */
+class AquaSimSpatialGrid
+{
+public:
+  explicit AquaSimSpatialGrid(double cellSize = 1000);
+
+  // Changing the cell size rebuckets every point
+  void SetCellSize(double cellSize);
+  double GetCellSize() const;
+
+  void Insert(uint32_t id, const Vector &pos);
+  void Update(uint32_t id, const Vector &pos);
+  void Remove(uint32_t id);
+  void Clear();
+  bool Contains(uint32_t id) const;
+  const Vector &GetPosition(uint32_t id) const;
+  uint32_t GetN() const;
+
+  /*
+   * Appends to out the ids of the points within radius of centre, in no
+   * particular order.
+   */
+  void Query(const Vector &centre, double radius, std::vector<uint32_t> &out) const;
+
+private:
+  int64_t Coord(double v) const;
+  uint64_t Key(int64_t x, int64_t y, int64_t z) const;
+
+  double m_cellSize;
+  uint32_t m_n;
+  std::vector<Vector> m_pos;
+  std::vector<uint64_t> m_cellOf;
+  std::vector<bool> m_present;
+  std::unordered_map<uint64_t, std::vector<uint32_t> > m_cells;
+};  // class AquaSimSpatialGrid
+
+}  // namespace ns3
+
+#endif /* AQUA_SIM_SPATIAL_GRID_H */
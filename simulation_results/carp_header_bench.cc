@@ -0,0 +1,439 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Checks and times the codecs of the routing headers.
+ *
+ * For every header type, randomly filled headers must
+ *  - write exactly GetSerializedSize bytes, no more and no fewer
+ *  - return GetSerializedSize from Deserialize
+ *  - come back from Deserialize with the same fields and serialize to the same bytes
+ *  - leave an empty packet after AddHeader and RemoveHeader
+ * and the cost of Serialize, Deserialize and an AddHeader/RemoveHeader pair
+ * is reported in ns per call.
+ *
+ *   ./waf --run "carp_header_bench --iterations=1000000"
+ *   ./waf --run "carp_header_bench --check=1"   # checks only, exit status 1 on a failure
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/aqua-sim-header-routing.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("CarpHeaderBench");
+
+static std::mt19937 g_rng(1);
+static uint32_t g_failures = 0;
+
+static uint32_t
+Rand(uint32_t max)
+{
+  return std::uniform_int_distribution<uint32_t>(0, max)(g_rng);
+}
+
+static AquaSimAddress
+RandAddr()
+{
+  return AquaSimAddress((uint16_t) Rand(UINT16_MAX));
+}
+
+// Multiples of 1 mm, which the fixed-point codecs carry exactly
+static double
+RandFixed(uint32_t max)
+{
+  return Rand(max * 1000) / 1000.0;
+}
+
+static Vector
+RandPosition()
+{
+  return Vector(RandFixed(100000), RandFixed(100000), RandFixed(10000));
+}
+
+static bool
+Same(const Vector &a, const Vector &b)
+{
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+/*
+ * Random values in the range each codec can carry. The fields that do not
+ * go on the wire (e.g. the energy of a CarpHeader) are left alone.
+ */
+static void
+Fill(CarpHeader &h)
+{
+  h.SetSAddr(RandAddr());
+  h.SetDAddr(RandAddr());
+  h.SetHopCount(Rand(UINT8_MAX));
+  h.SetPktCount(Rand(UINT8_MAX));
+  h.SetPacketType((PckType) Rand(DATA_ACK));
+  h.SetQueue(Rand(UINT8_MAX));
+}
+
+static bool
+Same(CarpHeader &a, CarpHeader &b)
+{
+  return a.GetSAddr() == b.GetSAddr() && a.GetDAddr() == b.GetDAddr() && a.GetHopCount() == b.GetHopCount()
+         && a.GetPktCount() == b.GetPktCount() && a.GetPacketType() == b.GetPacketType() && a.GetQueue() == b.GetQueue();
+}
+
+static void
+Fill(HelloHeader &h)
+{
+  h.SetSAddr(RandAddr());
+  h.SetHopCount(Rand(UINT8_MAX));
+}
+
+static bool
+Same(HelloHeader &a, HelloHeader &b)
+{
+  return a.GetSAddr() == b.GetSAddr() && a.GetHopCount() == b.GetHopCount();
+}
+
+static void
+Fill(PingHeader &h)
+{
+  h.SetSAddr(RandAddr());
+  h.SetPktCount(Rand(UINT8_MAX));
+}
+
+static bool
+Same(PingHeader &a, PingHeader &b)
+{
+  return a.GetSAddr() == b.GetSAddr() && a.GetPktCount() == b.GetPktCount();
+}
+
+static void
+Fill(PongHeader &h)
+{
+  h.SetSAddr(RandAddr());
+  h.SetDAddr(RandAddr());
+  h.SetQueue(Rand(UINT8_MAX));
+  h.SetHopCount(Rand(UINT8_MAX));
+}
+
+static bool
+Same(PongHeader &a, PongHeader &b)
+{
+  return a.GetSAddr() == b.GetSAddr() && a.GetDAddr() == b.GetDAddr() && a.GetQueue() == b.GetQueue()
+         && a.GetHopCount() == b.GetHopCount() && a.GetPacketType() == b.GetPacketType();
+}
+
+static void
+Fill(CarpAggHeader &h)
+{
+  uint32_t n = 1 + Rand(31);
+  for (uint32_t k = 0; k < n; k++)
+    {
+      h.AddPacket(Rand(UINT16_MAX));
+    }
+}
+
+static bool
+Same(CarpAggHeader &a, CarpAggHeader &b)
+{
+  if (a.GetNumPackets() != b.GetNumPackets())
+    {
+      return false;
+    }
+  for (uint8_t k = 0; k < a.GetNumPackets(); k++)
+    {
+      if (a.GetLength(k) != b.GetLength(k))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+static void
+Fill(CarpAckHeader &h)
+{
+  h.SetUid(Rand(UINT32_MAX));
+}
+
+static bool
+Same(CarpAckHeader &a, CarpAckHeader &b)
+{
+  return a.GetUid() == b.GetUid();
+}
+
+static void
+Fill(VBHeader &h)
+{
+  h.SetMessType(Rand(EXPENSION_DATA));
+  h.SetPkNum(Rand(UINT32_MAX));
+  h.SetTargetAddr(RandAddr());
+  h.SetSenderAddr(RandAddr());
+  h.SetForwardAddr(RandAddr());
+  h.SetDataType(Rand(UINT8_MAX));
+  h.SetOriginalSource(RandPosition());
+  // Token, timestamp and range go on the wire in thousandths in 32 bits
+  h.SetToken(Rand(UINT32_MAX / 1000));
+  h.SetTs(Rand(UINT32_MAX / 1000));
+  h.SetRange(Rand(UINT32_MAX / 1000));
+  h.SetExtraInfo_o(RandPosition());
+  h.SetExtraInfo_f(RandPosition());
+  h.SetExtraInfo_t(RandPosition());
+  h.SetExtraInfo_d(RandPosition());
+}
+
+static bool
+Same(VBHeader &a, VBHeader &b)
+{
+  uw_extra_info ia = a.GetExtraInfo();
+  uw_extra_info ib = b.GetExtraInfo();
+  return a.GetMessType() == b.GetMessType() && a.GetPkNum() == b.GetPkNum()
+         && a.GetTargetAddr() == b.GetTargetAddr() && a.GetSenderAddr() == b.GetSenderAddr()
+         && a.GetForwardAddr() == b.GetForwardAddr() && a.GetDataType() == b.GetDataType()
+         && Same(a.GetOriginalSource(), b.GetOriginalSource())
+         && a.GetToken() == b.GetToken() && a.GetTs() == b.GetTs() && a.GetRange() == b.GetRange()
+         && Same(ia.o, ib.o) && Same(ia.f, ib.f) && Same(ia.t, ib.t) && Same(ia.d, ib.d);
+}
+
+static void
+Fill(DBRHeader &h)
+{
+  h.SetPosition(RandPosition());
+  h.SetPacketID(Rand(UINT32_MAX));
+  h.SetMode(Rand(DBRH_BEACON));
+  h.SetNHops(Rand(UINT16_MAX));
+  h.SetPrevHop(RandAddr());
+  h.SetOwner(RandAddr());
+  h.SetDepth(RandFixed(10000));
+}
+
+static bool
+Same(DBRHeader &a, DBRHeader &b)
+{
+  return Same(a.GetPosition(), b.GetPosition()) && a.GetPacketID() == b.GetPacketID()
+         && a.GetMode() == b.GetMode() && a.GetNHops() == b.GetNHops()
+         && a.GetPrevHop() == b.GetPrevHop() && a.GetOwner() == b.GetOwner() && a.GetDepth() == b.GetDepth();
+}
+
+static void
+Fill(DRoutingHeader &h)
+{
+  h.SetPktSrc(RandAddr());
+  h.SetPktLen(Rand(UINT16_MAX));
+  h.SetPktSeqNum(Rand(UINT8_MAX));
+  h.SetEntryNum(Rand(UINT32_MAX));
+}
+
+static bool
+Same(DRoutingHeader &a, DRoutingHeader &b)
+{
+  return a.GetPktSrc() == b.GetPktSrc() && a.GetPktLen() == b.GetPktLen()
+         && a.GetPktSeqNum() == b.GetPktSeqNum() && a.GetEntryNum() == b.GetEntryNum();
+}
+
+static void
+Fill(DDOSHeader &h)
+{
+  h.SetPacketType(Rand(DDOSHeader::Alert));
+  h.SetRowIndex(Rand(UINT32_MAX));
+}
+
+static bool
+Same(DDOSHeader &a, DDOSHeader &b)
+{
+  return a.GetPacketType() == b.GetPacketType() && a.GetRowIndex() == b.GetRowIndex();
+}
+
+// Bytes of h serialized over a buffer prefilled with the given pattern,
+// followed by a guard area of the same pattern
+static const uint32_t g_guard = 16;
+
+template <typename H>
+static std::vector<uint8_t>
+Encode(const H &h, uint8_t pattern)
+{
+  uint32_t size = h.GetSerializedSize();
+  Buffer b;
+  b.AddAtStart(size + g_guard);
+  b.Begin().WriteU8(pattern, size + g_guard);
+  h.Serialize(b.Begin());
+  std::vector<uint8_t> bytes(size + g_guard);
+  b.CopyData(&bytes[0], bytes.size());
+  return bytes;
+}
+
+static void
+Fail(const char *name, const char *what)
+{
+  std::printf("FAIL %-14s %s\n", name, what);
+  g_failures++;
+}
+
+template <typename H>
+static void
+Check(const char *name, uint32_t samples)
+{
+  for (uint32_t s = 0; s < samples; s++)
+    {
+      H h;
+      Fill(h);
+      uint32_t size = h.GetSerializedSize();
+
+      // A byte that is written does not depend on what was in the buffer
+      std::vector<uint8_t> a = Encode(h, 0x00);
+      std::vector<uint8_t> b = Encode(h, 0xff);
+      for (uint32_t k = 0; k < size; k++)
+        {
+          if (a[k] != b[k])
+            {
+              return Fail(name, "Serialize writes fewer bytes than GetSerializedSize");
+            }
+        }
+      for (uint32_t k = size; k < size + g_guard; k++)
+        {
+          if (a[k] != 0x00 || b[k] != 0xff)
+            {
+              return Fail(name, "Serialize writes past GetSerializedSize");
+            }
+        }
+
+      Buffer buffer;
+      buffer.AddAtStart(size);
+      h.Serialize(buffer.Begin());
+      H copy;
+      if (copy.Deserialize(buffer.Begin()) != size)
+        {
+          return Fail(name, "Deserialize does not return GetSerializedSize");
+        }
+      if (!Same(h, copy))
+        {
+          return Fail(name, "fields change across Serialize and Deserialize");
+        }
+      std::vector<uint8_t> again = Encode(copy, 0x00);
+      if (copy.GetSerializedSize() != size || again != a)
+        {
+          return Fail(name, "bytes change across Deserialize and Serialize");
+        }
+
+      Ptr<Packet> p = Create<Packet>();
+      p->AddHeader(h);
+      H removed;
+      if (p->GetSize() != size || p->RemoveHeader(removed) != size || p->GetSize() != 0 || !Same(h, removed))
+        {
+          return Fail(name, "AddHeader and RemoveHeader do not round-trip");
+        }
+    }
+}
+
+static double
+NsPerCall(std::chrono::steady_clock::time_point start, uint32_t iterations)
+{
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+template <typename H>
+static void
+Measure(const char *name, uint32_t iterations)
+{
+  H h;
+  Fill(h);
+  uint32_t size = h.GetSerializedSize();
+  Buffer buffer;
+  buffer.AddAtStart(size);
+  volatile uint32_t sink = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < iterations; k++)
+    {
+      h.Serialize(buffer.Begin());
+    }
+  double serialize = NsPerCall(start, iterations);
+
+  H copy;
+  start = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < iterations; k++)
+    {
+      sink += copy.Deserialize(buffer.Begin());
+    }
+  double deserialize = NsPerCall(start, iterations);
+
+  Ptr<Packet> p = Create<Packet>();
+  start = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < iterations; k++)
+    {
+      p->AddHeader(h);
+      sink += p->RemoveHeader(copy);
+    }
+  double addRemove = NsPerCall(start, iterations);
+
+  std::printf("%-14s %6u %12.1f %12.1f %12.1f\n", name, size, serialize, deserialize, addRemove);
+}
+
+template <typename H>
+static void
+Run(const char *name, uint32_t samples, uint32_t iterations)
+{
+  uint32_t failures = g_failures;
+  Check<H>(name, samples);
+  if (iterations > 0 && g_failures == failures)
+    {
+      Measure<H>(name, iterations);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint32_t samples = 10000;
+  uint32_t iterations = 1000000;
+  bool check = false;
+
+  CommandLine cmd;
+  cmd.AddValue("samples", "Random headers checked per header type", samples);
+  cmd.AddValue("iterations", "Calls timed per header type and operation", iterations);
+  cmd.AddValue("check", "Only run the checks", check);
+  cmd.Parse(argc, argv);
+  if (check)
+    {
+      iterations = 0;
+    }
+
+  if (iterations > 0)
+    {
+      std::printf("%-14s %6s %12s %12s %12s\n", "header", "bytes", "ser ns", "deser ns", "add+rm ns");
+    }
+  Run<CarpHeader>("CarpHeader", samples, iterations);
+  Run<HelloHeader>("HelloHeader", samples, iterations);
+  Run<PingHeader>("PingHeader", samples, iterations);
+  Run<PongHeader>("PongHeader", samples, iterations);
+  Run<CarpAggHeader>("CarpAggHeader", samples, iterations);
+  Run<CarpAckHeader>("CarpAckHeader", samples, iterations);
+  Run<VBHeader>("VBHeader", samples, iterations);
+  Run<DBRHeader>("DBRHeader", samples, iterations);
+  Run<DRoutingHeader>("DRoutingHeader", samples, iterations);
+  Run<DDOSHeader>("DDOSHeader", samples, iterations);
+
+  std::printf("%u header types failed\n", g_failures);
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/aqua-sim-ng-module.h"
+#include "ns3/aqua-sim-carp-scenario.h"
+#include "ns3/aqua-sim-routing-carp.h"
+#include "ns3/aqua-sim-carp-trace.h"
+#include "ns3/aqua-sim-carp-replay.h"
+#include <chrono>
+#include <iostream>
+
+/*
+ * Replays a recording of onandoffapp_carp --recordRecv=FILE into CARP alone.
+ *
+ * The nodes of the recorded run are built again from the same scenario
+ * arguments, in the same order and with the same random streams, but with a
+ * MAC that drops whatever CARP sends. Every recorded packet is then handed to
+ * AquaSimCarp::Recv of its node at its recorded time, so that a profiler
+ * attached to this program sees the routing layer and nothing underneath it.
+ *
+ *   onandoffapp_carp --topology=random --nodes=200 --sinks=2 --recordRecv=run.rcv
+ *   carp_replay --topology=random --nodes=200 --sinks=2 --recording=run.rcv --trace=replay.ctr
+ *
+ * The replay is open loop: frames that CARP sends during the replay are
+ * counted and written to the trace, where they can be compared with the
+ * trace of the recorded run, but the receptions stay those of the recording.
+ */
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("CarpReplay");
+
+int
+main (int argc, char *argv[])
+{
+  double simStop = 100;
+  uint32_t nodes = 3;
+  uint32_t sinks = 1;
+  std::string topology = "topo2";
+  double area = 1000;
+  double depth = 0;
+  uint32_t clusters = 4;
+  uint32_t seed = 1;
+  uint32_t run = 1;
+  bool adaptRate = false;
+  std::string warmStart = "";
+  std::string recording = "";
+  std::string trace = "";
+
+  CommandLine cmd;
+  cmd.AddValue ("recording", "Recording written by onandoffapp_carp --recordRecv", recording);
+  cmd.AddValue ("trace", "Binary packet trace of the replay, none by default", trace);
+  cmd.AddValue ("simStop", "Length of the recorded simulation", simStop);
+  cmd.AddValue ("nodes", "Amount of regular underwater nodes of the recorded run", nodes);
+  cmd.AddValue ("sinks", "Amount of sinks of the recorded run", sinks);
+  cmd.AddValue ("topology", "Deployment of the recorded run: grid, random, cluster, column, topo1 or topo2", topology);
+  cmd.AddValue ("area", "Side of the square deployment area (m)", area);
+  cmd.AddValue ("depth", "Water depth of the deployment (m)", depth);
+  cmd.AddValue ("clusters", "Amount of clusters of the cluster deployment", clusters);
+  cmd.AddValue ("seed", "Seed of the recorded run", seed);
+  cmd.AddValue ("run", "Replicate number of the recorded run", run);
+  cmd.AddValue ("adaptRate", "The recorded run throttled its source, which enables the hop-by-hop ACKs", adaptRate);
+  cmd.AddValue ("warmStart", "Snapshot the recorded run started from", warmStart);
+  // Same probe window as onandoffapp_carp
+  Config::SetDefault ("ns3::AquaSimCarp::WaitTime", TimeValue (Seconds (2.0)));
+  cmd.Parse (argc, argv);
+  if (recording.empty ())
+    {
+      NS_FATAL_ERROR ("--recording is required");
+    }
+
+  RngSeedManager::SetSeed (seed);
+  RngSeedManager::SetRun (run);
+
+  Ptr<CarpRecvReplayer> replayer = Create<CarpRecvReplayer> (recording);
+  uint32_t recorded = replayer->GetNodes ();
+  if (recorded > nodes + sinks)
+    {
+      NS_FATAL_ERROR ("The recording refers to " << recorded << " nodes, the scenario has " << nodes + sinks);
+    }
+
+  CarpScenarioHelper scenario;
+  if (!scenario.SetDeployment (topology))
+    {
+      NS_FATAL_ERROR ("Unknown topology " << topology);
+    }
+  scenario.SetNodes (nodes);
+  scenario.SetSinks (sinks);
+  scenario.SetArea (area);
+  scenario.SetDepth (depth);
+  scenario.SetClusters (clusters);
+
+  // Same stream numbers as onandoffapp_carp, so that CARP draws the same jitter
+  int64_t stream = 0;
+  stream += scenario.AssignStreams(stream);
+  std::vector<Vector> allPos = scenario.CreatePositions();
+
+  NodeContainer nodesCon;
+  NodeContainer sinksCon;
+  nodesCon.Create(nodes);
+  sinksCon.Create(sinks);
+
+  PacketSocketHelper socketHelper;
+  socketHelper.Install(nodesCon);
+  socketHelper.Install(sinksCon);
+
+  AquaSimChannelHelper channel = AquaSimChannelHelper::Default();
+  AquaSimHelper asHelper = AquaSimHelper::Default();
+  asHelper.SetChannel(channel.Create());
+  asHelper.SetMac("ns3::AquaSimReplayMac");
+  asHelper.SetRouting("ns3::AquaSimCarp",
+                      "HopAckTimeout", TimeValue(Seconds(adaptRate ? 5.0 : 0.0)),
+                      "WarmStart", StringValue(warmStart));
+
+  NetDeviceContainer devices;
+  for (NodeContainer::Iterator i = nodesCon.Begin(); i != nodesCon.End(); i++)
+    {
+      Ptr<AquaSimNetDevice> newDevice = CreateObject<AquaSimNetDevice>();
+      devices.Add(asHelper.Create(*i, newDevice));
+    }
+  for (NodeContainer::Iterator i = sinksCon.Begin(); i != sinksCon.End(); i++)
+    {
+      Ptr<AquaSimNetDevice> newDevice = CreateObject<AquaSimNetDevice>();
+      devices.Add(asHelper.Create(*i, newDevice));
+    }
+
+  CarpScenarioHelper::Install(NodeContainer(nodesCon, sinksCon), allPos);
+  for (uint32_t j = nodes; j < devices.GetN(); j++)
+    {
+      DynamicCast<AquaSimNetDevice>(devices.Get(j))->GetRouting()->SetAttribute("Sink", BooleanValue(true));
+    }
+
+  for (uint32_t i = 0; i < devices.GetN(); i++)
+    {
+      stream += DynamicCast<AquaSimNetDevice>(devices.Get(i))->GetRouting()->AssignStreams(stream);
+    }
+
+  Ptr<CarpTraceWriter> binaryTrace;
+  if (!trace.empty ())
+    {
+      binaryTrace = Create<CarpTraceWriter> (trace, true);
+      binaryTrace->EnableAll ();
+    }
+
+  replayer->Start ();
+  Simulator::Stop(Seconds(simStop+1));
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  Simulator::Run();
+  double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+  uint64_t outputs = 0;
+  uint64_t outputBytes = 0;
+  for (uint32_t i = 0; i < devices.GetN(); i++)
+    {
+      Ptr<AquaSimReplayMac> mac = DynamicCast<AquaSimReplayMac>(DynamicCast<AquaSimNetDevice>(devices.Get(i))->GetMac());
+      outputs += mac->GetTxPackets();
+      outputBytes += mac->GetTxBytes();
+    }
+  std::cout << "CARP_REPLAY inputs=" << replayer->GetReplayed () << " outputs=" << outputs
+            << " output_bytes=" << outputBytes << " wall=" << wall
+            << " inputs_per_s=" << (wall > 0 ? replayer->GetReplayed () / wall : 0) << "\n";
+
+  Simulator::Destroy();
+  return 0;
+}
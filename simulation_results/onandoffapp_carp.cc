@@ -19,15 +19,29 @@
  */
 
 #include "ns3/core-module.h"
+#include "ns3/default-simulator-impl.h"
 #include "ns3/network-module.h"
 #include "ns3/mobility-module.h"
 #include "ns3/aqua-sim-ng-module.h"
+#include "ns3/aqua-sim-carp-scenario.h"
+#include "ns3/aqua-sim-routing-carp.h"
+#include "ns3/aqua-sim-carp-trace.h"
+#include "ns3/aqua-sim-carp-stats.h"
+#include "ns3/aqua-sim-carp-replay.h"
+#include "ns3/aqua-sim-lite-channel.h"
 #include "ns3/applications-module.h"
 #include "ns3/log.h"
 #include "ns3/callback.h"
-#include "ns3/flow-monitor-helper.h"
+#include <algorithm>
 #include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
 #include "ns3/netanim-module.h"
+#ifdef NS3_MPI
+#include <mpi.h>
+#include "ns3/mpi-interface.h"
+#endif
 //#include "ns3/ipv4-global-routing-helper.h"
 //#include "ns3/internet-module.h"
 /*
@@ -49,6 +63,8 @@
  *           N2
  * 
  * 
+ * Larger deployments are generated with --topology=grid|random|cluster|column,
+ * e.g. --topology=random --nodes=2000 --sinks=4 --area=20000 --depth=1000
  */
 
 
@@ -56,160 +72,616 @@ using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("OnandOffApp_CARPRouting");
 
+/*
+ * Rate adaptation of every source against the CARP congestion signal of its
+ * own node. The rate of a source is halved whenever its path towards the
+ * sink becomes congested and grows back additively every second while it
+ * is not.
+ */
+struct SourceRate
+{
+  Ptr<Application> m_app;
+  uint32_t m_rate;
+  bool m_congested;
+};
+static std::vector<SourceRate> g_sources;
+static uint32_t g_maxRate;
+
+static void
+SetSourceRate (SourceRate &source, uint32_t rate)
+{
+  source.m_rate = rate;
+  source.m_app->SetAttribute ("DataRate", DataRateValue (DataRate (rate)));
+}
+
+static void
+CongestionSignal (uint32_t index, bool congested, uint8_t level)
+{
+  SourceRate &source = g_sources[index];
+  source.m_congested = congested;
+  if (congested)
+    {
+      NS_LOG_INFO ("Path of node " << source.m_app->GetNode ()->GetId () << " congested at level "
+                   << (uint32_t) level << ", halving its rate");
+      SetSourceRate (source, std::max<uint32_t> (source.m_rate / 2, g_maxRate / 32));
+    }
+}
+
+static void
+IncreaseRate (void)
+{
+  for (std::vector<SourceRate>::iterator it = g_sources.begin (); it != g_sources.end (); it++)
+    {
+      if (!it->m_congested && it->m_rate < g_maxRate)
+        {
+          SetSourceRate (*it, std::min<uint32_t> (it->m_rate + g_maxRate / 16, g_maxRate));
+        }
+    }
+  Simulator::Schedule (Seconds (1.0), &IncreaseRate);
+}
+
+/*
+ * Default simulator that counts the events it runs, for the events per second
+ * of tools/carp-bench. Every event is wrapped, so it is only used with
+ * --countEvents.
+ */
+static uint64_t g_events = 0;
+
+class CountedEvent : public EventImpl
+{
+public:
+  CountedEvent (EventImpl *event) : m_event (event, false) {}
+
+protected:
+  virtual void Notify (void)
+  {
+    g_events++;
+    m_event->Invoke ();
+  }
+
+private:
+  Ptr<EventImpl> m_event;
+};
+
+class CountingSimulatorImpl : public DefaultSimulatorImpl
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::CountingSimulatorImpl")
+      .SetParent<DefaultSimulatorImpl> ()
+      .AddConstructor<CountingSimulatorImpl> ();
+    return tid;
+  }
+  virtual EventId Schedule (Time const &delay, EventImpl *event)
+  {
+    return DefaultSimulatorImpl::Schedule (delay, new CountedEvent (event));
+  }
+  virtual void ScheduleWithContext (uint32_t context, Time const &delay, EventImpl *event)
+  {
+    DefaultSimulatorImpl::ScheduleWithContext (context, delay, new CountedEvent (event));
+  }
+  virtual EventId ScheduleNow (EventImpl *event)
+  {
+    return DefaultSimulatorImpl::ScheduleNow (new CountedEvent (event));
+  }
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CountingSimulatorImpl);
+
+/*
+ * Latest MemoryUsage sample of every node and the largest total seen on
+ * any node, for the CARP_MEMORY line of --memoryInterval.
+ */
+static std::map<uint32_t, CarpMemoryUsage> g_memory;
+static uint64_t g_memoryPeak = 0;
+
+static void
+MemorySample (const CarpMemoryUsage &usage)
+{
+  g_memory[usage.m_node] = usage;
+  g_memoryPeak = std::max (g_memoryPeak, usage.GetTotal ());
+}
+
+static void
+PrintMemory (std::ostream &os)
+{
+  CarpMemoryUsage sum = CarpMemoryUsage ();
+  uint64_t largest = 0;
+  for (std::map<uint32_t, CarpMemoryUsage>::iterator it = g_memory.begin (); it != g_memory.end (); it++)
+    {
+      sum.m_neighbors += it->second.m_neighbors;
+      sum.m_probes += it->second.m_probes;
+      sum.m_relays += it->second.m_relays;
+      sum.m_aggregation += it->second.m_aggregation;
+      sum.m_hopAck += it->second.m_hopAck;
+      largest = std::max (largest, it->second.GetTotal ());
+    }
+  os << "CARP_MEMORY nodes=" << g_memory.size () << " bytes=" << sum.GetTotal ()
+     << " neighbors=" << sum.m_neighbors << " probes=" << sum.m_probes << " relays=" << sum.m_relays
+     << " aggregation=" << sum.m_aggregation << " hop_ack=" << sum.m_hopAck
+     << " node_max=" << largest << " node_peak=" << g_memoryPeak << "\n";
+}
+
+// Selection windows of --lqMode=Validate and those where the model agreed with the probes
+static uint64_t g_lqWindows = 0;
+static uint64_t g_lqAgreements = 0;
+
+static void
+LinkQualityAgreement (AquaSimAddress probed, AquaSimAddress analytic)
+{
+  g_lqWindows++;
+  if (probed == analytic)
+    {
+      g_lqAgreements++;
+    }
+}
+
+// The KPIs come from the CARP statistics collector, the sinks only drain their sockets
+static void
+SinkRecv (Ptr<Socket> socket)
+{
+  while (socket->Recv ())
+    {
+    }
+}
+
 int
-main ()
+main (int argc, char *argv[])
 {
   double simStop = 100; //seconds
-  int nodes = 3;
+  uint32_t nodes = 3;
  // int carrier_frequency = 24 kHz;
  // int bandwidth = 4 kHz;
-  int sinks = 1;
+  uint32_t sinks = 1;
+  uint32_t sources = 1;
   uint32_t m_dataRate = 16000;
   int m_packetSize = 100;
-  std::string asciiTraceFile = "carp_sim_static.asc";
+  bool adaptRate = false;
+  std::string topology = "topo2";
+  double area = 1000;
+  double depth = 0;
+  uint32_t clusters = 4;
+  uint32_t seed = 1;
+  uint32_t run = 1;
+  bool splitArea = false;
+  double range = 1000;
+  double halo = -1;
+  std::string trace = "binary";
+  std::string traceFile = "";
+  bool asyncTrace = true;
+  bool printFlows = false;
+  std::string warmStart = "";
+  std::string saveSnapshot = "";
+  double snapshotTime = 10;
+  bool countEvents = false;
+  std::string recordRecv = "";
+  std::string stack = "full";
+  uint32_t eventRing = 0;
+  double memoryInterval = 0;
+  std::string lqMode = "Probe";
 
   LogComponentEnable ("OnandOffApp_CARPRouting", LOG_LEVEL_INFO);
 
   //To change on the fly
   CommandLine cmd;
- // cmd.AddValue ("simStop", "Length of simulation", simStop);
- cmd.AddValue ("nodes", "Amount of regular underwater nodes", nodes);
+  cmd.AddValue ("simStop", "Length of simulation", simStop);
+  cmd.AddValue ("nodes", "Amount of regular underwater nodes", nodes);
+  cmd.AddValue ("sinks", "Amount of sinks", sinks);
+  cmd.AddValue ("sources", "Amount of nodes sending data, starting from the first node", sources);
+  cmd.AddValue ("topology", "Deployment: grid, random, cluster, column, topo1 or topo2", topology);
+  cmd.AddValue ("area", "Side of the square deployment area (m)", area);
+  cmd.AddValue ("depth", "Water depth of the deployment (m)", depth);
+  cmd.AddValue ("clusters", "Amount of clusters of the cluster deployment", clusters);
+  cmd.AddValue ("seed", "Seed of the random number generator", seed);
+  cmd.AddValue ("run", "Replicate number, selects independent random streams for the same seed", run);
+  cmd.AddValue ("dataRate", "Data rate of every source (bps)", m_dataRate);
+  cmd.AddValue ("packetSize", "Size of the data packets (bytes)", m_packetSize);
+  cmd.AddValue ("adaptRate", "Throttle every source against the CARP congestion signal of its node", adaptRate);
+  cmd.AddValue ("splitArea", "Split the area into independent slab runs, one per MPI rank (run with mpirun); not a distributed simulation", splitArea);
+  cmd.AddValue ("trace", "Packet trace: binary, ascii or none", trace);
+  cmd.AddValue ("traceFile", "Packet trace file, carp_sim_static.ctr or .asc by default", traceFile);
+  cmd.AddValue ("asyncTrace", "Write the binary trace from a background thread", asyncTrace);
+  cmd.AddValue ("printFlows", "Print the KPIs of every flow before the run summary", printFlows);
+  cmd.AddValue ("warmStart", "Snapshot of converged CARP tables to start from instead of running discovery", warmStart);
+  cmd.AddValue ("saveSnapshot", "File to save the CARP tables to at snapshotTime", saveSnapshot);
+  cmd.AddValue ("snapshotTime", "Time at which the CARP tables are saved (s)", snapshotTime);
+  cmd.AddValue ("range", "Propagation range covered by the receiver lookup (m)", range);
+  cmd.AddValue ("halo", "Width of the border simulated on both sides of a rank's slab, the range by default (m)", halo);
+  cmd.AddValue ("countEvents", "Count the simulator events and print them after the run summary", countEvents);
+  cmd.AddValue ("recordRecv", "File to record every packet handed to CARP in, to replay with carp_replay", recordRecv);
+  cmd.AddValue ("eventRing", "Keep the last N CARP events in memory and print them if the run aborts", eventRing);
+  cmd.AddValue ("memoryInterval", "Sample the memory of the CARP tables and queues every this many seconds and print it after the run summary, 0 disables it", memoryInterval);
+  cmd.AddValue ("lqMode", "Link quality of the neighbors: Probe, Analytic (from the channel model, no probes) or Validate (probes, compared with the model)", lqMode);
+  cmd.AddValue ("stack", "Layers under CARP: full, or lite for range-based delivery without PHY and MAC contention", stack);
+  // The probe window covers the 0.5 s probe jitter and the round trip over the default range
+  Config::SetDefault ("ns3::AquaSimCarp::WaitTime", TimeValue (Seconds (2.0)));
+  cmd.Parse (argc, argv);
+  if (countEvents && !splitArea)
+    {
+      GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::CountingSimulatorImpl"));
+    }
+  if (halo < 0)
+    {
+      halo = range;
+    }
+  if (traceFile.empty ())
+    {
+      traceFile = (trace == "ascii") ? "carp_sim_static.asc" : "carp_sim_static.ctr";
+    }
+
+  RngSeedManager::SetSeed (seed);
+  RngSeedManager::SetRun (run);
+
+  CarpScenarioHelper scenario;
+  if (!scenario.SetDeployment (topology))
+    {
+      NS_FATAL_ERROR ("Unknown topology " << topology);
+    }
+  scenario.SetNodes (nodes);
+  scenario.SetSinks (sinks);
+  scenario.SetArea (area);
+  scenario.SetDepth (depth);
+  scenario.SetClusters (clusters);
+  sources = std::min (sources, nodes);
 
+  // Positions are drawn first so that every slab run sees the same deployment
+  int64_t stream = 0;
+  stream += scenario.AssignStreams(stream);
+  std::vector<Vector> allPos = scenario.CreatePositions();
+
+  /*
+   * Split-area runs: every rank owns a slab of the area and simulates it
+   * together with the nodes within --halo of it, which relay for its own nodes
+   * but source no traffic, and with the sinks its sources send to. This is an
+   * approximation, not a distributed simulation: the ranks run independently,
+   * no frame crosses from one rank to another, and routes that leave the slab
+   * by more than the halo are cut. The KPIs of the ranks are summed at the
+   * end. A single process owns the whole area.
+   */
+  uint32_t rank = 0;
+  uint32_t ranks = 1;
+#ifdef NS3_MPI
+  if (splitArea)
+    {
+      MpiInterface::Enable (&argc, &argv);
+      rank = MpiInterface::GetSystemId ();
+      ranks = MpiInterface::GetSize ();
+    }
+#else
+  if (splitArea)
+    {
+      NS_FATAL_ERROR ("--splitArea needs ns-3 to be configured with --enable-mpi");
+    }
+#endif
+  if (ranks > 1)
+    {
+      // Every rank keeps the tables of its own partition
+      std::ostringstream suffix;
+      suffix << "." << rank;
+      warmStart += warmStart.empty () ? "" : suffix.str ();
+      saveSnapshot += saveSnapshot.empty () ? "" : suffix.str ();
+      recordRecv += recordRecv.empty () ? "" : suffix.str ();
+    }
+  std::vector<double> bounds;
+  std::vector<uint32_t> owner = scenario.Partition(allPos, ranks, bounds);
+  // Every source sends to one of the sinks in turn, whatever the number of ranks
+  std::vector<bool> target(allPos.size(), false);
+  uint32_t cutSources = 0;
+  for (uint32_t i = 0; i < sources; i++)
+    {
+      if (owner[i] == rank)
+        {
+          target[nodes + i % sinks] = true;
+          const Vector &sink = allPos[nodes + i % sinks];
+          cutSources += (sink.x < bounds[rank] - halo || sink.x >= bounds[rank + 1] + halo);
+        }
+    }
+  if (cutSources > 0)
+    {
+      NS_LOG_WARN (cutSources << " sources of rank " << rank << " send to a sink beyond the halo, their routes are cut");
+    }
+  std::vector<uint32_t> local; // Global index of every node simulated here, sensor nodes first
+  std::vector<Vector> localPos;
+  uint32_t localNodes = 0;
+  for (uint32_t i = 0; i < allPos.size(); i++)
+    {
+      if (owner[i] == rank || target[i]
+          || (allPos[i].x >= bounds[rank] - halo && allPos[i].x < bounds[rank + 1] + halo))
+        {
+          local.push_back(i);
+          localPos.push_back(allPos[i]);
+          localNodes += (i < nodes);
+        }
+    }
 
-  std::cout << "-----------Initializing simulation-----------\n";
-  std::cout <<"Running the simulation using " << nodes << " nodes\n"; 
+  if (rank == 0)
+    {
+      std::cout << "-----------Initializing simulation-----------\n";
+      std::cout <<"Running the simulation using " << nodes << " nodes and " << sinks << " sinks on topology " << topology;
+      if (ranks > 1)
+        {
+          std::cout << " split over " << ranks << " ranks";
+        }
+      std::cout << "\n";
+    }
 
   NodeContainer nodesCon;
   NodeContainer sinksCon;
-  nodesCon.Create(nodes);
-  sinksCon.Create(sinks);
+  nodesCon.Create(localNodes);
+  sinksCon.Create(local.size() - localNodes);
 
   PacketSocketHelper socketHelper;
   socketHelper.Install(nodesCon);
   socketHelper.Install(sinksCon);
 
+  Config::SetDefault ("ns3::AquaSimCarp::LinkQualityMode", StringValue (lqMode));
   //Establish layers using helper's pre-build settings
   AquaSimChannelHelper channel = AquaSimChannelHelper::Default();
-  channel.SetPropagation("ns3::AquaSimRangePropagation");
+  // Receivers are looked up in a grid of range-sized cells instead of scanning every device
+  channel.SetPropagation("ns3::AquaSimGridPropagation", "CellSize", DoubleValue(range));
   AquaSimHelper asHelper = AquaSimHelper::Default();
   asHelper.SetChannel(channel.Create());
-  asHelper.SetMac("ns3::AquaSimSFama");  // Changed this to FAMA
-  asHelper.SetRouting("ns3::AquaSimCarp");
+  Ptr<AquaSimLiteChannel> lite;
+  if (stack == "lite")
+    {
+      // Frames reach every node within range after the propagation delay, without collisions
+      lite = CreateObjectWithAttributes<AquaSimLiteChannel> ("Range", DoubleValue (range));
+      asHelper.SetMac("ns3::AquaSimLiteMac", "Channel", PointerValue (lite));
+    }
+  else if (stack == "full")
+    {
+      asHelper.SetMac("ns3::AquaSimSFama");  // Changed this to FAMA
+    }
+  else
+    {
+      NS_FATAL_ERROR ("Unknown stack " << stack);
+    }
+  // Congestion is carried back in the hop-by-hop ACKs
+  asHelper.SetRouting("ns3::AquaSimCarp",
+                      "HopAckTimeout", TimeValue(Seconds(adaptRate ? 5.0 : 0.0)),
+                      "WarmStart", StringValue(warmStart));
 
   /*
    * Set up mobility model for nodes and sinks
    */
-  MobilityHelper mobility;
   NetDeviceContainer devices;
-  Ptr<ListPositionAllocator> position = CreateObject<ListPositionAllocator> ();
-  Vector boundry = Vector(0,0,0);
 
-  std::cout << "Creating Nodes\n";
+  if (rank == 0)
+    {
+      std::cout << "Creating Nodes\n";
+    }
 
   for (NodeContainer::Iterator i = nodesCon.Begin(); i != nodesCon.End(); i++)
     {
       Ptr<AquaSimNetDevice> newDevice = CreateObject<AquaSimNetDevice>();
-      position->Add(boundry);
       devices.Add(asHelper.Create(*i, newDevice));
-
-      //NS_LOG_DEBUG("Node:" << newDevice->GetAddress () << " position(x):" << boundry.x);
-      //boundry.x += 10;
     }
 
   for (NodeContainer::Iterator i = sinksCon.Begin(); i != sinksCon.End(); i++)
     {
       Ptr<AquaSimNetDevice> newDevice = CreateObject<AquaSimNetDevice>();
-      position->Add(boundry);
       devices.Add(asHelper.Create(*i, newDevice));
-      //NS_LOG_DEBUG("Sink:" << newDevice->GetAddress () << " position(x):" << boundry.x);
-      //boundry.x += 10;
     }
 
-  mobility.SetPositionAllocator(position);
-  mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
-  
-  mobility.Install(nodesCon);
-  mobility.Install(sinksCon);
-  
-  Ptr<MobilityModel> nod0 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  nod0->SetPosition(boundry);
-  
-  // Network Topology I
-  //Ptr<MobilityModel> nod1 = nodesCon.Get(1)->GetObject<MobilityModel>();
-  //nod1->SetPosition(Vector(boundry.x + 10, boundry.y+0, boundry.z));
-  //Ptr<MobilityModel> nod2 = nodesCon.Get(2)->GetObject<MobilityModel>();
-  //nod2->SetPosition(Vector(boundry.x + 10, boundry.y+20, boundry.z));
-  //Ptr<MobilityModel> nod3 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod3->SetPosition(Vector(boundry.x + 25, boundry.y+20, boundry.z));
-  //Ptr<MobilityModel> nod4 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod4->SetPosition(Vector(boundry.x + 35, boundry.y+15, boundry.z));
-  //Ptr<MobilityModel> nod5 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod5->SetPosition(Vector(boundry.x + 30, boundry.y+40, boundry.z));
-  //Ptr<MobilityModel> nod6 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod6->SetPosition(Vector(boundry.x + 40, boundry.y+30, boundry.z));
- //Ptr<MobilityModel> nod7 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod7->SetPosition(Vector(boundry.x + 45, boundry.y+20, boundry.z));
-  
-  // Network Topology II
-   Ptr<MobilityModel> nod1 = nodesCon.Get(1)->GetObject<MobilityModel>();
-  nod1->SetPosition(Vector(boundry.x + 5, boundry.y+10, boundry.z));
-  Ptr<MobilityModel> nod2 = nodesCon.Get(2)->GetObject<MobilityModel>();
-  nod2->SetPosition(Vector(boundry.x + 15, boundry.y+10, boundry.z));
-  //Ptr<MobilityModel> nod3 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod3->SetPosition(Vector(boundry.x + 25, boundry.y+5, boundry.z));
-  //Ptr<MobilityModel> nod4 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod4->SetPosition(Vector(boundry.x + 28, boundry.y+25, boundry.z));
-  //Ptr<MobilityModel> nod5 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod5->SetPosition(Vector(boundry.x + 45, boundry.y+5, boundry.z));
-  //Ptr<MobilityModel> nod6 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod6->SetPosition(Vector(boundry.x + 50, boundry.y+35, boundry.z));
- //Ptr<MobilityModel> nod7 = nodesCon.Get(0)->GetObject<MobilityModel>();
-  //nod7->SetPosition(Vector(boundry.x + 55, boundry.y+15, boundry.z));
-  
-  
-  Ptr<MobilityModel> sink0 = sinksCon.Get(0)->GetObject<MobilityModel>();
-  sink0->SetPosition(Vector(boundry.x + 80, boundry.y+35, boundry.z));
+  CarpScenarioHelper::Install(NodeContainer(nodesCon, sinksCon), localPos);
+  for (uint32_t j = localNodes; j < devices.GetN(); j++)
+    {
+      DynamicCast<AquaSimNetDevice>(devices.Get(j))->GetRouting()->SetAttribute("Sink", BooleanValue(true));
+    }
 
+  if (lqMode == "Validate")
+    {
+      for (uint32_t i = 0; i < devices.GetN(); i++)
+        {
+          DynamicCast<AquaSimNetDevice>(devices.Get(i))->GetRouting()->TraceConnectWithoutContext("LinkQualityAgreement", MakeCallback(&LinkQualityAgreement));
+        }
+    }
+  if (memoryInterval > 0)
+    {
+      for (uint32_t i = 0; i < devices.GetN(); i++)
+        {
+          Ptr<AquaSimRouting> routing = DynamicCast<AquaSimNetDevice>(devices.Get(i))->GetRouting();
+          routing->SetAttribute("MemoryInterval", TimeValue(Seconds(memoryInterval)));
+          routing->TraceConnectWithoutContext("MemoryUsage", MakeCallback(&MemorySample));
+        }
+    }
 
-  PacketSocketAddress socket;
-  socket.SetAllDevices(); // Set all nodes as sender asides the receiver
-  //socket.SetSingleDevice(0); // Set a specific node as the sender which is ---> node 1
-  socket.SetPhysicalAddress (devices.Get(nodes)->GetAddress()); //Set dest to first sink
-  socket.SetProtocol (0);
+  // Fixed stream numbers keep a replicate reproducible whatever else draws random numbers
+  for (uint32_t i = 0; i < devices.GetN(); i++)
+    {
+      stream += DynamicCast<AquaSimNetDevice>(devices.Get(i))->GetRouting()->AssignStreams(stream);
+    }
+  if (lite)
+    {
+      stream += lite->AssignStreams(stream);
+    }
 
-  OnOffHelper app ("ns3::PacketSocketFactory", Address (socket));
-  app.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
-  app.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
-  app.SetAttribute ("DataRate", DataRateValue (m_dataRate));
-  app.SetAttribute ("PacketSize", UintegerValue (m_packetSize));
+  TypeId psfid = TypeId::LookupByName ("ns3::PacketSocketFactory"); // Socket factory put into use
+  for (uint32_t j = localNodes; j < local.size(); j++)
+    {
+      PacketSocketAddress socket;
+      socket.SetAllDevices();
+      socket.SetPhysicalAddress (devices.Get(j)->GetAddress());
+      socket.SetProtocol (0);
+      Ptr<Socket> sinkSocket = Socket::CreateSocket (sinksCon.Get(j - localNodes), psfid);
+      sinkSocket->Bind (socket);
+      sinkSocket->SetRecvCallback (MakeCallback (&SinkRecv));
+    }
 
+  ApplicationContainer apps;
+  NodeContainer owned; // Nodes whose transmissions this rank counts
+  for (uint32_t li = 0; li < local.size(); li++)
+    {
+      if (owner[local[li]] == rank)
+        {
+          owned.Add (li < localNodes ? nodesCon.Get(li) : sinksCon.Get(li - localNodes));
+        }
+    }
+  for (uint32_t li = 0; li < localNodes; li++)
+    {
+      uint32_t i = local[li];
+      if (i >= sources || owner[i] != rank)
+        {
+          continue;
+        }
+      uint32_t sink = std::find(local.begin() + localNodes, local.end(), nodes + i % sinks) - local.begin();
+
+      PacketSocketAddress socket;
+      socket.SetAllDevices(); // Set all nodes as sender asides the receiver
+      socket.SetPhysicalAddress (devices.Get(sink)->GetAddress());
+      socket.SetProtocol (0);
 
-  // Echo source is installed on the source nodes 
-  ApplicationContainer apps = app.Install (nodesCon.Get(0));
+      OnOffHelper app ("ns3::PacketSocketFactory", Address (socket));
+      app.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
+      app.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+      app.SetAttribute ("DataRate", DataRateValue (m_dataRate));
+      app.SetAttribute ("PacketSize", UintegerValue (m_packetSize));
+      ApplicationContainer source = app.Install (nodesCon.Get(li));
+      apps.Add (source);
+    }
   apps.Start (Seconds (0.5));
   apps.Stop (Seconds (simStop));
 
+  if (adaptRate && apps.GetN() > 0)
+    {
+      g_maxRate = m_dataRate;
+      for (uint32_t a = 0; a < apps.GetN(); a++)
+        {
+          SourceRate source;
+          source.m_app = apps.Get(a);
+          source.m_rate = m_dataRate;
+          source.m_congested = false;
+          g_sources.push_back(source);
+          Ptr<AquaSimNetDevice> srcDevice = DynamicCast<AquaSimNetDevice>(source.m_app->GetNode()->GetDevice(0));
+          srcDevice->GetRouting()->TraceConnectWithoutContext("Congestion", MakeBoundCallback(&CongestionSignal, a));
+        }
+      Simulator::Schedule (Seconds (1.5), &IncreaseRate);
+    }
 
-  Ptr<Node> sinkNode = sinksCon.Get(0);
-  TypeId psfid = TypeId::LookupByName ("ns3::PacketSocketFactory"); // Socket factory put into use
-
-  Ptr<Socket> sinkSocket = Socket::CreateSocket (sinkNode, psfid);
-  sinkSocket->Bind (socket);
-  
- 
-  std::cout << "-----------Running Simulation-----------\n";
-  Packet::EnablePrinting (); //for debugging purposes
+  if (rank == 0)
+    {
+      std::cout << "-----------Running Simulation-----------\n";
+    }
+  if (!saveSnapshot.empty ())
+    {
+      AquaSimCarp::ScheduleSnapshot (Seconds (snapshotTime), saveSnapshot);
+    }
 
   Simulator::Stop(Seconds(simStop+1));
-  std::ofstream ascii (asciiTraceFile.c_str());
-  if (!ascii.is_open()) {
-    NS_FATAL_ERROR("Could not open trace file.");
-  }
-  asHelper.EnableAsciiAll(ascii);
+  if (ranks > 1)
+    {
+      std::ostringstream rankFile;
+      rankFile << traceFile << "." << rank;
+      traceFile = rankFile.str ();
+    }
+  // The binary trace is read back with tools/carp-trace, the ASCII trace is kept for debugging
+  Ptr<CarpTraceWriter> binaryTrace;
+  std::ofstream ascii;
+  if (trace == "binary")
+    {
+      binaryTrace = Create<CarpTraceWriter> (traceFile, asyncTrace);
+      binaryTrace->EnableAll ();
+    }
+  else if (trace == "ascii")
+    {
+      Packet::EnablePrinting ();
+      ascii.open (traceFile.c_str());
+      if (!ascii.is_open()) {
+        NS_FATAL_ERROR("Could not open trace file.");
+      }
+      asHelper.EnableAsciiAll(ascii);
+    }
+  else if (trace != "none")
+    {
+      NS_FATAL_ERROR ("Unknown trace format " << trace);
+    }
+  Ptr<CarpStatsCollector> stats = Create<CarpStatsCollector> ();
+  if (ranks > 1)
+    {
+      // The border nodes are counted by the rank that owns them
+      stats->EnableAll (owned);
+    }
+  else
+    {
+      stats->EnableAll ();
+    }
+  Ptr<CarpRecvRecorder> recorder;
+  if (!recordRecv.empty ())
+    {
+      recorder = Create<CarpRecvRecorder> (recordRecv);
+      recorder->EnableAll ();
+    }
+  CarpEventRing::Enable (eventRing);
   Simulator::Run();
   
   asHelper.GetChannel()->PrintCounters();
+  if (lite)
+    {
+      lite->PrintCounters(std::cout);
+    }
+  Time activeTime = Seconds (simStop - 0.5);
+  if (ranks == 1)
+    {
+      if (printFlows)
+        {
+          stats->PrintFlows (std::cout);
+        }
+      stats->Print (std::cout, activeTime);
+      if (adaptRate)
+        {
+          // The throttled sources still have to get their packets through
+          std::cout << "CARP_ADAPT_RATE sources=" << g_sources.size () << " rates=";
+          for (uint32_t s = 0; s < g_sources.size (); s++)
+            {
+              std::cout << (s ? "," : "") << g_sources[s].m_rate;
+            }
+          std::cout << "\n";
+          if (stats->GetSent () > 0 && stats->GetDelivered () == 0)
+            {
+              NS_LOG_WARN ("No packet was delivered with adaptRate");
+            }
+        }
+      if (countEvents)
+        {
+          std::cout << "CARP_RUNTIME events=" << g_events << "\n";
+        }
+      if (memoryInterval > 0)
+        {
+          PrintMemory (std::cout);
+        }
+      if (lqMode == "Validate")
+        {
+          std::cout << "CARP_LQ_AGREEMENT windows=" << g_lqWindows << " agree=" << g_lqAgreements
+                    << " ratio=" << (g_lqWindows ? (double) g_lqAgreements / g_lqWindows : 0) << "\n";
+        }
+    }
+#ifdef NS3_MPI
+  else
+    {
+      // The counters of the ranks are summed into the summary of a single process
+      std::vector<double> mine = stats->GetCounters ();
+      std::vector<double> total (mine.size ());
+      MPI_Reduce (&mine[0], &total[0], mine.size (), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      double delayMax = stats->GetDelayMax ();
+      double totalDelayMax = 0;
+      MPI_Reduce (&delayMax, &totalDelayMax, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+      uint32_t totalCut = 0;
+      MPI_Reduce (&cutSources, &totalCut, 1, MPI_UNSIGNED, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (rank == 0)
+        {
+          std::cout << "CARP_PARTITION ranks=" << ranks << " halo=" << halo << " cut_sources=" << totalCut << "\n";
+          CarpStatsCollector::PrintCounters (std::cout, total, totalDelayMax, activeTime);
+        }
+    }
+#endif
   Simulator::Destroy();
+#ifdef NS3_MPI
+  if (splitArea)
+    {
+      MpiInterface::Disable ();
+    }
+#endif
 
   return 0;
 }
@@ -0,0 +1,318 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Scaling benchmark of a CARP scenario.
+ *
+ * Runs one fixed-seed random deployment per node count and data rate, one at
+ * a time so that the runs do not compete for the cores, and writes as CSV the
+ * wall time, simulator events per second, peak RSS, and control frames and
+ * simulator events per delivered data packet of each. The deployment keeps its node density: the
+ * side of the area grows with the square root of the node count.
+ *
+ *   carp-bench --out=bench.csv -- build/scratch/onandoffapp_carp
+ *   carp-bench --baseline=bench.csv -- build/scratch/onandoffapp_carp
+ *
+ * With --baseline, every run is compared with the run of the same
+ * configuration in an earlier output. The exit status is 1 when a run
+ * processes fewer events per second or uses more memory than its baseline by
+ * more than --tolerance.
+ */
+
+#include "carp-runner.h"
+
+#include <fstream>
+#include <iostream>
+
+using namespace carp;
+
+struct Config
+{
+  uint32_t m_nodes;
+  uint32_t m_rate;
+};
+
+struct Result
+{
+  Result () : m_ok (false), m_wallTime (0), m_events (0), m_maxRss (0),
+              m_sent (0), m_received (0), m_controlPackets (0) {}
+  double GetEventRate () const { return m_wallTime > 0 ? m_events / m_wallTime : 0; }
+  double GetControlPerDelivered () const { return m_received > 0 ? m_controlPackets / m_received : 0; }
+  double GetEventsPerDelivered () const { return m_received > 0 ? m_events / m_received : 0; }
+
+  bool m_ok;
+  double m_wallTime;
+  double m_events;
+  double m_maxRss;
+  double m_sent;
+  double m_received;
+  double m_controlPackets;
+};
+
+typedef std::pair<uint32_t, uint32_t> ConfigKey; // Nodes and data rate
+
+static void
+Usage (void)
+{
+  std::cerr << "usage: carp-bench [--nodes=10,100,1000,5000] [--rates=4000,16000] [--simStop=S]"
+            << " [--spacing=M] [--out=FILE] [--baseline=FILE] [--tolerance=F] -- PROGRAM [ARGS...]\n";
+  std::exit (2);
+}
+
+static std::vector<uint32_t>
+SplitNumbers (const std::string &s)
+{
+  std::vector<uint32_t> out;
+  std::istringstream in (s);
+  std::string item;
+  while (std::getline (in, item, ','))
+    {
+      out.push_back (std::strtoul (item.c_str (), 0, 10));
+    }
+  return out;
+}
+
+static std::vector<std::string>
+SplitFields (const std::string &s)
+{
+  std::vector<std::string> out;
+  std::istringstream in (s);
+  std::string item;
+  while (std::getline (in, item, ','))
+    {
+      out.push_back (item);
+    }
+  return out;
+}
+
+/*
+ * Reads the runs of an earlier output of carp-bench, keyed by configuration.
+ */
+static std::map<ConfigKey, Result>
+ReadBaseline (const std::string &fileName)
+{
+  std::map<ConfigKey, Result> baseline;
+  std::ifstream in (fileName.c_str ());
+  if (!in)
+    {
+      std::perror (fileName.c_str ());
+      std::exit (2);
+    }
+  std::string line;
+  std::getline (in, line);
+  std::vector<std::string> names = SplitFields (line);
+  while (std::getline (in, line))
+    {
+      std::vector<std::string> fields = SplitFields (line);
+      std::map<std::string, double> row;
+      for (size_t i = 0; i < names.size () && i < fields.size (); i++)
+        {
+          row[names[i]] = std::strtod (fields[i].c_str (), 0);
+        }
+      Result r;
+      r.m_ok = row["ok"] != 0;
+      r.m_wallTime = row["wall_s"];
+      r.m_events = row["events"];
+      r.m_maxRss = row["max_rss_kb"];
+      r.m_sent = row["sent"];
+      r.m_received = row["received"];
+      r.m_controlPackets = row["control_packets"];
+      baseline[ConfigKey (row["nodes"], row["rate"])] = r;
+    }
+  return baseline;
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::vector<uint32_t> nodes = SplitNumbers ("10,100,1000,5000");
+  std::vector<uint32_t> rates = SplitNumbers ("4000,16000");
+  std::string simStop = "60";
+  double spacing = 500;
+  double tolerance = 0.1;
+  std::string outFile;
+  std::string baselineFile;
+  std::vector<std::string> program;
+
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--")
+        {
+          program.assign (argv + i + 1, argv + argc);
+          break;
+        }
+      else if (arg.compare (0, 8, "--nodes=") == 0)
+        {
+          nodes = SplitNumbers (arg.substr (8));
+        }
+      else if (arg.compare (0, 8, "--rates=") == 0)
+        {
+          rates = SplitNumbers (arg.substr (8));
+        }
+      else if (arg.compare (0, 10, "--simStop=") == 0)
+        {
+          simStop = arg.substr (10);
+        }
+      else if (arg.compare (0, 10, "--spacing=") == 0)
+        {
+          spacing = std::atof (arg.c_str () + 10);
+        }
+      else if (arg.compare (0, 6, "--out=") == 0)
+        {
+          outFile = arg.substr (6);
+        }
+      else if (arg.compare (0, 11, "--baseline=") == 0)
+        {
+          baselineFile = arg.substr (11);
+        }
+      else if (arg.compare (0, 12, "--tolerance=") == 0)
+        {
+          tolerance = std::atof (arg.c_str () + 12);
+        }
+      else
+        {
+          Usage ();
+        }
+    }
+  if (program.empty () || nodes.empty () || rates.empty ())
+    {
+      Usage ();
+    }
+  std::map<ConfigKey, Result> baseline;
+  if (!baselineFile.empty ())
+    {
+      baseline = ReadBaseline (baselineFile);
+    }
+
+  std::vector<Config> configs;
+  std::vector<Job> work;
+  for (size_t n = 0; n < nodes.size (); n++)
+    {
+      for (size_t r = 0; r < rates.size (); r++)
+        {
+          Config c;
+          c.m_nodes = nodes[n];
+          c.m_rate = rates[r];
+          std::stringstream args;
+          args << "--topology=random --seed=1 --run=1 --trace=none --countEvents=1"
+               << " --simStop=" << simStop
+               << " --nodes=" << c.m_nodes
+               << " --sinks=" << std::max<uint32_t> (1, c.m_nodes / 500)
+               << " --sources=" << std::max<uint32_t> (1, c.m_nodes / 10)
+               << " --area=" << spacing * std::sqrt ((double) c.m_nodes)
+               << " --dataRate=" << c.m_rate;
+          Job job;
+          job.m_id = configs.size ();
+          job.m_argv.push_back (program[0]);
+          std::string arg;
+          while (args >> arg)
+            {
+              job.m_argv.push_back (arg);
+            }
+          // Arguments given after the program override the defaults above
+          job.m_argv.insert (job.m_argv.end (), program.begin () + 1, program.end ());
+          configs.push_back (c);
+          work.push_back (job);
+        }
+    }
+
+  std::vector<Result> results (configs.size ());
+  ProcessPool pool (1);
+  pool.Run (work, [&] (const JobResult &res)
+    {
+      Result &r = results[res.m_id];
+      std::map<std::string, double> kpi;
+      std::map<std::string, double> runtime;
+      r.m_wallTime = res.m_wallTime;
+      r.m_maxRss = res.m_maxRss;
+      r.m_ok = WIFEXITED (res.m_status) && WEXITSTATUS (res.m_status) == 0
+        && ParseSummary (res.m_output, kpi) && ParseSummary (res.m_output, runtime, "CARP_RUNTIME");
+      if (r.m_ok)
+        {
+          r.m_events = runtime["events"];
+          r.m_sent = kpi["sent"];
+          r.m_received = kpi["received"];
+          r.m_controlPackets = kpi["control_packets"];
+        }
+      const Config &c = configs[res.m_id];
+      std::cerr << "carp-bench: nodes " << c.m_nodes << " rate " << c.m_rate << ": "
+                << (r.m_ok ? "" : "FAILED ") << r.m_wallTime << " s\n";
+    });
+
+  std::ofstream file;
+  if (!outFile.empty ())
+    {
+      file.open (outFile.c_str ());
+    }
+  std::ostream &out = outFile.empty () ? std::cout : file;
+
+  out << "nodes,rate,ok,wall_s,events,events_per_s,max_rss_kb,sent,received,control_packets,control_per_delivered,events_per_delivered";
+  if (!baseline.empty ())
+    {
+      out << ",base_events_per_s,base_max_rss_kb,base_control_per_delivered,speedup,rss_ratio,verdict";
+    }
+  out << "\n";
+
+  uint32_t regressions = 0;
+  for (size_t i = 0; i < configs.size (); i++)
+    {
+      const Config &c = configs[i];
+      const Result &r = results[i];
+      out << c.m_nodes << "," << c.m_rate << "," << r.m_ok << "," << r.m_wallTime << ","
+          << (uint64_t) r.m_events << "," << r.GetEventRate () << "," << (uint64_t) r.m_maxRss << ","
+          << (uint64_t) r.m_sent << "," << (uint64_t) r.m_received << ","
+          << (uint64_t) r.m_controlPackets << "," << r.GetControlPerDelivered () << "," << r.GetEventsPerDelivered ();
+      if (!baseline.empty ())
+        {
+          std::map<ConfigKey, Result>::const_iterator it = baseline.find (ConfigKey (c.m_nodes, c.m_rate));
+          if (it == baseline.end () || !it->second.m_ok || !r.m_ok)
+            {
+              out << ",,,,,," << (r.m_ok ? "no-baseline" : "failed");
+              regressions += !r.m_ok;
+            }
+          else
+            {
+              const Result &b = it->second;
+              double speedup = b.GetEventRate () > 0 ? r.GetEventRate () / b.GetEventRate () : 0;
+              double rssRatio = b.m_maxRss > 0 ? r.m_maxRss / b.m_maxRss : 0;
+              // A fixed-seed run that processes a different number of events simulated something else
+              std::string verdict = (r.m_events != b.m_events) ? "changed" : "ok";
+              if (speedup < 1 - tolerance)
+                {
+                  verdict = "slower";
+                }
+              else if (rssRatio > 1 + tolerance)
+                {
+                  verdict = "memory";
+                }
+              regressions += (verdict == "slower" || verdict == "memory");
+              out << "," << b.GetEventRate () << "," << (uint64_t) b.m_maxRss << ","
+                  << b.GetControlPerDelivered () << "," << speedup << "," << rssRatio << "," << verdict;
+            }
+        }
+      out << "\n";
+    }
+
+  if (!baseline.empty ())
+    {
+      std::cerr << "carp-bench: " << regressions << " of " << configs.size () << " runs regressed\n";
+    }
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Drives CarpCore without ns-3.
+ *
+ * By default a node with --neighbors neighbors of random PSR, half of them
+ * closer to the sink, runs --windows selection windows, in which every probe
+ * is acknowledged with the PSR of its neighbor, and then picks the relay of
+ * --decisions data packets with each multipath scheduler among several
+ * relays. The rate of both is printed.
+ *
+ * With --snapshot, the tables of every node of a warm-start snapshot
+ * (AquaSimCarp::SaveSnapshot) are loaded instead, and the relay choices of
+ * every node are printed, so that a change of the selection can be judged on
+ * the neighbor data of a real run.
+ *
+ *   g++ -O2 -std=c++11 -o carp-core-bench tools/carp-core-bench.cc aqua-sim-carp-core.cc
+ *   carp-core-bench --neighbors=32 --decisions=10000000
+ *   carp-core-bench --snapshot=tables.snap --multipath=1 --decisions=1000
+ */
+
+#include "../aqua-sim-carp-core.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace ns3;
+
+/*
+ * Environment of the benchmark: time stands still and every probe is
+ * acknowledged at once with the PSR of its neighbor.
+ */
+class BenchEnv : public CarpCoreEnv
+{
+public:
+  BenchEnv () : m_core (0), m_probes (0), m_rng (1) {}
+  virtual int64_t GetTime () { return 0; }
+  virtual void SendProbe (CarpAddr neighbor, uint8_t frames)
+  {
+    m_probes += frames;
+    for (uint8_t i = 0; i < frames; i++)
+      {
+        if (m_uniform (m_rng) < m_psr[neighbor])
+          {
+            m_core->RecvProbeAck (neighbor);
+          }
+      }
+  }
+
+  CarpCore *m_core;
+  std::map<CarpAddr, double> m_psr;
+  uint64_t m_probes;
+  std::mt19937 m_rng;
+  std::uniform_real_distribution<double> m_uniform;
+};
+
+static void
+Usage (void)
+{
+  std::cerr << "usage: carp-core-bench [--neighbors=N] [--windows=W] [--decisions=D] [--seed=S]"
+            << " [--snapshot=FILE] [--multipath=0|1] [--tolerance=T]\n";
+  std::exit (2);
+}
+
+static double
+Seconds (std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+/*
+ * Reads a snapshot in the layout documented at CarpWriteSnapshot.
+ */
+static std::map<CarpAddr, CarpCoreState>
+ReadSnapshot (const std::string &fileName)
+{
+  std::map<CarpAddr, CarpCoreState> table;
+  std::ifstream is (fileName.c_str (), std::ios::binary);
+  std::string error;
+  if (!CarpReadSnapshot (is, table, error))
+    {
+      std::cerr << "carp-core-bench: " << fileName << ": " << error << "\n";
+      std::exit (2);
+    }
+  return table;
+}
+
+static int
+RunSnapshot (const std::string &fileName, bool multipath, double tolerance, uint64_t decisions)
+{
+  std::map<CarpAddr, CarpCoreState> table = ReadSnapshot (fileName);
+  std::printf ("%6s %5s %8s %8s %8s %6s  relay:share...\n", "node", "hops", "next", "backup", "lq", "relays");
+  uint64_t total = 0;
+  double elapsed = 0;
+  for (std::map<CarpAddr, CarpCoreState>::iterator it = table.begin (); it != table.end (); it++)
+    {
+      CarpCore core;
+      core.SetMultipath (multipath);
+      core.SetMultipathTolerance (tolerance);
+      core.Restore (it->second);
+      std::map<CarpAddr, uint64_t> chosen;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      for (uint64_t d = 0; d < decisions; d++)
+        {
+          chosen[core.SelectRelay (100)]++;
+        }
+      elapsed += Seconds (start);
+      total += decisions;
+      std::printf ("%6u %5u %8u %8u %8.3f %6zu ", (unsigned) it->first, (unsigned) core.GetHopCount (),
+                   (unsigned) core.GetNextHop (), (unsigned) core.GetBackupHop (), core.GetLinkQuality (),
+                   core.GetRelaySet ().size ());
+      for (std::map<CarpAddr, uint64_t>::iterator c = chosen.begin (); c != chosen.end (); c++)
+        {
+          std::printf (" %u:%.3f", (unsigned) c->first, decisions ? (double) c->second / decisions : 0);
+        }
+      std::printf ("\n");
+    }
+  std::printf ("%zu nodes, %.3g relay decisions/s\n", table.size (), elapsed > 0 ? total / elapsed : 0);
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t neighbors = 16;
+  uint64_t windows = 100000;
+  uint64_t decisions = 10000000;
+  uint32_t seed = 1;
+  std::string snapshot;
+  bool multipath = true;
+  double tolerance = 0.1;
+
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg.compare (0, 12, "--neighbors=") == 0)
+        {
+          neighbors = std::strtoul (arg.c_str () + 12, 0, 10);
+        }
+      else if (arg.compare (0, 10, "--windows=") == 0)
+        {
+          windows = std::strtoull (arg.c_str () + 10, 0, 10);
+        }
+      else if (arg.compare (0, 12, "--decisions=") == 0)
+        {
+          decisions = std::strtoull (arg.c_str () + 12, 0, 10);
+        }
+      else if (arg.compare (0, 7, "--seed=") == 0)
+        {
+          seed = std::strtoul (arg.c_str () + 7, 0, 10);
+        }
+      else if (arg.compare (0, 11, "--snapshot=") == 0)
+        {
+          snapshot = arg.substr (11);
+        }
+      else if (arg.compare (0, 12, "--multipath=") == 0)
+        {
+          multipath = std::atoi (arg.c_str () + 12) != 0;
+        }
+      else if (arg.compare (0, 12, "--tolerance=") == 0)
+        {
+          tolerance = std::atof (arg.c_str () + 12);
+        }
+      else
+        {
+          Usage ();
+        }
+    }
+  if (!snapshot.empty ())
+    {
+      return RunSnapshot (snapshot, multipath, tolerance, decisions);
+    }
+  if (neighbors == 0 || neighbors >= UINT16_MAX)
+    {
+      Usage ();
+    }
+
+  BenchEnv env;
+  env.m_rng.seed (seed);
+  CarpCore core (&env);
+  env.m_core = &core;
+  core.SetMultipath (multipath);
+  core.SetMultipathTolerance (tolerance);
+  // Every other neighbor is one hop closer to the sink than the node, with a PSR close enough to
+  // the best one for several of them to share the traffic
+  for (uint32_t n = 1; n <= neighbors; n++)
+    {
+      bool upstream = n % 2;
+      core.RecvHello (n, upstream ? 2 : 3 + env.m_rng () % 6);
+      env.m_psr[n] = upstream ? 0.8 + 0.2 * env.m_uniform (env.m_rng) : env.m_uniform (env.m_rng);
+    }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  for (uint64_t w = 0; w < windows; w++)
+    {
+      core.StartProbes ();
+      core.EndProbes ();
+    }
+  double elapsed = Seconds (start);
+  std::printf ("selection windows: %llu in %.3f s, %.3g windows/s, %.3g probes/s\n",
+               (unsigned long long) windows, elapsed, elapsed > 0 ? windows / elapsed : 0,
+               elapsed > 0 ? env.m_probes / elapsed : 0);
+  std::printf ("next hop %u, backup %u, link quality %.3f, %zu relays\n", (unsigned) core.GetNextHop (),
+               (unsigned) core.GetBackupHop (), core.GetLinkQuality (), core.GetRelaySet ().size ());
+
+  const char *names[] = { "weighted-rr", "deficit-rr" };
+  CarpCore::Scheduler schedulers[] = { CarpCore::WEIGHTED_RR, CarpCore::DEFICIT_RR };
+  for (int s = 0; s < 2; s++)
+    {
+      core.SetScheduler (schedulers[s]);
+      uint64_t check = 0;
+      start = std::chrono::steady_clock::now ();
+      for (uint64_t d = 0; d < decisions; d++)
+        {
+          check += core.SelectRelay (64 + d % 64);
+        }
+      elapsed = Seconds (start);
+      std::printf ("%-12s %llu relay decisions in %.3f s, %.3g decisions/s (checksum %llu)\n", names[s],
+                   (unsigned long long) decisions, elapsed, elapsed > 0 ? decisions / elapsed : 0,
+                   (unsigned long long) check);
+    }
+  return 0;
+}
@@ -0,0 +1,372 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Checks of the decisions of CarpCore, without ns-3.
+ *
+ * Every check builds a node from HELLOs and PSRs given by hand and compares
+ * what the core decides with what the protocol prescribes: the hop count
+ * gradient, the relay and runner-up of a selection window, the share of the
+ * multipath schedulers, the eviction of a full neighbor table and the warm
+ * start round trip. A failed comparison is printed with its line, and the
+ * exit status is then 1.
+ *
+ *   g++ -O2 -std=c++11 -o carp-core-check tools/carp-core-check.cc aqua-sim-carp-core.cc
+ *   carp-core-check
+ */
+
+#include "../aqua-sim-carp-core.h"
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace ns3;
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                     \
+  do                                                                    \
+    {                                                                   \
+      if (!(cond))                                                      \
+        {                                                               \
+          std::cerr << __FILE__ << ":" << __LINE__ << ": " #cond "\n";  \
+          g_failures++;                                                 \
+        }                                                               \
+    }                                                                   \
+  while (0)
+
+#define CHECK_NEAR(a, b, tol) CHECK (std::fabs ((a) - (b)) <= (tol))
+
+/*
+ * A node at 2 hops from the sink with the upstream neighbors 1, 2 and 3 and
+ * the downstream neighbors 4 and 5. HELLOs count the hop that delivered
+ * them, so an upstream neighbor at 1 hop is heard at 2.
+ */
+static void
+MakeNode (CarpCore &core)
+{
+  core.SetLinkQualityWeight (1); // The link quality of a neighbor is the PSR of its last window
+  core.RecvHello (4, 3);
+  core.RecvHello (1, 2);
+  core.RecvHello (2, 2);
+  core.RecvHello (5, 4);
+  core.RecvHello (3, 2);
+}
+
+static std::map<CarpAddr, double>
+Psr (double p1, double p2, double p3, double p4, double p5)
+{
+  std::map<CarpAddr, double> psr;
+  psr[1] = p1;
+  psr[2] = p2;
+  psr[3] = p3;
+  psr[4] = p4;
+  psr[5] = p5;
+  return psr;
+}
+
+static void
+CheckGradient (void)
+{
+  CarpCore core;
+  CHECK (core.GetHopCount () == 0);
+  core.RecvHello (7, 4);
+  CHECK (core.GetHopCount () == 4);
+  CHECK (core.IsUpstream (7));
+  // A shorter path lowers the hop count and leaves the old neighbor downstream
+  core.RecvHello (8, 2);
+  CHECK (core.GetHopCount () == 2);
+  CHECK (core.IsUpstream (8));
+  CHECK (!core.IsUpstream (7));
+  // A longer path neither raises the hop count nor the entry of a known neighbor
+  core.RecvHello (8, 5);
+  core.RecvHello (9, 3);
+  CHECK (core.GetHopCount () == 2);
+  CHECK (core.GetNeighbors ().find (8)->second == 2);
+  CHECK (core.GetNeighbors ().find (9)->second == 3);
+  // The smallest hop count heard from a neighbor is kept
+  core.RecvHello (7, 2);
+  CHECK (core.GetNeighbors ().find (7)->second == 2);
+  CHECK (core.IsUpstream (7));
+  CHECK (!core.IsUpstream (9));
+  CHECK (!core.IsUpstream (10));
+  CHECK (core.GetNeighbors ().size () == 3);
+
+  // Without a hop count nothing is upstream, and no relay is picked
+  CarpCore lost;
+  lost.RecvHello (1, 0);
+  CHECK (lost.GetHopCount () == 0);
+  CHECK (!lost.IsUpstream (1));
+  std::map<CarpAddr, double> psr;
+  psr[1] = 1;
+  lost.EndWindow (psr);
+  CHECK (lost.GetNextHop () == 0);
+  CHECK (lost.SelectRelay (100) == 0);
+}
+
+static void
+CheckWindow (void)
+{
+  // The relay is the best upstream neighbor and the runner-up the second,
+  // whatever their order; downstream neighbors never qualify
+  double orders[3][5] = { { 0.9, 0.6, 0.3, 1.0, 1.0 },
+                          { 0.3, 0.6, 0.9, 1.0, 1.0 },
+                          { 0.6, 0.9, 0.3, 1.0, 1.0 } };
+  CarpAddr best[3] = { 1, 3, 2 };
+  CarpAddr second[3] = { 2, 2, 1 };
+  for (int o = 0; o < 3; o++)
+    {
+      CarpCore core;
+      MakeNode (core);
+      const double *p = orders[o];
+      core.EndWindow (Psr (p[0], p[1], p[2], p[3], p[4]));
+      CHECK (core.GetNextHop () == best[o]);
+      CHECK (core.GetBackupHop () == second[o]);
+      CHECK_NEAR (core.GetLinkQuality (), 0.9, 1e-12);
+    }
+
+  // The probes of a window go to the upstream neighbors only
+  CarpCore core;
+  MakeNode (core);
+  core.StartProbes ();
+  CHECK (core.GetProbedCount () == 3);
+  for (int i = 0; i < core.GetProbeCount (); i++)
+    {
+      core.RecvProbeAck (2);
+      core.RecvProbeAck (4);
+    }
+  core.RecvProbeAck (3);
+  core.EndProbes ();
+  CHECK (core.GetNextHop () == 2);
+  CHECK (core.GetBackupHop () == 3);
+  CHECK_NEAR (core.GetLinkQuality (), 1.0, 1e-12);
+  CHECK (core.GetNeighborLq ().find (4) == core.GetNeighborLq ().end ());
+
+  // Only the relays within the tolerance of the best one form the relay set
+  core.SetMultipath (true);
+  core.SetMultipathTolerance (0.25);
+  core.EndWindow (Psr (0.5, 0.9, 0.7, 1.0, 1.0));
+  CHECK (core.GetRelaySet ().size () == 2);
+  core.SetMultipathTolerance (0.5);
+  core.EndWindow (Psr (0.5, 0.9, 0.7, 1.0, 1.0));
+  CHECK (core.GetRelaySet ().size () == 3);
+}
+
+/*
+ * Hands decisions packets to the relays of a node whose relays have the
+ * link qualities p1, p2 and p3 and returns the share of every relay.
+ */
+static std::map<CarpAddr, double>
+Share (CarpCore::Scheduler scheduler, double p1, double p2, double p3, uint32_t decisions)
+{
+  CarpCore core;
+  MakeNode (core);
+  core.SetMultipath (true);
+  core.SetMultipathTolerance (1);
+  core.SetScheduler (scheduler);
+  core.EndWindow (Psr (p1, p2, p3, 1.0, 1.0));
+  std::map<CarpAddr, double> share;
+  for (uint32_t d = 0; d < decisions; d++)
+    {
+      share[core.SelectRelay (100)] += 1.0 / decisions;
+    }
+  return share;
+}
+
+static void
+CheckSchedulers (void)
+{
+  CarpCore::Scheduler schedulers[] = { CarpCore::WEIGHTED_RR, CarpCore::DEFICIT_RR };
+  for (int s = 0; s < 2; s++)
+    {
+      // Every relay gets packets in proportion to its link quality
+      std::map<CarpAddr, double> share = Share (schedulers[s], 0.6, 0.3, 0.9, 18000);
+      CHECK (share.size () == 3);
+      CHECK_NEAR (share[1], 0.6 / 1.8, 0.01);
+      CHECK_NEAR (share[2], 0.3 / 1.8, 0.01);
+      CHECK_NEAR (share[3], 0.9 / 1.8, 0.01);
+
+      // A relay written off by MAC feedback gets nothing
+      CarpCore core;
+      MakeNode (core);
+      core.SetMultipath (true);
+      core.SetMultipathTolerance (1);
+      core.SetScheduler (schedulers[s]);
+      core.EndWindow (Psr (0.6, 0.3, 0.9, 1.0, 1.0));
+      core.RecvTxOutcome (2, false, 1);
+      share.clear ();
+      for (int d = 0; d < 1000; d++)
+        {
+          share[core.SelectRelay (100)]++;
+        }
+      CHECK (share.find (2) == share.end ());
+      CHECK (share.size () == 2);
+
+      // With every weight at 0 the scheduler falls back to the next hop at once
+      core.RecvTxOutcome (1, false, 1);
+      core.RecvTxOutcome (3, false, 1);
+      uint32_t count = 1;
+      CHECK (core.SelectRelay (100, &count) == core.GetNextHop ());
+      CHECK (count == 0);
+    }
+
+  // Without multipath, or with a single relay, every packet goes to the next hop
+  std::map<CarpAddr, double> single = Share (CarpCore::WEIGHTED_RR, 0.9, 0, 0, 100);
+  CHECK (single.size () == 1 && single.begin ()->first == 1);
+}
+
+static void
+CheckEviction (void)
+{
+  CarpCore core;
+  core.SetLinkQualityWeight (1);
+  core.SetMaxNeighbors (3);
+  core.RecvHello (1, 2);
+  core.RecvHello (2, 3);
+  core.RecvHello (3, 4);
+  CHECK (core.GetNeighbors ().size () == 3);
+
+  // A neighbor no closer than the furthest one is left out
+  core.RecvHello (4, 4);
+  CHECK (core.GetNeighbors ().size () == 3);
+  CHECK (core.GetNeighbors ().count (4) == 0);
+
+  // A closer one takes the place of the furthest one
+  core.RecvHello (5, 2);
+  CHECK (core.GetNeighbors ().size () == 3);
+  CHECK (core.GetNeighbors ().count (5) == 1);
+  CHECK (core.GetNeighbors ().count (3) == 0);
+
+  // The next hop and the backup hop stay, even when they are the furthest
+  std::map<CarpAddr, double> psr;
+  psr[1] = 0.9;
+  psr[5] = 0.8;
+  core.SetMultipath (true);
+  core.SetMultipathTolerance (1);
+  core.EndWindow (psr);
+  CHECK (core.GetNextHop () == 1 && core.GetBackupHop () == 5);
+  core.RecvHello (6, 1);
+  CHECK (core.GetNeighbors ().count (2) == 0);
+  CHECK (core.GetNeighbors ().count (6) == 1);
+  core.RecvHello (7, 1);
+  CHECK (core.GetNeighbors ().count (7) == 0);
+  CHECK (core.GetNeighbors ().count (1) == 1 && core.GetNeighbors ().count (5) == 1);
+
+  // An evicted neighbor leaves the link quality table and the relay set too
+  CarpCore small;
+  small.SetLinkQualityWeight (1);
+  small.SetMaxNeighbors (3);
+  small.SetMultipath (true);
+  small.SetMultipathTolerance (1);
+  small.RecvHello (1, 2);
+  small.RecvHello (2, 2);
+  small.RecvHello (3, 2);
+  std::map<CarpAddr, double> three;
+  three[1] = 0.9;
+  three[2] = 0.8;
+  three[3] = 0.7;
+  small.EndWindow (three);
+  CHECK (small.GetRelaySet ().size () == 3);
+  small.RecvHello (4, 1);
+  CHECK (small.GetNeighbors ().count (3) == 0);
+  CHECK (small.GetNeighborLq ().count (3) == 0);
+  CHECK (small.GetRelaySet ().size () == 2);
+}
+
+static bool
+SameState (const CarpCoreState &a, const CarpCoreState &b)
+{
+  return a.m_hopCount == b.m_hopCount && a.m_nextHop == b.m_nextHop && a.m_backupHop == b.m_backupHop
+         && a.m_linkQuality == b.m_linkQuality && a.m_neighbor == b.m_neighbor && a.m_neighborLq == b.m_neighborLq;
+}
+
+static void
+CheckWarmStart (void)
+{
+  CarpCore core;
+  MakeNode (core);
+  core.SetMultipath (true);
+  core.SetMultipathTolerance (0.5);
+  core.EndWindow (Psr (0.6, 0.3, 0.9, 1.0, 1.0));
+  CarpCoreState saved = core.Save ();
+
+  // Restoring a saved state gives the same tables and the same decisions
+  CarpCore restored;
+  restored.SetMultipath (true);
+  restored.SetMultipathTolerance (0.5);
+  restored.Restore (saved);
+  CHECK (SameState (restored.Save (), saved));
+  CHECK (restored.GetRelaySet ().size () == core.GetRelaySet ().size ());
+  for (int d = 0; d < 100; d++)
+    {
+      CHECK (restored.SelectRelay (100) == core.SelectRelay (100));
+    }
+
+  // So does a snapshot, where neighbors without an estimate get one of 0
+  std::map<CarpAddr, CarpCoreState> nodes;
+  nodes[7] = saved;
+  std::stringstream snapshot;
+  CarpWriteSnapshot (snapshot, nodes);
+  std::map<CarpAddr, CarpCoreState> read;
+  std::string error;
+  CHECK (CarpReadSnapshot (snapshot, read, error));
+  CHECK (read.size () == 1 && read.count (7) == 1);
+  CarpCoreState expected = saved;
+  for (std::map<CarpAddr, uint16_t>::iterator it = expected.m_neighbor.begin (); it != expected.m_neighbor.end (); it++)
+    {
+      expected.m_neighborLq.insert (std::make_pair (it->first, 0.0));
+    }
+  CHECK (SameState (read[7], expected));
+  CarpCore reloaded;
+  reloaded.SetMultipath (true);
+  reloaded.SetMultipathTolerance (0.5);
+  reloaded.Restore (read[7]);
+  CHECK (reloaded.GetNextHop () == 3 && reloaded.GetBackupHop () == 1);
+  CHECK (reloaded.GetRelaySet ().size () == core.GetRelaySet ().size ());
+
+  // Damaged snapshots are refused
+  std::string bytes = snapshot.str ();
+  std::stringstream truncated (bytes.substr (0, bytes.size () - 1));
+  CHECK (!CarpReadSnapshot (truncated, read, error));
+  std::stringstream trailing (bytes + "x");
+  CHECK (!CarpReadSnapshot (trailing, read, error));
+  std::string other = bytes;
+  other[8] = 1; // Version 1, written in host byte order
+  std::stringstream version (other);
+  CHECK (!CarpReadSnapshot (version, read, error));
+}
+
+int
+main (void)
+{
+  CheckGradient ();
+  CheckWindow ();
+  CheckSchedulers ();
+  CheckEviction ();
+  CheckWarmStart ();
+  if (g_failures)
+    {
+      std::cerr << g_failures << " checks failed\n";
+      return 1;
+    }
+  std::cout << "all checks passed\n";
+  return 0;
+}
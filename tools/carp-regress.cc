@@ -0,0 +1,435 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Baseline comparison of the CARP scenarios.
+ *
+ * Runs every scenario of a scenario file (tools/carp-regress.scenarios) for a
+ * few replicates and compares the mean PSR, throughput, latency and control
+ * frames per delivered packet with a baseline file. A metric fails when it
+ * leaves its band around the baseline, and the exit status is then 1.
+ * --update runs the scenarios and writes their means as the new baseline
+ * instead, keeping the entries of the scenarios that were not run if they
+ * come from the same build.
+ *
+ * The KPIs depend on the ns-3 and Aqua-Sim versions the module is built
+ * against, so no baseline comes with the module: it has to be recorded once
+ * with --update from a trusted build, and --build names that build in the
+ * file. Until then the check stops at once with status 3, and scenarios
+ * without a baseline are reported as not checked, with status 3 unless
+ * something failed. A comparison given a --build other than the recorded one
+ * stops with status 3 as well, since its KPIs are not comparable.
+ *
+ *   carp-regress --update --build="ns-3.27 aqua-sim-ng 1a2b3c4" -- build/scratch/onandoffapp_carp
+ *   carp-regress --build="ns-3.27 aqua-sim-ng 1a2b3c4" -- build/scratch/onandoffapp_carp
+ *   carp-regress --only=topo1,topo2 --band=latency=0.2 -- build/scratch/onandoffapp_carp
+ */
+
+#include "carp-runner.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace carp;
+
+struct Scenario
+{
+  std::string m_name;
+  std::vector<std::string> m_args;
+  std::map<std::string, RunningStat> m_kpi;
+  uint32_t m_failed;
+};
+
+/*
+ * Allowed deviation of a metric from its baseline: the larger of a fraction
+ * of the baseline and an absolute floor.
+ */
+struct Band
+{
+  double m_relative;
+  double m_absolute;
+};
+
+static const char *g_metrics[] = { "psr", "throughput", "latency", "control_per_delivered" };
+static const size_t g_nMetrics = sizeof (g_metrics) / sizeof (g_metrics[0]);
+
+static void
+Usage (void)
+{
+  std::cerr << "usage: carp-regress [--scenarios=FILE] [--baseline=FILE] [--update] [--only=NAME,...]"
+            << " [--replicates=R] [--jobs=N] [--band=METRIC=FRACTION] [--build=TEXT] -- PROGRAM [ARGS...]\n";
+  std::exit (2);
+}
+
+static std::vector<std::string>
+Split (const std::string &s, char sep)
+{
+  std::vector<std::string> out;
+  std::istringstream in (s);
+  std::string item;
+  while (std::getline (in, item, sep))
+    {
+      out.push_back (item);
+    }
+  return out;
+}
+
+// Lines of a file without comments and blank lines, split at white space
+static std::vector<std::vector<std::string> >
+ReadLines (const std::string &fileName, bool required)
+{
+  std::vector<std::vector<std::string> > lines;
+  std::ifstream in (fileName.c_str ());
+  if (!in)
+    {
+      if (required)
+        {
+          std::perror (fileName.c_str ());
+          std::exit (2);
+        }
+      return lines;
+    }
+  std::string line;
+  while (std::getline (in, line))
+    {
+      line = line.substr (0, line.find ('#'));
+      std::istringstream words (line);
+      std::vector<std::string> fields;
+      std::string word;
+      while (words >> word)
+        {
+          fields.push_back (word);
+        }
+      if (!fields.empty ())
+        {
+          lines.push_back (fields);
+        }
+    }
+  return lines;
+}
+
+// Line of the baseline naming the build it was recorded from
+static const char *g_buildKey = "@build";
+
+// Baseline entries: scenario name, then metric=value pairs; build receives the @build line
+static std::map<std::string, std::map<std::string, double> >
+ReadBaseline (const std::string &fileName, std::string &build)
+{
+  std::map<std::string, std::map<std::string, double> > baseline;
+  std::vector<std::vector<std::string> > lines = ReadLines (fileName, false);
+  build.clear ();
+  for (size_t l = 0; l < lines.size (); l++)
+    {
+      if (lines[l][0] == g_buildKey)
+        {
+          for (size_t f = 1; f < lines[l].size (); f++)
+            {
+              build += (f > 1 ? " " : "") + lines[l][f];
+            }
+          continue;
+        }
+      std::map<std::string, double> &entry = baseline[lines[l][0]];
+      for (size_t f = 1; f < lines[l].size (); f++)
+        {
+          std::string::size_type eq = lines[l][f].find ('=');
+          if (eq != std::string::npos)
+            {
+              entry[lines[l][f].substr (0, eq)] = std::strtod (lines[l][f].c_str () + eq + 1, 0);
+            }
+        }
+    }
+  return baseline;
+}
+
+static void
+WriteBaseline (const std::string &fileName, const std::string &build,
+               const std::map<std::string, std::map<std::string, double> > &baseline)
+{
+  std::ofstream out (fileName.c_str ());
+  if (!out)
+    {
+      std::perror (fileName.c_str ());
+      std::exit (2);
+    }
+  out << "# KPI baseline of the CARP scenarios, written by carp-regress --update\n";
+  out << g_buildKey << " " << build << "\n";
+  out << std::setprecision (10);
+  for (std::map<std::string, std::map<std::string, double> >::const_iterator it = baseline.begin ();
+       it != baseline.end (); it++)
+    {
+      out << it->first;
+      for (std::map<std::string, double>::const_iterator m = it->second.begin (); m != it->second.end (); m++)
+        {
+          out << " " << m->first << "=" << m->second;
+        }
+      out << "\n";
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string scenarioFile = "tools/carp-regress.scenarios";
+  std::string baselineFile = "tools/carp-regress.baseline";
+  bool update = false;
+  std::vector<std::string> only;
+  uint32_t replicates = 3;
+  unsigned jobs = ProcessPool::GetCores ();
+  std::vector<std::string> program;
+  std::string build;
+
+  std::map<std::string, Band> bands;
+  bands["psr"].m_relative = 0;
+  bands["psr"].m_absolute = 0.02;
+  bands["throughput"].m_relative = 0.05;
+  bands["throughput"].m_absolute = 0;
+  bands["latency"].m_relative = 0.10;
+  bands["latency"].m_absolute = 0.001;
+  bands["control_per_delivered"].m_relative = 0.10;
+  bands["control_per_delivered"].m_absolute = 0.1;
+
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--")
+        {
+          program.assign (argv + i + 1, argv + argc);
+          break;
+        }
+      else if (arg.compare (0, 12, "--scenarios=") == 0)
+        {
+          scenarioFile = arg.substr (12);
+        }
+      else if (arg.compare (0, 11, "--baseline=") == 0)
+        {
+          baselineFile = arg.substr (11);
+        }
+      else if (arg == "--update")
+        {
+          update = true;
+        }
+      else if (arg.compare (0, 7, "--only=") == 0)
+        {
+          only = Split (arg.substr (7), ',');
+        }
+      else if (arg.compare (0, 13, "--replicates=") == 0)
+        {
+          replicates = std::atoi (arg.c_str () + 13);
+        }
+      else if (arg.compare (0, 7, "--jobs=") == 0)
+        {
+          jobs = std::atoi (arg.c_str () + 7);
+        }
+      else if (arg.compare (0, 8, "--build=") == 0)
+        {
+          build = arg.substr (8);
+        }
+      else if (arg.compare (0, 7, "--band=") == 0)
+        {
+          std::string spec = arg.substr (7);
+          std::string::size_type eq = spec.find ('=');
+          if (eq == std::string::npos || bands.find (spec.substr (0, eq)) == bands.end ())
+            {
+              Usage ();
+            }
+          bands[spec.substr (0, eq)].m_relative = std::atof (spec.c_str () + eq + 1);
+        }
+      else
+        {
+          Usage ();
+        }
+    }
+  if (program.empty () || replicates == 0)
+    {
+      Usage ();
+    }
+  if (update && build.find_first_not_of (" \t") == std::string::npos)
+    {
+      std::cerr << "carp-regress: --update needs --build to name the ns-3 and Aqua-Sim versions of the build\n";
+      return 2;
+    }
+
+  std::vector<Scenario> scenarios;
+  std::vector<std::vector<std::string> > lines = ReadLines (scenarioFile, true);
+  for (size_t l = 0; l < lines.size (); l++)
+    {
+      if (!only.empty () && std::find (only.begin (), only.end (), lines[l][0]) == only.end ())
+        {
+          continue;
+        }
+      Scenario s;
+      s.m_name = lines[l][0];
+      s.m_args.assign (lines[l].begin () + 1, lines[l].end ());
+      s.m_failed = 0;
+      scenarios.push_back (s);
+    }
+  if (scenarios.empty ())
+    {
+      std::cerr << "carp-regress: no scenario to run\n";
+      return 2;
+    }
+
+  std::string recorded;
+  std::map<std::string, std::map<std::string, double> > baseline = ReadBaseline (baselineFile, recorded);
+  if (!update)
+    {
+      size_t known = 0;
+      for (size_t i = 0; i < scenarios.size (); i++)
+        {
+          known += baseline.count (scenarios[i].m_name);
+        }
+      if (known == 0)
+        {
+          std::cerr << "carp-regress: " << baselineFile << " has no baseline for these scenarios,"
+                    << " record one from a trusted build with --update first\n";
+          return 3;
+        }
+      if (!build.empty () && build != recorded)
+        {
+          std::cerr << "carp-regress: " << baselineFile << " was recorded from \"" << recorded
+                    << "\", not from \"" << build << "\"; record a baseline of this build with --update\n";
+          return 3;
+        }
+      std::cerr << "carp-regress: baseline recorded from \"" << recorded << "\"\n";
+    }
+  else if (!baseline.empty () && recorded != build)
+    {
+      // Entries of another build would be mixed with this one under its name
+      std::cerr << "carp-regress: dropping the baseline of \"" << recorded << "\"\n";
+      baseline.clear ();
+    }
+
+  std::vector<Job> work;
+  for (size_t i = 0; i < scenarios.size (); i++)
+    {
+      for (uint32_t r = 1; r <= replicates; r++)
+        {
+          Job job;
+          job.m_id = i;
+          job.m_argv.push_back (program[0]);
+          job.m_argv.insert (job.m_argv.end (), scenarios[i].m_args.begin (), scenarios[i].m_args.end ());
+          job.m_argv.insert (job.m_argv.end (), program.begin () + 1, program.end ());
+          std::ostringstream run;
+          run << "--run=" << r;
+          job.m_argv.push_back (run.str ());
+          job.m_argv.push_back ("--trace=none");
+          work.push_back (job);
+        }
+    }
+
+  size_t finished = 0;
+  ProcessPool pool (jobs);
+  pool.Run (work, [&] (const JobResult &res)
+    {
+      Scenario &s = scenarios[res.m_id];
+      std::map<std::string, double> kpi;
+      if (!WIFEXITED (res.m_status) || WEXITSTATUS (res.m_status) != 0 || !ParseSummary (res.m_output, kpi))
+        {
+          s.m_failed++;
+        }
+      else
+        {
+          kpi["control_per_delivered"] = kpi["received"] > 0 ? kpi["control_packets"] / kpi["received"] : 0;
+          for (size_t m = 0; m < g_nMetrics; m++)
+            {
+              s.m_kpi[g_metrics[m]].Add (kpi[g_metrics[m]]);
+            }
+        }
+      finished++;
+      std::cerr << "\rcarp-regress: " << finished << "/" << work.size () << " runs done" << std::flush;
+    });
+  std::cerr << "\n";
+
+  uint32_t failures = 0;
+  uint32_t unchecked = 0;
+  for (size_t i = 0; i < scenarios.size (); i++)
+    {
+      const Scenario &s = scenarios[i];
+      if (s.m_failed > 0)
+        {
+          std::cout << "FAIL " << s.m_name << ": " << s.m_failed << " of " << replicates << " runs failed\n";
+          failures++;
+        }
+    }
+  if (update)
+    {
+      if (failures > 0)
+        {
+          std::cerr << "carp-regress: baseline not written\n";
+          return 1;
+        }
+      for (size_t i = 0; i < scenarios.size (); i++)
+        {
+          std::map<std::string, double> &entry = baseline[scenarios[i].m_name];
+          entry.clear ();
+          for (size_t m = 0; m < g_nMetrics; m++)
+            {
+              entry[g_metrics[m]] = scenarios[i].m_kpi.find (g_metrics[m])->second.GetMean ();
+            }
+        }
+      WriteBaseline (baselineFile, build, baseline);
+      std::cerr << "carp-regress: baseline of " << scenarios.size () << " scenarios written to " << baselineFile << "\n";
+      return 0;
+    }
+
+  std::cout << std::left << std::setw (16) << "scenario" << std::setw (24) << "metric" << std::right
+            << std::setw (14) << "baseline" << std::setw (14) << "current" << std::setw (14) << "band"
+            << "  result\n";
+  for (size_t i = 0; i < scenarios.size (); i++)
+    {
+      const Scenario &s = scenarios[i];
+      if (s.m_failed > 0)
+        {
+          continue;
+        }
+      std::map<std::string, std::map<std::string, double> >::const_iterator base = baseline.find (s.m_name);
+      if (base == baseline.end ())
+        {
+          std::cout << "SKIP " << s.m_name << ": no baseline, record one with --update --only=" << s.m_name << "\n";
+          unchecked++;
+          continue;
+        }
+      for (size_t m = 0; m < g_nMetrics; m++)
+        {
+          std::map<std::string, double>::const_iterator b = base->second.find (g_metrics[m]);
+          double current = s.m_kpi.find (g_metrics[m])->second.GetMean ();
+          const Band &band = bands[g_metrics[m]];
+          bool pass = false;
+          double width = 0;
+          if (b != base->second.end ())
+            {
+              width = std::max (band.m_relative * std::fabs (b->second), band.m_absolute);
+              pass = std::fabs (current - b->second) <= width;
+            }
+          failures += !pass;
+          std::cout << std::left << std::setw (16) << s.m_name << std::setw (24) << g_metrics[m] << std::right
+                    << std::setw (14) << (b != base->second.end () ? b->second : 0)
+                    << std::setw (14) << current << std::setw (14) << width
+                    << "  " << (pass ? "ok" : "FAIL") << "\n";
+        }
+    }
+  std::cout << failures << " failures, " << unchecked << " scenarios not checked\n";
+  if (failures)
+    {
+      return 1;
+    }
+  return unchecked ? 3 : 0;
+}
@@ -0,0 +1,260 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Shared pieces of the CARP command-line tools: a pool running scenario
+ * replicates as child processes, the parser of the CARP_SUMMARY line the
+ * scenarios print at the end of a run, and on-line statistics.
+ *
+ * The tools do not link against ns-3, build them with e.g.
+ *   g++ -O2 -std=c++11 -o carp-sweep tools/carp-sweep.cc
+ */
+
+#ifndef CARP_RUNNER_H
+#define CARP_RUNNER_H
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace carp {
+
+/**
+ * Running mean and variance of a metric (Welford), with the half width of
+ * its 95% confidence interval from Student's t distribution.
+ */
+class RunningStat
+{
+public:
+  RunningStat () : m_n (0), m_mean (0), m_m2 (0) {}
+
+  void Add (double x)
+  {
+    m_n++;
+    double delta = x - m_mean;
+    m_mean += delta / m_n;
+    m_m2 += delta * (x - m_mean);
+  }
+  uint64_t GetCount () const { return m_n; }
+  double GetMean () const { return m_mean; }
+  double GetVariance () const { return (m_n > 1) ? m_m2 / (m_n - 1) : 0; }
+  double GetCi95 () const
+  {
+    if (m_n < 2)
+      {
+        return 0;
+      }
+    static const double t[] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    uint64_t df = m_n - 1;
+    double q = (df <= 30) ? t[df - 1] : 1.960;
+    return q * std::sqrt (GetVariance () / m_n);
+  }
+
+private:
+  uint64_t m_n;
+  double m_mean;
+  double m_m2;
+};
+
+/*
+ * Extracts the key=value pairs of the last "CARP_SUMMARY" line of a run, or
+ * of the last line starting with another tag. Returns false if the output
+ * holds no such line.
+ */
+inline bool
+ParseSummary (const std::string &output, std::map<std::string, double> &kpi,
+              const std::string &tag = "CARP_SUMMARY")
+{
+  std::string::size_type pos = output.rfind (tag);
+  if (pos == std::string::npos)
+    {
+      return false;
+    }
+  std::string::size_type end = output.find ('\n', pos);
+  std::istringstream line (output.substr (pos + tag.size (), end - pos - tag.size ()));
+  std::string field;
+  kpi.clear ();
+  while (line >> field)
+    {
+      std::string::size_type eq = field.find ('=');
+      if (eq != std::string::npos)
+        {
+          kpi[field.substr (0, eq)] = std::strtod (field.c_str () + eq + 1, 0);
+        }
+    }
+  return true;
+}
+
+struct Job
+{
+  size_t m_id;
+  std::vector<std::string> m_argv;
+};
+
+struct JobResult
+{
+  size_t m_id;
+  int m_status;         // Exit status as returned by waitpid
+  std::string m_output; // Everything the job wrote to stdout
+  double m_wallTime;    // Seconds from fork to exit
+  long m_maxRss;        // Peak resident set size of the job (KiB)
+};
+
+/**
+ * Runs jobs as child processes, at most a given number at a time, and hands
+ * every finished job to a callback in completion order.
+ */
+class ProcessPool
+{
+public:
+  explicit ProcessPool (unsigned jobs) : m_jobs (jobs ? jobs : 1) {}
+
+  static unsigned GetCores ()
+  {
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? n : 1;
+  }
+
+  void Run (const std::vector<Job> &jobs, std::function<void (const JobResult &)> done)
+  {
+    std::vector<Running> running;
+    size_t next = 0;
+    while (next < jobs.size () || !running.empty ())
+      {
+        while (next < jobs.size () && running.size () < m_jobs)
+          {
+            running.push_back (Spawn (jobs[next++]));
+          }
+
+        std::vector<struct pollfd> fds (running.size ());
+        for (size_t i = 0; i < running.size (); i++)
+          {
+            fds[i].fd = running[i].m_fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+          }
+        if (poll (&fds[0], fds.size (), -1) < 0 && errno != EINTR)
+          {
+            std::perror ("poll");
+            std::exit (1);
+          }
+
+        for (size_t i = running.size (); i-- > 0;)
+          {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+              {
+                continue;
+              }
+            char buf[4096];
+            ssize_t n = read (running[i].m_fd, buf, sizeof (buf));
+            if (n > 0)
+              {
+                running[i].m_result.m_output.append (buf, n);
+                continue;
+              }
+            close (running[i].m_fd);
+            struct rusage usage;
+            wait4 (running[i].m_pid, &running[i].m_result.m_status, 0, &usage);
+            std::chrono::duration<double> wall = std::chrono::steady_clock::now () - running[i].m_start;
+            running[i].m_result.m_wallTime = wall.count ();
+            running[i].m_result.m_maxRss = usage.ru_maxrss;
+            done (running[i].m_result);
+            running.erase (running.begin () + i);
+          }
+      }
+  }
+
+private:
+  struct Running
+  {
+    pid_t m_pid;
+    int m_fd;
+    std::chrono::steady_clock::time_point m_start;
+    JobResult m_result;
+  };
+
+  Running Spawn (const Job &job)
+  {
+    int fd[2];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    if (pipe (fd) < 0)
+      {
+        std::perror ("pipe");
+        std::exit (1);
+      }
+    pid_t pid = fork ();
+    if (pid < 0)
+      {
+        std::perror ("fork");
+        std::exit (1);
+      }
+    if (pid == 0)
+      {
+        dup2 (fd[1], STDOUT_FILENO);
+        close (fd[0]);
+        close (fd[1]);
+        std::vector<char *> argv;
+        for (size_t i = 0; i < job.m_argv.size (); i++)
+          {
+            argv.push_back (const_cast<char *> (job.m_argv[i].c_str ()));
+          }
+        argv.push_back (0);
+        execvp (argv[0], &argv[0]);
+        std::perror (argv[0]);
+        _exit (127);
+      }
+    close (fd[1]);
+    fcntl (fd[0], F_SETFD, FD_CLOEXEC); // Keep later children off this pipe
+    Running r;
+    r.m_pid = pid;
+    r.m_fd = fd[0];
+    r.m_start = start;
+    r.m_result.m_id = job.m_id;
+    r.m_result.m_status = 0;
+    r.m_result.m_wallTime = 0;
+    r.m_result.m_maxRss = 0;
+    return r;
+  }
+
+  unsigned m_jobs;
+};
+
+} // namespace carp
+
+#endif /* CARP_RUNNER_H */
@@ -0,0 +1,233 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Parallel parameter sweep over a CARP scenario.
+ *
+ * Every point of the cartesian product of the --param lists is run
+ * --replicates times, replicate r with --run=r so that it draws its own
+ * deterministic random streams. The replicates run as child processes on all
+ * cores and the KPIs of their CARP_SUMMARY lines are folded on-line into a
+ * mean and 95% confidence interval per point, written as CSV.
+ *
+ *   carp-sweep --jobs=32 --replicates=10 \
+ *     --param=ns3::AquaSimCarp::WaitTime=5ms,50ms \
+ *     --param=nodes=10,100 --param=dataRate=4000,16000 \
+ *     -- build/scratch/onandoffapp_carp --topology=random --simStop=200
+ */
+
+#include "carp-runner.h"
+
+#include <fstream>
+#include <iostream>
+
+using namespace carp;
+
+struct Param
+{
+  std::string m_name;
+  std::vector<std::string> m_values;
+};
+
+struct Point
+{
+  std::vector<std::string> m_values; // One value per parameter
+  std::map<std::string, RunningStat> m_kpi;
+  uint32_t m_failed;
+};
+
+static void
+Usage (void)
+{
+  std::cerr << "usage: carp-sweep [--jobs=N] [--replicates=R] [--out=FILE]"
+            << " --param=NAME=V1,V2,... [--param=...] -- PROGRAM [ARGS...]\n";
+  std::exit (2);
+}
+
+static std::vector<std::string>
+Split (const std::string &s, char sep)
+{
+  std::vector<std::string> out;
+  std::istringstream in (s);
+  std::string item;
+  while (std::getline (in, item, sep))
+    {
+      out.push_back (item);
+    }
+  return out;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned jobs = ProcessPool::GetCores ();
+  uint32_t replicates = 10;
+  std::string outFile;
+  std::vector<Param> params;
+  std::vector<std::string> program;
+
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--")
+        {
+          program.assign (argv + i + 1, argv + argc);
+          break;
+        }
+      else if (arg.compare (0, 7, "--jobs=") == 0)
+        {
+          jobs = std::atoi (arg.c_str () + 7);
+        }
+      else if (arg.compare (0, 13, "--replicates=") == 0)
+        {
+          replicates = std::atoi (arg.c_str () + 13);
+        }
+      else if (arg.compare (0, 6, "--out=") == 0)
+        {
+          outFile = arg.substr (6);
+        }
+      else if (arg.compare (0, 8, "--param=") == 0)
+        {
+          std::string spec = arg.substr (8);
+          std::string::size_type eq = spec.rfind ('=');
+          if (eq == std::string::npos)
+            {
+              Usage ();
+            }
+          Param p;
+          p.m_name = spec.substr (0, eq);
+          p.m_values = Split (spec.substr (eq + 1), ',');
+          params.push_back (p);
+        }
+      else
+        {
+          Usage ();
+        }
+    }
+  if (program.empty () || replicates == 0)
+    {
+      Usage ();
+    }
+
+  // Cartesian product of the parameter lists
+  std::vector<Point> points (1);
+  points[0].m_failed = 0;
+  for (size_t p = 0; p < params.size (); p++)
+    {
+      std::vector<Point> next;
+      for (size_t i = 0; i < points.size (); i++)
+        {
+          for (size_t v = 0; v < params[p].m_values.size (); v++)
+            {
+              Point pt = points[i];
+              pt.m_values.push_back (params[p].m_values[v]);
+              next.push_back (pt);
+            }
+        }
+      points.swap (next);
+    }
+
+  std::vector<Job> work;
+  for (size_t i = 0; i < points.size (); i++)
+    {
+      for (uint32_t r = 1; r <= replicates; r++)
+        {
+          Job job;
+          job.m_id = i;
+          job.m_argv = program;
+          for (size_t p = 0; p < params.size (); p++)
+            {
+              job.m_argv.push_back ("--" + params[p].m_name + "=" + points[i].m_values[p]);
+            }
+          std::ostringstream run;
+          run << "--run=" << r;
+          job.m_argv.push_back (run.str ());
+          work.push_back (job);
+        }
+    }
+
+  std::cerr << "carp-sweep: " << points.size () << " points x " << replicates
+            << " replicates on " << jobs << " processes\n";
+  size_t finished = 0;
+  ProcessPool pool (jobs);
+  pool.Run (work, [&] (const JobResult &res)
+    {
+      Point &pt = points[res.m_id];
+      std::map<std::string, double> kpi;
+      if (!WIFEXITED (res.m_status) || WEXITSTATUS (res.m_status) != 0
+          || !ParseSummary (res.m_output, kpi))
+        {
+          pt.m_failed++;
+        }
+      else
+        {
+          for (std::map<std::string, double>::iterator it = kpi.begin (); it != kpi.end (); it++)
+            {
+              pt.m_kpi[it->first].Add (it->second);
+            }
+        }
+      finished++;
+      std::cerr << "\rcarp-sweep: " << finished << "/" << work.size () << " runs done" << std::flush;
+    });
+  std::cerr << "\n";
+
+  std::ofstream file;
+  if (!outFile.empty ())
+    {
+      file.open (outFile.c_str ());
+    }
+  std::ostream &out = outFile.empty () ? std::cout : file;
+
+  std::vector<std::string> metrics;
+  for (size_t i = 0; i < points.size () && metrics.empty (); i++)
+    {
+      for (std::map<std::string, RunningStat>::iterator it = points[i].m_kpi.begin ();
+           it != points[i].m_kpi.end (); it++)
+        {
+          metrics.push_back (it->first);
+        }
+    }
+
+  for (size_t p = 0; p < params.size (); p++)
+    {
+      out << params[p].m_name << ",";
+    }
+  out << "replicates,failed";
+  for (size_t m = 0; m < metrics.size (); m++)
+    {
+      out << "," << metrics[m] << "_mean," << metrics[m] << "_ci95";
+    }
+  out << "\n";
+
+  for (size_t i = 0; i < points.size (); i++)
+    {
+      for (size_t p = 0; p < params.size (); p++)
+        {
+          out << points[i].m_values[p] << ",";
+        }
+      out << replicates - points[i].m_failed << "," << points[i].m_failed;
+      for (size_t m = 0; m < metrics.size (); m++)
+        {
+          const RunningStat &st = points[i].m_kpi[metrics[m]];
+          out << "," << st.GetMean () << "," << st.GetCi95 ();
+        }
+      out << "\n";
+    }
+  return 0;
+}
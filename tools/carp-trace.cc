@@ -0,0 +1,224 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Reader of the CARP binary packet traces written by CarpTraceWriter.
+ * The trace is memory-mapped and printed as text, converted to CSV, or
+ * summarised per event and packet type.
+ *
+ *   g++ -O2 -std=c++11 -o carp-trace tools/carp-trace.cc
+ *   carp-trace carp_sim_static.ctr            # one line per record
+ *   carp-trace --csv carp_sim_static.ctr > trace.csv
+ *   carp-trace --summary carp_sim_static.ctr
+ */
+
+#include "../aqua-sim-carp-trace-record.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+static const char *g_events[] = { "TX", "RX", "DELIVER", "DROP", "SEND" };
+static const char *g_types[] = { "ACK", "DATA", "LQ_DATA", "AGG", "DATA_ACK", "?", "?", "?",
+                                 "?", "?", "?", "?", "?", "?", "?", "?", "HELLO", "PING", "PONG" };
+
+static const char *
+Name (const char **names, size_t n, uint8_t v)
+{
+  return (v < n) ? names[v] : "?";
+}
+
+/**
+ * Read-only mapping of a trace file.
+ */
+class CarpTraceFile
+{
+public:
+  CarpTraceFile () : m_fd (-1), m_map (0), m_size (0) {}
+  ~CarpTraceFile ()
+  {
+    if (m_map)
+      {
+        munmap (m_map, m_size);
+      }
+    if (m_fd >= 0)
+      {
+        close (m_fd);
+      }
+  }
+
+  bool Open (const char *fileName)
+  {
+    struct stat st;
+    m_fd = open (fileName, O_RDONLY);
+    if (m_fd < 0 || fstat (m_fd, &st) < 0)
+      {
+        std::perror (fileName);
+        return false;
+      }
+    m_size = st.st_size;
+    if (m_size < sizeof (CarpTraceFileHeader))
+      {
+        std::fprintf (stderr, "%s: not a CARP trace\n", fileName);
+        return false;
+      }
+    m_map = mmap (0, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (m_map == MAP_FAILED)
+      {
+        m_map = 0;
+        std::perror ("mmap");
+        return false;
+      }
+    madvise (m_map, m_size, MADV_SEQUENTIAL);
+    const CarpTraceFileHeader *h = (const CarpTraceFileHeader *) m_map;
+    if (std::memcmp (h->m_magic, "CARPTRC1", sizeof (h->m_magic)) != 0
+        || h->m_recordSize != sizeof (CarpTraceRecord))
+      {
+        std::fprintf (stderr, "%s: not a CARP trace of this version\n", fileName);
+        return false;
+      }
+    return true;
+  }
+
+  size_t GetN () const
+  {
+    return (m_size - sizeof (CarpTraceFileHeader)) / sizeof (CarpTraceRecord);
+  }
+  const CarpTraceRecord *Begin () const
+  {
+    return (const CarpTraceRecord *) ((const char *) m_map + sizeof (CarpTraceFileHeader));
+  }
+
+private:
+  int m_fd;
+  void *m_map;
+  size_t m_size;
+};
+
+static void
+Usage (void)
+{
+  std::fprintf (stderr, "usage: carp-trace [--csv|--summary] TRACE\n");
+  std::exit (2);
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string mode = "text";
+  const char *fileName = 0;
+  for (int i = 1; i < argc; i++)
+    {
+      if (std::strcmp (argv[i], "--csv") == 0)
+        {
+          mode = "csv";
+        }
+      else if (std::strcmp (argv[i], "--summary") == 0)
+        {
+          mode = "summary";
+        }
+      else if (argv[i][0] != '-' && !fileName)
+        {
+          fileName = argv[i];
+        }
+      else
+        {
+          Usage ();
+        }
+    }
+  if (!fileName)
+    {
+      Usage ();
+    }
+
+  CarpTraceFile trace;
+  if (!trace.Open (fileName))
+    {
+      return 1;
+    }
+  const CarpTraceRecord *r = trace.Begin ();
+  const CarpTraceRecord *end = r + trace.GetN ();
+  const size_t nEvents = sizeof (g_events) / sizeof (g_events[0]);
+  const size_t nTypes = sizeof (g_types) / sizeof (g_types[0]);
+
+  if (mode == "summary")
+    {
+      uint64_t count[nEvents + 1][nTypes + 1];
+      uint64_t bytes[nEvents + 1];
+      std::memset (count, 0, sizeof (count));
+      std::memset (bytes, 0, sizeof (bytes));
+      int64_t first = (r != end) ? r->m_time : 0;
+      int64_t last = first;
+      for (; r != end; r++)
+        {
+          size_t e = std::min<size_t> (r->m_event, nEvents);
+          count[e][std::min<size_t> (r->m_type, nTypes)]++;
+          bytes[e] += r->m_size;
+          last = r->m_time;
+        }
+      std::printf ("records %zu, %.6f s to %.6f s\n", trace.GetN (), first / 1e9, last / 1e9);
+      std::printf ("%-8s", "event");
+      for (size_t t = 0; t <= nTypes; t++)
+        {
+          std::printf (" %10s", Name (g_types, nTypes, t));
+        }
+      std::printf (" %12s\n", "bytes");
+      for (size_t e = 0; e <= nEvents; e++)
+        {
+          std::printf ("%-8s", Name (g_events, nEvents, e));
+          for (size_t t = 0; t <= nTypes; t++)
+            {
+              std::printf (" %10llu", (unsigned long long) count[e][t]);
+            }
+          std::printf (" %12llu\n", (unsigned long long) bytes[e]);
+        }
+      return 0;
+    }
+
+  if (mode == "csv")
+    {
+      std::printf ("time,node,event,type,uid,size,src,dst,next,hops\n");
+    }
+  for (; r != end; r++)
+    {
+      const char *event = Name (g_events, nEvents, r->m_event);
+      const char *type = Name (g_types, nTypes, r->m_type);
+      if (mode == "csv")
+        {
+          std::printf ("%.9f,%u,%s,%s,%llu,%u,%u,%u,%u,%u\n", r->m_time / 1e9, r->m_node, event, type,
+                       (unsigned long long) r->m_uid, r->m_size, r->m_src, r->m_dst, r->m_next, r->m_hops);
+        }
+      else
+        {
+          std::printf ("%.9f node %u %-7s %-8s uid %llu size %u src %u dst %u next %u hops %u\n",
+                       r->m_time / 1e9, r->m_node, event, type, (unsigned long long) r->m_uid,
+                       r->m_size, r->m_src, r->m_dst, r->m_next, r->m_hops);
+        }
+    }
+  return 0;
+}
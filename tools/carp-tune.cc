@@ -0,0 +1,343 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2016 Michigan Technological University
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Tunes the WaitTime, HelloTime and ProbeCount attributes of CARP for a
+ * scenario by successive halving.
+ *
+ * Every combination of the candidate lists runs --replicates short
+ * simulations of --simStop seconds. The best 1/--eta of them go on to the
+ * next round, which runs --eta times longer, until a round holds no more than
+ * --eta candidates; its best one wins. Candidates whose mean PSR stays below
+ * --psrFloor rank after all the others, by PSR.
+ * The others rank by mean latency, or by control frames per delivered
+ * packet with --objective=overhead. The last round of the winner is printed
+ * with the attribute settings to use.
+ *
+ * The first round runs every candidate for the same time, so the search
+ * stops there with status 3 when no KPI of any candidate differs from the
+ * others by more than the noise of the replicates. The attributes then have no
+ * visible effect on the scenario, for instance because routes never form,
+ * and any winner would be an accident of the ranking.
+ *
+ *   carp-tune --jobs=32 --psrFloor=0.9 --objective=latency \
+ *     --waitTime=0.1s,0.5s,1s,2s --helloTime=1s,5s,10s --probeCount=2,4,8 \
+ *     -- build/scratch/onandoffapp_carp --topology=random --nodes=200 --area=7000
+ */
+
+#include "carp-runner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+using namespace carp;
+
+struct Candidate
+{
+  std::string m_waitTime;
+  std::string m_helloTime;
+  std::string m_probeCount;
+  std::map<std::string, RunningStat> m_kpi; // Of the last round it ran in
+  uint32_t m_failed;
+
+  double GetPsr () const
+  {
+    std::map<std::string, RunningStat>::const_iterator it = m_kpi.find ("psr");
+    return it == m_kpi.end () ? 0 : it->second.GetMean ();
+  }
+  double Get (const std::string &name) const
+  {
+    std::map<std::string, RunningStat>::const_iterator it = m_kpi.find (name);
+    return it == m_kpi.end () ? 0 : it->second.GetMean ();
+  }
+};
+
+static void
+Usage (void)
+{
+  std::cerr << "usage: carp-tune [--jobs=N] [--replicates=R] [--simStop=S] [--eta=E]"
+            << " [--objective=latency|overhead] [--psrFloor=P]"
+            << " [--waitTime=T1,T2,...] [--helloTime=T1,...] [--probeCount=N1,...] -- PROGRAM [ARGS...]\n";
+  std::exit (2);
+}
+
+static std::vector<std::string>
+Split (const std::string &s, char sep)
+{
+  std::vector<std::string> out;
+  std::istringstream in (s);
+  std::string item;
+  while (std::getline (in, item, sep))
+    {
+      out.push_back (item);
+    }
+  return out;
+}
+
+/*
+ * Value minimized by the search: the objective of a candidate that meets the
+ * PSR floor, or a value above every objective that grows as the PSR falls.
+ */
+static double
+Score (const Candidate &c, const std::string &objective, double psrFloor)
+{
+  if (c.m_failed > 0 || c.m_kpi.empty ())
+    {
+      return std::numeric_limits<double>::infinity ();
+    }
+  if (c.GetPsr () < psrFloor)
+    {
+      return 1e300 * (2 - c.GetPsr ());
+    }
+  if (objective == "overhead")
+    {
+      double received = c.Get ("received");
+      return received > 0 ? c.Get ("control_packets") / received : 1e299;
+    }
+  double latency = c.Get ("latency");
+  return latency > 0 ? latency : 1e299;
+}
+
+static const char *g_kpis[] = { "psr", "latency", "control_per_delivered" };
+static const size_t g_nKpis = sizeof (g_kpis) / sizeof (g_kpis[0]);
+
+/*
+ * Returns true if some KPI differs between the candidates by more than the
+ * 95% confidence interval of their replicates, which are taken from runs of
+ * the same length. Candidates with failed runs are left out.
+ */
+static bool
+KpisDiffer (const std::vector<Candidate> &candidates, const std::vector<size_t> &ran)
+{
+  for (size_t k = 0; k < g_nKpis; k++)
+    {
+      double lo = std::numeric_limits<double>::infinity ();
+      double hi = -lo;
+      double noise = 0;
+      size_t n = 0;
+      for (size_t a = 0; a < ran.size (); a++)
+        {
+          const Candidate &c = candidates[ran[a]];
+          std::map<std::string, RunningStat>::const_iterator it = c.m_kpi.find (g_kpis[k]);
+          if (c.m_failed > 0 || it == c.m_kpi.end ())
+            {
+              continue;
+            }
+          lo = std::min (lo, it->second.GetMean ());
+          hi = std::max (hi, it->second.GetMean ());
+          noise = std::max (noise, it->second.GetCi95 ());
+          n++;
+        }
+      if (n > 1 && hi - lo > noise + 1e-9 * std::max (std::fabs (hi), 1.0))
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned jobs = ProcessPool::GetCores ();
+  uint32_t replicates = 2;
+  double simStop = 50;
+  uint32_t eta = 3;
+  std::string objective = "latency";
+  double psrFloor = 0.9;
+  // WaitTime has to cover the round trip of a probe over the range, 1.3 s at 1000 m
+  std::vector<std::string> waitTimes = Split ("0.2s,0.5s,1s,1.5s,2s,3s", ',');
+  std::vector<std::string> helloTimes = Split ("1s,2s,5s,10s", ',');
+  std::vector<std::string> probeCounts = Split ("2,4,8", ',');
+  std::vector<std::string> program;
+
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--")
+        {
+          program.assign (argv + i + 1, argv + argc);
+          break;
+        }
+      else if (arg.compare (0, 7, "--jobs=") == 0)
+        {
+          jobs = std::atoi (arg.c_str () + 7);
+        }
+      else if (arg.compare (0, 13, "--replicates=") == 0)
+        {
+          replicates = std::atoi (arg.c_str () + 13);
+        }
+      else if (arg.compare (0, 10, "--simStop=") == 0)
+        {
+          simStop = std::atof (arg.c_str () + 10);
+        }
+      else if (arg.compare (0, 6, "--eta=") == 0)
+        {
+          eta = std::atoi (arg.c_str () + 6);
+        }
+      else if (arg.compare (0, 12, "--objective=") == 0)
+        {
+          objective = arg.substr (12);
+        }
+      else if (arg.compare (0, 11, "--psrFloor=") == 0)
+        {
+          psrFloor = std::atof (arg.c_str () + 11);
+        }
+      else if (arg.compare (0, 11, "--waitTime=") == 0)
+        {
+          waitTimes = Split (arg.substr (11), ',');
+        }
+      else if (arg.compare (0, 12, "--helloTime=") == 0)
+        {
+          helloTimes = Split (arg.substr (12), ',');
+        }
+      else if (arg.compare (0, 13, "--probeCount=") == 0)
+        {
+          probeCounts = Split (arg.substr (13), ',');
+        }
+      else
+        {
+          Usage ();
+        }
+    }
+  if (program.empty () || replicates == 0 || eta < 2 || simStop <= 0
+      || (objective != "latency" && objective != "overhead")
+      || waitTimes.empty () || helloTimes.empty () || probeCounts.empty ())
+    {
+      Usage ();
+    }
+
+  std::vector<Candidate> candidates;
+  for (size_t w = 0; w < waitTimes.size (); w++)
+    {
+      for (size_t h = 0; h < helloTimes.size (); h++)
+        {
+          for (size_t p = 0; p < probeCounts.size (); p++)
+            {
+              Candidate c;
+              c.m_waitTime = waitTimes[w];
+              c.m_helloTime = helloTimes[h];
+              c.m_probeCount = probeCounts[p];
+              c.m_failed = 0;
+              candidates.push_back (c);
+            }
+        }
+    }
+
+  ProcessPool pool (jobs);
+  std::vector<size_t> alive;
+  for (size_t i = 0; i < candidates.size (); i++)
+    {
+      alive.push_back (i);
+    }
+  double stop = simStop;
+  for (uint32_t round = 1; ; round++)
+    {
+      std::vector<Job> work;
+      for (size_t a = 0; a < alive.size (); a++)
+        {
+          Candidate &c = candidates[alive[a]];
+          c.m_kpi.clear ();
+          c.m_failed = 0;
+          for (uint32_t r = 1; r <= replicates; r++)
+            {
+              Job job;
+              job.m_id = alive[a];
+              job.m_argv = program;
+              job.m_argv.push_back ("--ns3::AquaSimCarp::WaitTime=" + c.m_waitTime);
+              job.m_argv.push_back ("--ns3::AquaSimCarp::HelloTime=" + c.m_helloTime);
+              job.m_argv.push_back ("--ns3::AquaSimCarp::ProbeCount=" + c.m_probeCount);
+              std::ostringstream args;
+              args << "--simStop=" << stop;
+              job.m_argv.push_back (args.str ());
+              args.str ("");
+              args << "--run=" << r;
+              job.m_argv.push_back (args.str ());
+              work.push_back (job);
+            }
+        }
+
+      std::cerr << "carp-tune: round " << round << ", " << alive.size () << " candidates x "
+                << replicates << " replicates of " << stop << " s\n";
+      pool.Run (work, [&] (const JobResult &res)
+        {
+          Candidate &c = candidates[res.m_id];
+          std::map<std::string, double> kpi;
+          if (!WIFEXITED (res.m_status) || WEXITSTATUS (res.m_status) != 0
+              || !ParseSummary (res.m_output, kpi))
+            {
+              c.m_failed++;
+              return;
+            }
+          kpi["control_per_delivered"] = kpi["received"] > 0 ? kpi["control_packets"] / kpi["received"] : 0;
+          for (std::map<std::string, double>::iterator it = kpi.begin (); it != kpi.end (); it++)
+            {
+              c.m_kpi[it->first].Add (it->second);
+            }
+        });
+
+      std::stable_sort (alive.begin (), alive.end (), [&] (size_t a, size_t b)
+        {
+          return Score (candidates[a], objective, psrFloor) < Score (candidates[b], objective, psrFloor);
+        });
+      for (size_t a = 0; a < alive.size (); a++)
+        {
+          const Candidate &c = candidates[alive[a]];
+          std::cerr << "  WaitTime=" << c.m_waitTime << " HelloTime=" << c.m_helloTime
+                    << " ProbeCount=" << c.m_probeCount << " psr=" << c.GetPsr ()
+                    << " latency=" << c.Get ("latency") << " control_packets=" << c.Get ("control_packets")
+                    << (c.m_failed ? " FAILED" : "") << "\n";
+        }
+      if (round == 1 && alive.size () > 1 && !KpisDiffer (candidates, alive))
+        {
+          std::cerr << "carp-tune: no KPI differs between the " << alive.size ()
+                    << " candidates beyond the noise of the replicates; WaitTime, HelloTime and ProbeCount"
+                    << " have no effect on this scenario, check that its routes form\n";
+          return 3;
+        }
+      if (alive.size () <= eta)
+        {
+          break;
+        }
+      alive.resize (alive.size () / eta);
+      stop *= eta;
+    }
+
+  const Candidate &best = candidates[alive[0]];
+  if (best.m_failed > 0 || best.m_kpi.empty ())
+    {
+      std::cerr << "carp-tune: every run of the last round failed\n";
+      return 1;
+    }
+  double received = best.Get ("received");
+  std::cout << "CARP_TUNE psr=" << best.GetPsr () << " latency=" << best.Get ("latency")
+            << " control_per_delivered=" << (received > 0 ? best.Get ("control_packets") / received : 0)
+            << " feasible=" << (best.GetPsr () >= psrFloor) << "\n"
+            << "--ns3::AquaSimCarp::WaitTime=" << best.m_waitTime
+            << " --ns3::AquaSimCarp::HelloTime=" << best.m_helloTime
+            << " --ns3::AquaSimCarp::ProbeCount=" << best.m_probeCount << "\n";
+  if (best.GetPsr () < psrFloor)
+    {
+      std::cerr << "carp-tune: no candidate reached a PSR of " << psrFloor << ", the best PSR is shown\n";
+      return 1;
+    }
+  return 0;
+}